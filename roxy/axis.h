@@ -4,83 +4,336 @@
 #include <gpio/gpio.h>
 #include <timer/timer.h>
 #include <adc/adc_f3.h>
+#include <interrupt/interrupt.h>
+#include <dma/dma.h>
+#include <spi/spi.h>
+#include <rcc/rcc.h>
+#include <syscfg/syscfg.h>
 #include <os/time.h>
 
+#include "us_clock.h"
+#include "ramfunc.h"
+
+// Velocity is measured over windows of at least this long
+#define AXIS_VELOCITY_WINDOW_US	2000
+// Edges further apart than this don't count as movement on their own
+#define AXIS_EDGE_TIMEOUT_US	20000
+// Adaptive mode: reversals this recent mark the axis as wobbling
+#define AXIS_WOBBLE_US			100000
+// Adaptive mode: sustain covers this many steps at the speed of the last one
+#define AXIS_SUSTAIN_STEPS		4
+#define AXIS_SUSTAIN_MIN_US		4000
+
+// Last captured encoder edge, for axes that timestamp them.
+struct axis_edge_t {
+	uint32_t time;		// us
+	int32_t position;	// Unwrapped count at the edge
+	uint32_t interval;	// us since the edge before, 0 unless both moved the same way within the timeout
+	uint32_t counts;	// Counts moved in that interval
+	int8_t dir;
+	uint32_t seq;		// Increments on every edge with an interval
+};
+
 class Axis {
 	private:
-		uint32_t axis_sustain_start;
-		uint32_t axis_debounce_start;
-
-		uint32_t axis_time = 0;
-		uint32_t last_axis = 0;
+		uint32_t axis_time = 0;			// Of the last process()
+		uint32_t axis_sustained = 0;	// us sustaining so far, added up a process() at a time
+		int32_t last_axis = 0;			// Unwrapped, reduced position behind dir_state
+		uint32_t last_phase = 0;		// last_axis within the period, 0 to period - 1
 		int8_t last_axis_stae = 0;
 
-		uint8_t axis_debounce_time = 0;
-		uint8_t axis_sustain_time = 0;
+		uint32_t axis_sustain_time = 0;	// us
 
-		uint8_t reduction_ratio = 0;
+		uint32_t reduction_step = 1;	// Counts per reduced step, 2 * reduction_ratio + 1
 
-		float deadzone_angle = 0.0f;	// Deadzone before movement from idle is registered
+		uint8_t deadzone = 0;			// 0.5 deg
+		int32_t deadzone_counts = 0;	// Deadzone before movement from idle is registered
 		uint32_t idle_count = 0;		// Count after movement has stopped for some time
 
+		uint32_t scale = 1 << 24;		// Sensitivity as a 8.24 multiplier
+
+		uint32_t velocity_time = 0;
+		int32_t velocity_position = 0;
+
+		bool edge_start = false;		// Start and reverse on a single edge interval
+		uint32_t edge_seq = 0;
+
+		// Adaptive deadzone and sustain
+		bool adaptive = false;
+		int32_t raw_position = 0;		// Unreduced position at the last movement
+		int32_t raw_run = 0;			// Where it last reversed
+		int8_t raw_dir = 0;
+		bool wobbled = false;
+		uint32_t wobble_time = 0;		// Last reversal short of the deadzone
+		int32_t wobble_counts = 0;		// Longest of them while wobbling
+		int32_t stroke_position = 0;	// Where dir_state last took a new sign
+		int8_t stroke_dir = 0;
+		uint32_t motion_speed = 0;		// Peak counts per second over the stroke
+		uint32_t step_speed = 0;		// Counts per second expected after the last step
+		int32_t speed_change = 0;		// Counts per second gained over the last velocity window, per AXIS_VELOCITY_WINDOW_US
+
+		// n * 1000000 / d, truncated, in 32-bit divisions, which the M4 does
+		// in hardware rather than through a 64-bit library call. One division
+		// for the small n seen in practice, exact up to n * d below 2^32.
+		static uint32_t per_second(uint32_t n, uint32_t d) {
+			if(n <= 0xffffffff / 1000000) {
+				return n * 1000000 / d;
+			}
+			return n * (1000000 / d) + n * (1000000 % d) / d;
+		}
+
+		// Smallest movement that covers the deadzone angle, deadzone / 720 of a turn.
+		void update_deadzone() {
+			deadzone_counts = (deadzone * max_count + 719) / 720;
+		}
+
+		// Adaptive mode scales the deadzone down for movement that looks
+		// deliberate. From idle, a quarter of it unless the axis has been
+		// wobbling, reversing before it covered the deadzone. For a reversal of a stroke that covered
+		// the deadzone, down to a single count as the stroke's speed rises
+		// past a quarter turn per second, but never within the wobble.
+		void adapt_deadzone(uint32_t now, int32_t speed, int32_t& start, int32_t& reverse) {
+			int32_t moved = position - raw_position;
+			if(moved) {
+				int8_t dir = moved > 0 ? 1 : -1;
+				if(raw_dir && dir != raw_dir) {
+					int32_t run = raw_position - raw_run;
+					run = run < 0 ? -run : run;
+					if(run < deadzone_counts) {
+						wobbled = true;
+						wobble_time = now;
+						wobble_counts = run > wobble_counts ? run : wobble_counts;
+					}
+					raw_run = raw_position;
+				}
+				raw_dir = dir;
+				raw_position = position;
+			}
+
+			int8_t stroke = dir_state > 0 ? 1 : dir_state < 0 ? -1 : 0;
+			if(stroke != stroke_dir) {
+				stroke_dir = stroke;
+				stroke_position = position;
+				motion_speed = 0;
+			}
+			if(stroke && uint32_t(speed) > motion_speed) {
+				motion_speed = speed;
+			}
+
+			if(!deadzone_counts) {
+				return;
+			}
+
+			if(!wobbled || now - wobble_time >= AXIS_WOBBLE_US) {
+				wobbled = false;
+				wobble_counts = 0;
+				start = (deadzone_counts + 3) / 4;
+			}
+
+			int32_t covered = position - stroke_position;
+			if((covered < 0 ? -covered : covered) < deadzone_counts) {
+				return;
+			}
+
+			uint32_t ref = (max_count + 1) / 4;
+			reverse = int32_t(uint32_t(deadzone_counts) * ref / (ref + motion_speed));
+			if(reverse <= wobble_counts) {
+				reverse = wobble_counts + 1;
+			}
+		}
+
+		// Adaptive mode sustains for AXIS_SUSTAIN_STEPS step intervals at the
+		// speed expected after the last step, within the configured time.
+		uint32_t get_sustain() {
+			if(!adaptive || !step_speed) {
+				return axis_sustain_time;
+			}
+			uint32_t t = per_second(AXIS_SUSTAIN_STEPS * reduction_step, step_speed);
+			if(t < AXIS_SUSTAIN_MIN_US) {
+				t = AXIS_SUSTAIN_MIN_US;
+			}
+			return t < axis_sustain_time ? t : axis_sustain_time;
+		}
+
 	protected:
 		uint16_t max_count = 255;
+		uint32_t period = 256;			// Counts per wrap of the reported value
 		int8_t sensitivity = 0;
 
+		// Counts per turn for the -127/-126/-125 special cases, or 256 * -sens
+		// for reduced sensitivity. Sets max_count, period and the report scale.
+		void set_range(int8_t sens, bool wrap_at_max) {
+			uint32_t turn;
+			if(sens == -127) {
+				turn = 600 * 4;
+			} else if(sens == -126) {
+				turn = 400 * 4;
+			} else if(sens == -125) {
+				turn = 360 * 4;
+			} else if(sens < 0) {
+				turn = 256 * -sens;
+			} else {
+				turn = 256;
+			}
+
+			max_count = turn - 1;
+			period = wrap_at_max ? max_count : turn;
+			sensitivity = sens;
+
+			// Reports run 0-255 per turn, except for positive sensitivity which multiplies.
+			// Rounded up so the truncated product matches exact division for every count.
+			if(sens > 0) {
+				scale = uint32_t(sens) << 24;
+			} else {
+				scale = ((256ull << 24) + turn - 1) / turn;
+			}
+
+			update_deadzone();
+		}
+
 	public:
-		uint32_t count;
+		uint32_t count;					// Reported value, wraps every period
 		int8_t dir_state = 0;
 
-		virtual uint32_t get() = 0;
+		int32_t position = 0;			// Unwrapped counts, as of the last process()
+		int32_t velocity = 0;			// Counts per second, positive is CW
+
+		// From edge timestamps where the axis has them, otherwise the same as
+		// velocity and position. Instantaneous velocity is bounded by the
+		// time since the last edge, so it falls off as soon as the axis slows
+		// down. Position is interpolated between counts, in 1/256 counts.
+		int32_t edge_velocity = 0;
+		int32_t position_fine = 0;
+
+		// Counts moved since enable, without wrapping. Positions are only ever
+		// compared by difference, so they may wrap around the int32_t range.
+		virtual int32_t get_position() = 0;
+
+		virtual bool get_edge(axis_edge_t&) {
+			return false;
+		}
 
-		void set_config(uint8_t _debounce, uint8_t _sustain, uint8_t _reduction, uint8_t _deadzone) {
-			axis_debounce_time = _debounce;
+		// Position in 1/256 counts for axes that resolve finer than a count,
+		// read after get_position().
+		virtual int32_t get_position_fine() {
+			return int32_t(uint32_t(position) << 8);
+		}
+
+		void set_edge_start(bool enable) {
+			edge_start = enable;
+		}
+
+		void set_adaptive(bool enable) {
+			adaptive = enable;
+		}
+
+		void set_config(uint32_t _sustain, uint8_t _reduction, uint8_t _deadzone) {
 			axis_sustain_time = _sustain;
-			reduction_ratio = _reduction;
-			deadzone_angle = (float)_deadzone / 2.0f;
+			reduction_step = 2 * _reduction + 1;
+			deadzone = _deadzone;
+			update_deadzone();
 		}
 
+		// Integer only, so it can run from an interrupt without stacking FPU state.
 		void process() {
-			uint32_t current_time = Time::time();
-			count = get();
+			uint32_t current_time = us_clock.now();
+			uint32_t elapsed = current_time - axis_time;
+			axis_time = current_time;
+			position = get_position();
+
+			uint32_t window = current_time - velocity_time;
+			if(window >= AXIS_VELOCITY_WINDOW_US) {
+				int32_t moved = position - velocity_position;
+				int32_t v = int32_t(per_second(moved < 0 ? -moved : moved, window));
+				v = moved < 0 ? -v : v;
+				speed_change = (v - velocity) * AXIS_VELOCITY_WINDOW_US / int32_t(window);
+				velocity = v;
+				velocity_position = position;
+				velocity_time = current_time;
+			}
+
+			// Movement seen by a single edge interval, which is enough to start
+			// or reverse without waiting for the deadzone.
+			int8_t edge_dir = 0;
+			axis_edge_t edge;
+			if(get_edge(edge)) {
+				uint32_t since = current_time - edge.time;
+				uint32_t span = since > edge.interval ? since : edge.interval;
+
+				if(edge.interval && span < AXIS_EDGE_TIMEOUT_US) {
+					edge_velocity = edge.dir * int32_t(per_second(edge.counts, span));
+				} else {
+					edge_velocity = 0;
+				}
 
-			// Perform reduction
-			uint32_t qe_temp = count;
-			if(reduction_ratio > 0) {
-				qe_temp = uint32_t((float)count / (4.0f * float(reduction_ratio) * 0.5f + 1.0f));
-				qe_temp = uint32_t((float)qe_temp * (4.0f * float(reduction_ratio) * 0.5f + 1.0f));
+				// Extrapolated from the edge, but kept short of the next count.
+				// 1099512 / 2^32 is 256 / 1000000, and edge_velocity is 0 past the
+				// timeout, so the product stays well inside 64 bits.
+				int32_t off = (edge.position - position) * 256 + int32_t((int64_t(edge_velocity) * since * 1099512) >> 32);
+				int32_t lo = edge.dir < 0 ? -255 : 0;
+				int32_t hi = edge.dir > 0 ? 255 : 0;
+				off = off < lo ? lo : off > hi ? hi : off;
+				position_fine = int32_t((uint32_t(position) << 8) + uint32_t(off));
+
+				if(edge_start && edge.seq != edge_seq && edge.interval) {
+					edge_dir = edge.dir;
+				}
+				edge_seq = edge.seq;
+			} else {
+				edge_velocity = velocity;
+				position_fine = get_position_fine();
+			}
+
+			int32_t start_deadzone = deadzone_counts;
+			int32_t reverse_deadzone = deadzone_counts;
+			if(adaptive) {
+				adapt_deadzone(current_time, edge_velocity < 0 ? -edge_velocity : edge_velocity, start_deadzone, reverse_deadzone);
+			}
+			uint32_t sustain = get_sustain();
+
+			// Added up a call at a time, so no clock difference spans more
+			// than one process() and a long sustain can't wrap.
+			if(dir_state == 2 || dir_state == -2) {
+				axis_sustained = axis_sustained > sustain ? axis_sustained : axis_sustained + elapsed;
 			}
 
-			// Get delta
-			int8_t delta = qe_temp - last_axis;
-			// Detect rollover
-			if ((last_axis > (max_count / 2)) && qe_temp < (max_count / 4)) {
-				delta += max_count;
+			// Perform reduction, rounding towards negative infinity
+			int32_t rem = 0;
+			if(reduction_step > 1) {
+				rem = position % int32_t(reduction_step);
+				if(rem < 0) {
+					rem += reduction_step;
+				}
 			}
-			float delta_angle = (float)delta / (float)max_count * 360.0f;
+			int32_t qe_temp = position - rem;
+
+			// Positions don't wrap, so the delta is exact however far the axis moved
+			int32_t prev_axis = last_axis;
+			int32_t delta = int32_t(uint32_t(qe_temp) - uint32_t(last_axis));
 
 			// Logic:
 			// If QE was stationary and is now moving, change must exceed deadzone
 			// If QE was moving and is now stationary, it sustains for a set time / resets deadzone
 			// If QE was moving and is now moving in the opposite direction, change must exceed deadzone to trigger
+			// A fresh edge interval in the direction of the change counts as exceeding the deadzone
 
 			switch(dir_state) {
 				case 0:   // Not moving
 					// Deadzone goes here
-					if(delta > 0 && delta_angle >= deadzone_angle) {
+					if(delta > 0 && (delta >= start_deadzone || edge_dir > 0)) {
 						last_axis = qe_temp;
 						dir_state = 1;
-					} else if(delta < 0 && delta_angle <= -deadzone_angle) {
+					} else if(delta < 0 && (delta <= -start_deadzone || edge_dir < 0)) {
 						last_axis = qe_temp;
 						dir_state = -1;
 					}
 					break;
 				case 1:   // Started moving CW
 					if(delta == 0) {
-						axis_sustain_start = current_time;
+						axis_sustained = 0;
 						last_axis = qe_temp;
 						dir_state = 2;
-					} else if(delta < 0 && delta_angle <= -deadzone_angle) {
+					} else if(delta < 0 && (delta <= -reverse_deadzone || edge_dir < 0)) {
 						last_axis = qe_temp;
 						dir_state = -1;
 					} else if(delta > 0) {
@@ -88,23 +341,23 @@ class Axis {
 					}
 					break;
 				case 2:   // Sustaining CW
-					if(delta <= 0 && ((current_time - axis_sustain_start) > axis_sustain_time)) {
+					if(delta <= 0 && (axis_sustained > sustain)) {
 						last_axis = qe_temp;
 						dir_state = 0;
 					} else if(delta > 0) {
-						axis_sustain_start = current_time;
+						axis_sustained = 0;
 						last_axis = qe_temp;
-					} else if(delta < 0 && delta_angle <= -deadzone_angle) {
+					} else if(delta < 0 && (delta <= -reverse_deadzone || edge_dir < 0)) {
 						last_axis = qe_temp;
 						dir_state = -1;
 					}
 					break;
 				case -1:  // Started moving CCW
 					if(delta == 0) {
-						axis_sustain_start = current_time;
+						axis_sustained = 0;
 						last_axis = qe_temp;
 						dir_state = -2;
-					} else if(delta > 0 && delta_angle >= deadzone_angle) {
+					} else if(delta > 0 && (delta >= reverse_deadzone || edge_dir > 0)) {
 						last_axis = qe_temp;
 						dir_state = 1;
 					} else if(delta < 0) {
@@ -112,50 +365,103 @@ class Axis {
 					}
 					break;
 				case -2:  // Sustaining CCW
-					if(delta >= 0 && ((current_time - axis_sustain_start) > axis_sustain_time)) {
+					if(delta >= 0 && (axis_sustained > sustain)) {
 						last_axis = qe_temp;
 						dir_state = 0;
 					} else if(delta < 0) {
-						axis_sustain_start = current_time;
+						axis_sustained = 0;
 						last_axis = qe_temp;
-					} else if(delta > 0 && delta_angle >= deadzone_angle) {
+					} else if(delta > 0 && (delta >= reverse_deadzone || edge_dir > 0)) {
 						last_axis = qe_temp;
 						dir_state = 1;
 					}
 					break;
 			}
 
-			if(sensitivity == -127) {
-				count = last_axis * (256.0f / (600.0f * 4.0f));
-			} else if(sensitivity == -126) {
-				count = last_axis * (256.0f / (400.0f * 4.0f));
-			} else if(sensitivity == -125) {
-				count = last_axis * (256.0f / (360.0f * 4.0f));
-			} else if(sensitivity < 0) {
-				count = last_axis / -sensitivity;
-			} else if(sensitivity > 0) {
-				count = last_axis * sensitivity;
-			} else {
-				count = last_axis;
+			// Speed to expect after a step, less any deceleration over the next window
+			if(adaptive && dir_state && last_axis != prev_axis) {
+				int32_t speed = edge_velocity < 0 ? -edge_velocity : edge_velocity;
+				int32_t along = dir_state > 0 ? speed_change : -speed_change;
+				int32_t expected = speed + (along < 0 ? along : 0);
+				step_speed = uint32_t(expected > speed / 4 ? expected : speed / 4);
 			}
 
+			// Only the reported value wraps. A call rarely moves a whole period,
+			// so the division is skipped unless it did.
+			int32_t moved = int32_t(uint32_t(last_axis) - uint32_t(prev_axis));
+			if(moved >= int32_t(period) || moved <= -int32_t(period)) {
+				moved %= int32_t(period);
+			}
+			if(moved < 0) {
+				moved += period;
+			}
+			last_phase += moved;
+			if(last_phase >= period) {
+				last_phase -= period;
+			}
+
+			count = uint32_t((uint64_t(last_phase) * scale) >> 24);
+
 			count -= 128;
 		}
 };
 
 class NullAxis : public Axis {
 	public:
-		virtual uint32_t get() final {
+		virtual int32_t get_position() final {
 			return 0;
 		}
 };
 
+// The timer counts over its full 16 bits and is unwrapped by difference,
+// which is exact as long as it moves less than half its range in between.
+// Compare interrupts at each third of the range keep that true while the
+// main loop is stalled, at the cost of an interrupt every 21845 counts.
+//
+// With capture enabled, channels 1 and 2 also latch the count on every
+// active edge of inputs A and B, twice per quadrature cycle, and the
+// interrupt timestamps them. The count tells the direction and rejects an
+// input chattering on its edge, which captures the same count every time.
 class QEAxis : public Axis {
 	private:
 		TIM_t& tim;
+		Interrupt::IRQ irq_n;
+
+		volatile int32_t counter = 0;
+		volatile uint16_t last_cnt = 0;
+
+		axis_edge_t edge = {};
+		bool capture = false;
+
+		RAMINLINE void unwrap() {
+			uint16_t cnt = tim.CNT;
+			counter += int16_t(cnt - last_cnt);
+			last_cnt = cnt;
+		}
+
+		RAMINLINE void capture_edge(uint16_t cap, uint32_t now) {
+			int32_t pos = counter + int16_t(cap - last_cnt);
+			int32_t moved = pos - edge.position;
+			if(moved == 0) {
+				return;
+			}
+
+			int8_t dir = moved > 0 ? 1 : -1;
+			uint32_t interval = now - edge.time;
+			if(dir == edge.dir && interval < AXIS_EDGE_TIMEOUT_US) {
+				edge.interval = interval ? interval : 1;
+				edge.counts = moved > 0 ? moved : -moved;
+				edge.seq++;
+			} else {
+				edge.interval = 0;
+			}
+			edge.time = now;
+			edge.position = pos;
+			edge.dir = dir;
+		}
 	
 	public:
-		QEAxis(TIM_t& t) : tim(t) {}
+		QEAxis(TIM_t& t, Interrupt::IRQ i) : tim(t), irq_n(i) {}
 		
 		void enable(bool invert, int8_t sens) {
 			if(!invert) {
@@ -164,120 +470,199 @@ class QEAxis : public Axis {
 			
 			tim.CCMR1 = (1 << 8) | (1 << 0);
 			tim.SMCR = 3;
+			tim.ARR = 0xffff;
+			tim.CCR3 = 0x5555;
+			tim.CCR4 = 0xaaaa;
 			tim.CR1 = 1;
-			
-			if(sens < 0) {
-				// Special cases
-				if(sens == -127) {
-					tim.ARR = (600 * 4) - 1;
-				} else if(sens == -126) {
-					tim.ARR = (400 * 4) - 1;
-				} else if(sens == -125) {
-					tim.ARR = (360 * 4) - 1;
-				} else {
-					tim.ARR = 256 * -sens - 1;
-				}
-			} else {
-				tim.ARR = 256 - 1;
-			}
-			sensitivity = sens;
-			max_count = tim.ARR;
+
+			set_range(sens, false);
+
+			last_cnt = tim.CNT;
+			tim.SR = 0;
+			tim.DIER = (1 << 4) | (1 << 3) | (1 << 0);	// CC4IE, CC3IE, UIE
+			Interrupt::enable(irq_n);
+		}
+		
+		void enable_capture() {
+			tim.SR &= ~((1 << 10) | (1 << 9) | (1 << 2) | (1 << 1));
+			tim.CCER |= (1 << 4) | (1 << 0);	// CC2E, CC1E
+			tim.DIER |= (1 << 2) | (1 << 1);	// CC2IE, CC1IE
+			capture = true;
 		}
 		
-		virtual uint32_t get() final {
-			return tim.CNT;
+		virtual int32_t get_position() final {
+			Interrupt::disable(irq_n);
+			unwrap();
+			int32_t p = counter;
+			Interrupt::enable(irq_n);
+			return p;
+		}
+
+		virtual bool get_edge(axis_edge_t& e) final {
+			if(!capture) {
+				return false;
+			}
+			Interrupt::disable(irq_n);
+			e = edge;
+			Interrupt::enable(irq_n);
+			return true;
+		}
+
+		RAMFUNC void irq() {
+			uint32_t sr = tim.SR;
+			tim.SR &= ~(sr & ((1 << 10) | (1 << 9) | (1 << 4) | (1 << 3) | (1 << 2) | (1 << 1) | (1 << 0)));
+			unwrap();
+
+			if(sr & ((1 << 2) | (1 << 1))) {
+				uint32_t now = us_clock.now();
+				if(sr & (1 << 1)) {
+					capture_edge(tim.CCR1, now);
+				}
+				if(sr & (1 << 2)) {
+					capture_edge(tim.CCR2, now);
+				}
+			}
 		}
 };
 
+struct qe_pair_stats_t {
+	uint32_t edges;			// Interrupts taken
+	uint32_t steps;			// Single step transitions
+	uint32_t illegal;		// Double step transitions, both inputs changed at once
+	uint32_t spurious;		// Interrupts without a state change
+	uint32_t filtered;		// Reads rejected by the glitch filter
+	uint8_t filter;			// Configured glitch filter
+} __attribute__((packed));
+
+// Filter modes for qe_pair_filter
+#define QE_FILTER_NONE		0	// Double steps count two in the guessed direction
+#define QE_FILTER_DROP		1	// Double steps are dropped
+#define QE_FILTER_CONFIRM	2	// Double steps are dropped, and the inputs must read the same twice
+
 // This class inspired heavily by mon's Pocket Voltex, which was adapted from Encoder.h by PRJC
 // https://github.com/mon/PocketVoltex
+//
+// Both inputs are on one port and read together. The previous and new
+// state index a table of steps, with a double step for the transitions
+// where both inputs changed since the last interrupt.
 class IntAxis : public Axis {
 	private:
-		Pin *a;
-		Pin *b;
-		uint32_t count = 0;
+		GPIO_t* port;
+		uint8_t bit_a;
+		uint8_t bit_b;
+		volatile int32_t counter = 0;
 		uint8_t state;
+		uint8_t filter = QE_FILTER_NONE;
 
 		bool invert = false;
 
+		qe_pair_stats_t stats;
+
+		// Indexed by old state | new state << 2, state being A | B << 1.
+		// Not const, so it's in RAM with updateEncoder().
+		static inline int8_t steps[16] = {
+			0, 1, -1, 2,
+			-1, 0, -2, 1,
+			1, -2, 0, -1,
+			2, -1, 1, 0,
+		};
+
+		RAMINLINE uint8_t read_state(uint32_t idr) {
+			return ((idr >> bit_a) & 1) | (((idr >> bit_b) & 1) << 1);
+		}
+
 	public:
-		void set_pins(Pin _a, Pin _b) {
-			a = &(_a);
-			b = &(_b);
+		void set_pins(GPIO_t* _port, uint8_t _bit_a, uint8_t _bit_b) {
+			port = _port;
+			bit_a = _bit_a;
+			bit_b = _bit_b;
 		}
 
-		void enable(bool _invert, int8_t sens) {
+		void enable(bool _invert, int8_t sens, uint8_t _filter) {
 			invert = _invert;
+			filter = _filter;
 
-			if(sens < 0) {
-				if(sens == -127) {
-					max_count = (600 * 4) - 1;
-				} else if(sens == -126) {
-					max_count = (400 * 4) - 1;
-				} else if(sens == -125) {
-					max_count = (360 * 4) - 1;
-				} else {
-					max_count = 256 * -sens - 1;
-				}
-			} else {
-				max_count = 256 - 1;
-			}
-			sensitivity = sens;
+			// The report wraps at max_count rather than after it
+			set_range(sens, true);
 
-			state = a->get() | (b->get() << 1);
+			reset_stats();
+			state = read_state(port->reg.IDR);
 		}
 
-		void updateEncoder() {
-			uint8_t newState = a->get() | (b->get() << 1);
-			int8_t delta;
-			uint8_t tempState = state | (newState << 2);
-			state = newState;
-			switch (tempState) {
-				case 1:
-				case 7:
-				case 8:
-				case 14:
-					delta = 1;
-					break;
-				case 2:
-				case 4:
-				case 11:
-				case 13:
-					delta = -1;
-					break;
-				case 3:
-				case 12:
-					delta = 2;
-					break;
-				case 6:
-				case 9:
-					delta = -2;
-					break;
-			}
-			if(((int16_t)count + delta) < 0) {
-				count += max_count;
+		RAMFUNC void updateEncoder() {
+			uint8_t newState = read_state(port->reg.IDR);
+			if(filter >= QE_FILTER_CONFIRM && read_state(port->reg.IDR) != newState) {
+				stats.filtered++;
+				return;
 			}
-			count += delta;
-			if(count >= max_count) {
-				count -= max_count;
+
+			int8_t delta = steps[state | (newState << 2)];
+			state = newState;
+
+			if(delta == 0) {
+				stats.spurious++;
+			} else if(delta == 1 || delta == -1) {
+				stats.steps++;
+				counter += delta;
+			} else {
+				stats.illegal++;
+				if(filter == QE_FILTER_NONE) {
+					counter += delta;
+				}
 			}
+		}
 
+		virtual int32_t get_position() final {
+			return counter;
 		}
 
-		virtual uint32_t get() final {
-			return count;
+		qe_pair_stats_t get_stats() {
+			qe_pair_stats_t s = stats;
+			s.edges = s.steps + s.illegal + s.spurious + s.filtered;
+			s.filter = filter;
+			return s;
+		}
+
+		void reset_stats() {
+			stats = {0, 0, 0, 0, 0, 0};
 		}
 };
 
+#define ANALOG_OVERSAMPLE		64		// Conversions averaged per read, must be a power of two
+#define ANALOG_FILTER_TICK_US	1000
+
+// Converts continuously into a circular DMA buffer, 117 kHz with the
+// longest sample time. Every read averages the whole buffer, the last
+// ~0.5 ms, into a 16-bit value, and a first order IIR filter stepping once
+// per ms smooths that further with a time constant of 2^filter ms. The
+// 8-bit position only moves once the filtered value is a quarter step
+// past the current one, so noise around a step doesn't flip dir_state.
 class AnalogAxis : public Axis {
 	private:
 		ADC_t& adc;
 		uint32_t ch;
+		DMA_t& dma;
+		uint8_t dma_ch;
+		uint32_t remap;		// SYSCFG_CFGR1 DMA remap bit
+
+		volatile uint16_t buf[ANALOG_OVERSAMPLE];
+
+		uint8_t filter = 0;
+		int32_t filtered = 0;	// 16.8 fixed point
+		uint32_t filter_time;
+		bool primed = false;
+
+		int32_t counter = 0;
+		uint8_t level = 0;
 	
 	public:
-		AnalogAxis(ADC_t& a, uint32_t c) : adc(a), ch(c) {}
+		uint16_t value = 0;		// Filtered, full scale 0xffff
+
+		AnalogAxis(ADC_t& a, uint32_t c, DMA_t& d, uint8_t dc, uint32_t r) : adc(a), ch(c), dma(d), dma_ch(dc), remap(r) {}
 		
-		void enable() {
+		void enable(uint8_t _filter) {
+			filter = _filter > 10 ? 10 : _filter;
+
 			// Turn on ADC regulator.
 			adc.CR &= ~((1 << 28) | (1 << 29));	// Reset ADVREGEN
 			adc.CR |= 1 << 28;	// Turn on ADVREGEN
@@ -287,11 +672,27 @@ class AnalogAxis : public Axis {
 			adc.CR &= ~(1 << 30);	// ADCALDIF = 0 (single ended)
 			adc.CR |= 1 << 31;	// Enable ADCAL
 			while(!(adc.CR & (1 << 31)));	// Wait for ADCAL to finish
+
+			RCC.enable(RCC.SYSCFG);
+			RCC.enable(RCC.DMA1);
+			RCC.enable(RCC.DMA2);
+			SYSCFG.CFGR1 |= remap;
+
+			dma.reg.C[dma_ch].NDTR = ANALOG_OVERSAMPLE;
+			dma.reg.C[dma_ch].MAR = (uintptr_t)&buf;
+			dma.reg.C[dma_ch].PAR = (uintptr_t)&adc.DR;
+			dma.reg.C[dma_ch].CR = 	(0 << 12) |	// Priority low
+									(1 << 10) |	// MSIZE = 16-bits
+									(1 << 8) | 	// PSIZE = 16-bits
+									(1 << 7) | 	// Memory increment mode enabled
+									(1 << 5) | 	// Circular mode
+									(0 << 4) | 	// Direction: read from peripheral
+									(1 << 0);	// Channel enable
 			
-			// Configure continous capture on one channel.
-			adc.CFGR = (1 << 13) | (1 << 12) | (1 << 5); // CONT, OVRMOD, ALIGN
+			// Configure continous capture on one channel, right aligned into DMA.
+			adc.CFGR = (1 << 13) | (1 << 12) | (1 << 1) | (1 << 0); // CONT, OVRMOD, DMACFG, DMAEN
 			adc.SQR1 = (ch << 6);
-			// adc.SMPR1 = (7 << (ch * 3)); // 72 MHz / 64 / 614 = apx. 1.8 kHz
+			adc.SMPR1 = (7 << (ch * 3)); // 601.5 cycles, 72 MHz / 614 = apx. 117 kHz
 			
 			// Enable ADC.
 			adc.CR |= 1 << 0; // ADEN
@@ -300,11 +701,218 @@ class AnalogAxis : public Axis {
 			
 			// Start conversion.
 			adc.CR |= 1 << 2; // ADSTART
+
+			// Fill the buffer once before the first read
+			Time::sleep(2);
 		}
 		
-		virtual uint32_t get() final {
-			return adc.DR >> 8;
+		// A knob is taken to move the short way round between reads.
+		virtual int32_t get_position() final {
+			uint32_t sum = 0;
+			for(uint32_t i = 0; i < ANALOG_OVERSAMPLE; i++) {
+				sum += buf[i];
+			}
+			int32_t raw = (sum << 4) / ANALOG_OVERSAMPLE;	// 12 to 16 bits
+
+			uint32_t now = us_clock.now();
+			if(!primed || !filter) {
+				filtered = raw << 8;
+				filter_time = now;
+				primed = true;
+			} else {
+				// Fixed steps, so the time constant doesn't depend on the loop rate
+				uint32_t ticks = (now - filter_time) / ANALOG_FILTER_TICK_US;
+				if(ticks > 64) {
+					ticks = 64;
+					filter_time = now;
+				} else {
+					filter_time += ticks * ANALOG_FILTER_TICK_US;
+				}
+				while(ticks--) {
+					filtered += ((raw << 8) - filtered) >> filter;
+				}
+			}
+			value = filtered >> 8;
+
+			// Hysteresis of a quarter step either side
+			int32_t center = level * 256 + 128;
+			if(value > center + 192 || value < center - 192) {
+				level = value >> 8;
+			}
+
+			int8_t moved = level - uint8_t(counter);
+			counter += moved;
+			return counter;
+		}
+};
+
+#define MAG_SAMPLE_HZ	20000	// Sensor reads per second
+#define MAG_BUF_LEN		32		// Frames in the receive ring, interrupts every half
+#define MAG_BITS		14		// Angle resolution of the sensor
+
+struct mag_stats_t {
+	uint32_t frames;		// Frames unwrapped
+	uint32_t errors;		// Frames with bad parity or the error flag set
+	uint8_t sampler_off;	// Button sampler gave up TIM4 and the buttons are polled
+	uint32_t sampler_overruns;	// Button samples overwritten before they were read
+} __attribute__((packed));
+
+// AS5047-class absolute magnetic angle sensor on SPI1, read by DMA at
+// MAG_SAMPLE_HZ without the CPU:
+//	TIM4 CH1 (PB6) drives CSn low for the first 3 us of every period
+//	TIM4 CH2 compares just after, its DMA request writes the read command
+//	to SPI1 DR (DMA1 channel 4), clocking one 16-bit frame
+//	SPI1 RX fills a ring of MAG_BUF_LEN frames (DMA1 channel 2)
+// TIM4 CC2 and DMA1 channel 4 are also sampler slot 3, see release_tim4().
+//
+// Every command reads ANGLECOM, so each frame returns the angle latched
+// one period before. The 14-bit angle is unwrapped frame by frame, taking
+// the short way round, which holds up to half a turn per 50 us. The half
+// and full transfer interrupts keep unwrapping while the main loop is
+// stalled. The position is scaled to the configured counts per turn, and
+// what's left over gives position_fine.
+class MagAxis : public Axis {
+	private:
+		static const uint32_t cmd_read_angle = 0xffff;	// Read 0x3fff with parity
+
+		volatile uint16_t buf[MAG_BUF_LEN];
+		uint16_t command = cmd_read_angle;
+		uint32_t read_index = 0;
+
+		bool invert = false;
+		bool primed = false;
+		uint16_t angle = 0;
+		volatile int64_t raw = 0;	// Unwrapped angle
+		int32_t fine = 0;
+		uint32_t turn = 256;
+
+		mag_stats_t stats = {0, 0, 0, 0};
+
+		// __builtin_parity() may be a libgcc call, which is in flash.
+		RAMINLINE static bool parity(uint16_t v) {
+			v ^= v >> 8;
+			v ^= v >> 4;
+			v ^= v >> 2;
+			v ^= v >> 1;
+			return v & 1;
+		}
+
+		RAMINLINE void unwrap() {
+			uint32_t write_index = MAG_BUF_LEN - DMA1.reg.C[1].NDTR;
+			if(write_index >= MAG_BUF_LEN) {
+				write_index = 0;
+			}
+			while(read_index != write_index) {
+				uint16_t frame = buf[read_index];
+				read_index = (read_index + 1) % MAG_BUF_LEN;
+
+				// Even parity over the frame, error flag in bit 14
+				if(parity(frame) || (frame & (1 << 14))) {
+					stats.errors++;
+					continue;
+				}
+				stats.frames++;
+
+				uint16_t a = frame & ((1 << MAG_BITS) - 1);
+				if(primed) {
+					int32_t delta = int16_t(uint16_t(a - angle) << (16 - MAG_BITS)) >> (16 - MAG_BITS);
+					raw = raw + (invert ? -delta : delta);
+				}
+				angle = a;
+				primed = true;
+			}
+		}
+
+	public:
+		void enable(bool _invert, int8_t sens) {
+			invert = _invert;
+			set_range(sens, false);
+			turn = max_count + 1;
+
+			RCC.enable(RCC.SPI1);
+			RCC.enable(RCC.TIM4);
+			RCC.enable(RCC.DMA1);
+
+			// 16-bit frames, mode 1, 72 MHz / 8 = 9 MHz, RX by DMA
+			SPI1.reg.CR1 = 0;
+			SPI1.reg.CR2 = (15 << 8) | (1 << 0);	// DS = 16-bit, RXDMAEN
+			SPI1.reg.CR1 = (1 << 9) | (1 << 8) | (2 << 3) | (1 << 2) | (1 << 0);	// SSM, SSI, BR = 2, MSTR, CPHA
+			SPI1.reg.CR1 |= 1 << 6;	// SPE
+
+			DMA1.reg.C[1].CR = 0;
+			DMA1.reg.C[1].NDTR = MAG_BUF_LEN;
+			DMA1.reg.C[1].MAR = (uintptr_t)&buf;
+			DMA1.reg.C[1].PAR = (uintptr_t)&SPI1.reg.DR;
+			DMA1.reg.C[1].CR = 	(3 << 12) |	// Priority very high
+								(1 << 10) |	// MSIZE = 16-bits
+								(1 << 8) | 	// PSIZE = 16-bits
+								(1 << 7) | 	// Memory increment mode enabled
+								(1 << 5) | 	// Circular mode
+								(0 << 4) | 	// Direction: read from peripheral
+								(1 << 2) | 	// Half transfer interrupt
+								(1 << 1) | 	// Transfer complete interrupt
+								(1 << 0);	// Channel enable
+
+			DMA1.reg.C[3].CR = 0;
+			DMA1.reg.C[3].NDTR = 1;
+			DMA1.reg.C[3].MAR = (uintptr_t)&command;
+			DMA1.reg.C[3].PAR = (uintptr_t)&SPI1.reg.DR;
+			DMA1.reg.C[3].CR = 	(2 << 12) |	// Priority high
+								(1 << 10) |	// MSIZE = 16-bits
+								(1 << 8) | 	// PSIZE = 16-bits
+								(1 << 5) | 	// Circular mode
+								(1 << 4) | 	// Direction: read from memory
+								(1 << 0);	// Channel enable
+
+			read_index = 0;
+			primed = false;
+			Interrupt::enable(Interrupt::DMA1_Channel2);
+
+			// CSn low from the update for 3 us, the command 0.5 us in
+			TIM4.CR1 = 0;
+			TIM4.PSC = 0;
+			TIM4.ARR = 72000000 / MAG_SAMPLE_HZ - 1;
+			TIM4.CCR1 = 216;
+			TIM4.CCR2 = 36;
+			TIM4.CCMR1 = (6 << 4) | (1 << 3);	// OC1M = PWM 1, OC1PE
+			TIM4.CCER = (1 << 1) | (1 << 0);	// CC1P (active low), CC1E
+			TIM4.EGR = 1 << 0;
+			TIM4.DIER = 1 << 10;				// CC2DE
+			TIM4.CR1 = 1 << 0;
+		}
+
+		virtual int32_t get_position() final {
+			Interrupt::disable(Interrupt::DMA1_Channel2);
+			unwrap();
+			int64_t r = raw;
+			Interrupt::enable(Interrupt::DMA1_Channel2);
+
+			int64_t scaled = r * turn;
+			fine = int32_t(scaled >> (MAG_BITS - 8));
+			return int32_t(scaled >> MAG_BITS);
+		}
+
+		virtual int32_t get_position_fine() final {
+			return fine;
+		}
+
+		mag_stats_t get_stats() {
+			Interrupt::disable(Interrupt::DMA1_Channel2);
+			mag_stats_t s = stats;
+			Interrupt::enable(Interrupt::DMA1_Channel2);
+			return s;
+		}
+
+		void reset_stats() {
+			Interrupt::disable(Interrupt::DMA1_Channel2);
+			stats = {0, 0, 0, 0};
+			Interrupt::enable(Interrupt::DMA1_Channel2);
+		}
+
+		RAMFUNC void irq() {
+			DMA1.reg.IFCR = 1 << 4;	// Clears all interrupt flags for Channel 2
+			unwrap();
 		}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -11,12 +11,19 @@ class Pin_Definition {
 		Pin qe2a = GPIOA[6];
 		Pin qe2b = GPIOA[7];
 
+		// QE pair mode reads QE1B and QE2B together
+		GPIO_t* qe_pair_port = &GPIOA;
+		uint8_t qe1b_bit = 1;
+		uint8_t qe2b_bit = 7;
+
 		virtual bool has_usb_pullup();
 		virtual Pin get_usb_pullup();
 
 		virtual uint8_t get_num_buttons();
 
 		virtual Pin* get_button_input(uint8_t index);
+		virtual GPIO_t* get_button_port(uint8_t index);
+		virtual uint8_t get_button_bit(uint8_t index);
 		virtual Pin* get_button_led(uint8_t index);
 
 		virtual uint8_t get_num_leds();
@@ -34,6 +41,10 @@ class Roxy_v11_Pins : public Pin_Definition {
 		Pin button_inputs[12] = {
 			GPIOB[4], GPIOB[5], GPIOB[6], GPIOB[9], GPIOC[14], GPIOC[5],
 			GPIOB[1], GPIOB[10], GPIOC[7], GPIOC[9], GPIOA[9], GPIOB[7]};
+		GPIO_t* button_ports[12] = {
+			&GPIOB, &GPIOB, &GPIOB, &GPIOB, &GPIOC, &GPIOC,
+			&GPIOB, &GPIOB, &GPIOC, &GPIOC, &GPIOA, &GPIOB};
+		uint8_t button_bits[12] = {4, 5, 6, 9, 14, 5, 1, 10, 7, 9, 9, 7};
 		Pin button_leds[12] = {
 			GPIOA[15], GPIOC[11], GPIOB[3], GPIOC[13], GPIOC[15], GPIOB[0],
 			GPIOB[2], GPIOC[6], GPIOC[8], GPIOA[8], GPIOA[10], GPIOB[8]};
@@ -61,19 +72,35 @@ class Roxy_v11_Pins : public Pin_Definition {
 			if(index < num_buttons) {
 				return &button_inputs[index];
 			}
+			return &null_pin;
+		}
+
+		GPIO_t* get_button_port(uint8_t index) {
+			if(index < num_buttons) {
+				return button_ports[index];
+			}
+			return &GPIOF;	// Port and bit of null_pin
+		}
+
+		uint8_t get_button_bit(uint8_t index) {
+			if(index < num_buttons) {
+				return button_bits[index];
+			}
+			return 4;
 		}
 
 		Pin* get_button_led(uint8_t index) {
 			if (index < num_buttons) {
 				return &button_leds[index];
 			}
+			return &null_pin;
 		}
 
 		uint8_t get_num_leds() {
 			return 1;
 		}
 
-		Pin* get_led(uint8_t index) {
+		Pin* get_led(uint8_t) {
 			return &leds[0];	// Always return the first one
 		}
 
@@ -93,6 +120,10 @@ class Roxy_v20_Pins : public Pin_Definition {
 		Pin button_inputs[11] = {
 			GPIOA[15], GPIOD[2], GPIOC[14], GPIOC[15], GPIOC[1], GPIOC[3],
 			GPIOC[2], GPIOA[4], GPIOA[5], GPIOB[2], GPIOB[10]};
+		GPIO_t* button_ports[11] = {
+			&GPIOA, &GPIOD, &GPIOC, &GPIOC, &GPIOC, &GPIOC,
+			&GPIOC, &GPIOA, &GPIOA, &GPIOB, &GPIOB};
+		uint8_t button_bits[11] = {15, 2, 14, 15, 1, 3, 2, 4, 5, 2, 10};
 		Pin button_leds[11] = {
 			GPIOA[8], GPIOA[9], GPIOA[10], GPIOC[11], GPIOC[13], GPIOB[0],
 			GPIOB[1], GPIOC[6], GPIOC[7], GPIOC[8], GPIOC[9]};
@@ -118,19 +149,35 @@ class Roxy_v20_Pins : public Pin_Definition {
 			if(index < num_buttons) {
 				return &button_inputs[index];
 			}
+			return &null_pin;
+		}
+
+		GPIO_t* get_button_port(uint8_t index) {
+			if(index < num_buttons) {
+				return button_ports[index];
+			}
+			return &GPIOF;	// Port and bit of null_pin
+		}
+
+		uint8_t get_button_bit(uint8_t index) {
+			if(index < num_buttons) {
+				return button_bits[index];
+			}
+			return 4;
 		}
 
 		Pin* get_button_led(uint8_t index) {
 			if (index < num_buttons) {
 				return &button_leds[index];
 			}
+			return &null_pin;
 		}
 
 		uint8_t get_num_leds() {
 			return 0;
 		}
 
-		Pin* get_led(uint8_t index) {
+		Pin* get_led(uint8_t) {
 			return &null_pin;
 		}
 
@@ -152,6 +199,10 @@ class Arcin_Pins : public Pin_Definition {
 		Pin button_inputs[11] = {
 			GPIOB[0], GPIOB[1], GPIOB[2], GPIOB[3], GPIOB[4], GPIOB[5],
 			GPIOB[6], GPIOB[7], GPIOB[8], GPIOB[9], GPIOB[10]};
+		GPIO_t* button_ports[11] = {
+			&GPIOB, &GPIOB, &GPIOB, &GPIOB, &GPIOB, &GPIOB,
+			&GPIOB, &GPIOB, &GPIOB, &GPIOB, &GPIOB};
+		uint8_t button_bits[11] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
 		Pin button_leds[11] = {
 			GPIOC[0], GPIOC[1], GPIOC[2], GPIOC[3], GPIOC[4], GPIOC[5],
 			GPIOC[6], GPIOC[7], GPIOC[8], GPIOC[9], GPIOC[10]};
@@ -177,12 +228,28 @@ class Arcin_Pins : public Pin_Definition {
 			if(index < num_buttons) {
 				return &button_inputs[index];
 			}
+			return &null_pin;
+		}
+
+		GPIO_t* get_button_port(uint8_t index) {
+			if(index < num_buttons) {
+				return button_ports[index];
+			}
+			return &GPIOF;	// Port and bit of null_pin
+		}
+
+		uint8_t get_button_bit(uint8_t index) {
+			if(index < num_buttons) {
+				return button_bits[index];
+			}
+			return 4;
 		}
 
 		Pin* get_button_led(uint8_t index) {
 			if (index < num_buttons) {
 				return &button_leds[index];
 			}
+			return &null_pin;
 		}
 
 		uint8_t get_num_leds() {
@@ -214,6 +281,8 @@ Pin rgb_mosi = GPIOC[12];
 
 Pin spi1_sck = GPIOB[3];
 Pin spi1_mosi = GPIOB[5];
+Pin spi1_miso = GPIOB[4];	// Magnetic encoder, spare on v2.0
+Pin spi1_cs = GPIOB[6];		// Magnetic encoder, TIM4 CH1
 
 Pin ws_data = GPIOC[12];
 
@@ -263,6 +332,8 @@ Pin rgb_mosi = GPIOC[12];
 // UNUSED, just here so it builds
 Pin spi1_sck = GPIOB[3];
 Pin spi1_mosi = GPIOB[5];
+Pin spi1_miso = GPIOB[4];
+Pin spi1_cs = GPIOB[6];
 
 Pin ws_data = GPIOB[8];
 
@@ -0,0 +1,72 @@
+#ifndef BUTTON_LATCH_H
+#define BUTTON_LATCH_H
+
+#include <stdint.h>
+
+// Holds button edges for a consumer that only looks at the state now and
+// then, such as an interrupt endpoint. A press is shown in at least one
+// report even if the button was released again before it was sent, and the
+// release follows in the next one.
+//
+// Keeps one press and one release per button; anything beyond that falls
+// back to the current state.
+class Button_Latch {
+	private:
+		uint16_t current = 0;
+		uint16_t reported = 0;
+		uint16_t pending_press = 0;
+		uint16_t pending_release = 0;
+
+		// Before the last commit, in case that report is replaced unsent
+		uint16_t prev_reported = 0;
+		uint16_t prev_press = 0;
+		uint16_t prev_release = 0;
+
+		uint16_t state(uint16_t rep, uint16_t press, uint16_t release) {
+			return (~rep & (press | current)) | (rep & ~release & current);
+		}
+
+	public:
+		// Edges the caller saw between updates can be passed in as well.
+		void update(uint16_t buttons, uint16_t pressed = 0, uint16_t released = 0) {
+			pending_press |= pressed | (buttons & ~current);
+			pending_release |= released | (~buttons & current);
+			current = buttons;
+		}
+
+		// State to put in the next report.
+		uint16_t peek() {
+			return state(reported, pending_press, pending_release);
+		}
+
+		// State for a report replacing the last committed one before the
+		// host got it, so no edge that report carried is lost.
+		uint16_t peek_replace() {
+			return state(prev_reported, prev_press | pending_press, prev_release | pending_release);
+		}
+
+		// Call with the state that was actually sent.
+		void commit(uint16_t sent) {
+			prev_reported = reported;
+			prev_press = pending_press;
+			prev_release = pending_release;
+
+			pending_press &= ~(~reported & sent);
+			pending_release &= ~(reported & ~sent);
+
+			// A release with no press ahead of it has nothing left to end
+			pending_release &= sent | pending_press;
+
+			reported = sent;
+		}
+
+		// Call with the state from peek_replace() once it replaced the last report.
+		void commit_replace(uint16_t sent) {
+			reported = prev_reported;
+			pending_press |= prev_press;
+			pending_release |= prev_release;
+			commit(sent);
+		}
+};
+
+#endif
@@ -7,6 +7,8 @@
 #include <stdint.h>
 
 #include "board_define.h"
+#include "profiler.h"
+#include "us_clock.h"
 #include "rgb/rgb_buttons.h"
 
 extern Pin_Definition *current_pins;
@@ -29,10 +31,11 @@ enum LedType {
 
 class Button_Leds {
 	private:
-		uint32_t ramp_down_cycles;	// Converted to timer cycles
-		float ramp_down_slope;
+		uint32_t ramp_down_us;
+		float ramp_down_slope;		// Percent per us
 		bool led_on_req[MAX_BUTTONS];
 		uint32_t led_release_time[MAX_BUTTONS];
+		bool led_faded[MAX_BUTTONS];	// Fade out over, the release time may have wrapped since
 		uint32_t led_set_period[MAX_BUTTONS];
 		uint32_t led_current_period[MAX_BUTTONS];
 		uint32_t led_percentage[MAX_BUTTONS];
@@ -55,8 +58,12 @@ class Button_Leds {
 			TIM6.CR1 = 	(1 << 7) |			// ARPE = 1 (Auto-reload preload enabled)
 						(1 << 0);			// CEN = 1 (Counter enabled)
 
-			ramp_down_cycles = ramp_down * 20;	// Input (ms) converted to timer cycles (20 per ms)
-			ramp_down_slope = -100.0f / (float)ramp_down_cycles;
+			set_ramp_down(ramp_down);
+		}
+
+		void set_ramp_down(uint32_t ramp_down) {
+			ramp_down_us = ramp_down * 1000;	// Input (ms) converted to us
+			ramp_down_slope = -100.0f / (float)ramp_down_us;
 		}
 
 		void set_mode(uint8_t index, LedMode mode) {
@@ -87,7 +94,8 @@ class Button_Leds {
 				led_on_req[index] = true;
 			} else {
 				if(led_on_req[index]) {
-					led_release_time[index] = Time::time();
+					led_release_time[index] = us_clock.now();
+					led_faded[index] = false;
 					led_current_period[index] = 0;
 					led_set_period[index] = 100;
 					cycle_count[index] = 0;
@@ -151,7 +159,7 @@ class Button_Leds {
 			// Clear flag
 			TIM6.SR &= ~(1 << 0);	// Clear UIF
 
-			uint32_t cur_time = Time::time();
+			uint32_t cur_time = us_clock.now();
 			for(int i=0; i<current_pins->get_num_buttons(); i++) {
 				switch(led_mode[i]) {
 					case LedMode::Standard:
@@ -165,11 +173,12 @@ class Button_Leds {
 					case LedMode::FadeOut:
 						if(led_on_req[i]) {
 							set_led_on(i);
-						} else if((cur_time - led_release_time[i]) >= (ramp_down_cycles * 20)) {	// Convert cycles to ms
+						} else if(led_faded[i] || (cur_time - led_release_time[i]) >= ramp_down_us) {
+							led_faded[i] = true;
 							set_led_off(i);
 						} else {
-							uint32_t elapsed = 20 * (cur_time - led_release_time[i]);	// Get elapsed cycles
-							// Set percentage based on elapsed cycles
+							uint32_t elapsed = cur_time - led_release_time[i];
+							// Set percentage based on elapsed time
 							led_percentage[i] = ramp_down_slope * (float)elapsed + 100;
 							if(led_type[i] == LedType::TypeStandard) {
 								if(led_current_period[i] < led_percentage[i]) {
@@ -190,11 +199,12 @@ class Button_Leds {
 					case LedMode::FadeOutInvert:
 						if(led_on_req[i]) {
 							set_led_off(i);
-						} else if((cur_time - led_release_time[i]) >= (ramp_down_cycles * 20)) {	// Convert cycles to ms
+						} else if(led_faded[i] || (cur_time - led_release_time[i]) >= ramp_down_us) {
+							led_faded[i] = true;
 							set_led_on(i);
 						} else {
-							uint32_t elapsed = 20 * (cur_time - led_release_time[i]);	// Get elapsed cycles
-							// Set percentage based on elapsed cycles
+							uint32_t elapsed = cur_time - led_release_time[i];
+							// Set percentage based on elapsed time
 							led_percentage[i] = ramp_down_slope * (float)elapsed + 100;
 							if(led_type[i] == LedType::TypeStandard) {
 								if(led_current_period[i] < led_percentage[i]) {
@@ -233,8 +243,10 @@ Button_Leds button_led_manager;
 
 template<>
 void interrupt<Interrupt::TIM6>() {
+	uint32_t prof = profiler.start();
 	button_led_manager.irq();
 	rgb_buttons.irq();
+	profiler.stop(PROF_TIM6, prof);
 }
 
 #endif
\ No newline at end of file
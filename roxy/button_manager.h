@@ -7,23 +7,157 @@
 #include "board_define.h"
 #include "config.h"
 #include "button_leds.h"
+#include "button_sampler.h"
+#include "debouncer.h"
+#include "hall_buttons.h"
+#include "us_clock.h"
 #include "device/device_config.h"
 #include "rgb/rgb_config.h"
 
 extern Pin_Definition *current_pins;
 extern Button_Leds button_led_manager;
+extern Button_Sampler button_sampler;
+extern Hall_Buttons hall_buttons;
 
 extern config_t config;
 extern mapping_config_t mapping_config;
 extern device_config_t device_config;
 extern rgb_config_t rgb_config;
 
+#define POLL_TICK_US    10      // Debounce counter step when polling
+
 class Button_Manager {
     private:
         bool enabled[MAX_BUTTONS];
         uint8_t mapping[MAX_BUTTONS];
-        uint32_t button_time[MAX_BUTTONS];
-	    bool last_state[MAX_BUTTONS];
+        uint16_t enabled_mask = 0;
+        uint16_t state = 0;     // Debounced, 1 = pressed
+        uint16_t hall_state = 0;
+        uint16_t pressed = 0;   // Edges since the last get_edges()
+        uint16_t released = 0;
+        uint32_t last_tick;     // us
+        uint32_t max_ticks;
+        Debouncer debouncer;
+
+        // Sampled mode (Flag bit 9), debounce counts samples instead of ticks
+        bool sampled = false;
+        uint8_t sample_slot[MAX_BUTTONS];
+        uint16_t sample_mask[MAX_BUTTONS];
+        uint32_t read_index;
+        uint32_t overruns = 0;
+
+        uint16_t poll() {
+            uint16_t sample = 0;
+            for (uint8_t i = 0; i < current_pins->get_num_buttons(); i++) {
+                if ((enabled_mask & (1 << i)) && !current_pins->get_button_input(i)->get()) {
+                    sample |= 1 << i;
+                }
+            }
+            return sample;
+        }
+
+        void init_sampler() {
+            for (uint8_t i = 0; i < current_pins->get_num_buttons(); i++) {
+                if (enabled_mask & (1 << i)) {
+                    int8_t slot = button_sampler.add_port(current_pins->get_button_port(i));
+                    if (slot < 0) {
+                        // More ports than the sampler has slots, keep polling
+                        return;
+                    }
+                    sample_slot[i] = slot;
+                    sample_mask[i] = 1 << current_pins->get_button_bit(i);
+                }
+            }
+
+            button_sampler.init(get_sample_rate());
+
+            debouncer.init(get_debounce_us() * get_sample_rate() / 1000, get_eager_mask(), state);
+            read_index = button_sampler.get_sample_count();
+            sampled = true;
+        }
+
+        uint8_t get_sample_rate() {
+            uint8_t rate = config.button_sample_rate ? config.button_sample_rate : 10;
+            return rate < SAMPLER_RATE_MAX ? rate : SAMPLER_RATE_MAX;
+        }
+
+        uint32_t get_debounce_us() {
+            return config.debounce_time_us ? config.debounce_time_us : config.debounce_time * 1000;
+        }
+
+        uint16_t get_eager_mask() {
+            return ~(config.debounce_mode[0] | (config.debounce_mode[1] << 8));
+        }
+
+        void set_state(uint16_t new_state) {
+            pressed |= new_state & ~state;
+            released |= state & ~new_state;
+            state = new_state;
+        }
+
+        // Moves button bits to their (remapped) report bits
+        uint16_t map_buttons(uint16_t bits) {
+            uint16_t buttons = 0;
+
+            for (uint8_t i = 0; i < current_pins->get_num_buttons(); i++) {
+                if (bits & (1 << i)) {
+                    uint8_t shift = mapping[i] > 0 ? mapping[i] - 1 : i;
+                    buttons |= 1 << shift;
+                }
+            }
+
+            return buttons;
+        }
+
+        void read_samples() {
+            uint32_t count = button_sampler.get_sample_count();
+
+            // Fell behind far enough for the DMA to be overwriting samples
+            // not read yet, skip to the ones that are still intact. Edges
+            // in between are lost, which the host sees in report 0xab.
+            // Half the ring outlasts the longest stall, a page erase, at
+            // any rate get_sample_rate() allows.
+            if (count - read_index > SAMPLER_DEPTH / 2) {
+                read_index = count - SAMPLER_DEPTH / 2;
+                overruns++;
+            }
+
+            for (; read_index != count; read_index++) {
+                uint16_t sample = 0;
+                for (uint8_t i = 0; i < current_pins->get_num_buttons(); i++) {
+                    if ((enabled_mask & (1 << i)) && !(button_sampler.get_sample(sample_slot[i], read_index) & sample_mask[i])) {
+                        sample |= 1 << i;
+                    }
+                }
+                set_state(debouncer.update(sample, true));
+            }
+        }
+
+        // Hall effect buttons need no debouncing and keep their own state.
+        void read_hall() {
+            uint16_t new_state = hall_buttons.read();
+            pressed |= new_state & ~hall_state;
+            released |= hall_state & ~new_state;
+            hall_state = new_state;
+        }
+
+        void read_poll() {
+            uint16_t sample = poll();
+            uint32_t ticks = (us_clock.now() - last_tick) / POLL_TICK_US;
+            last_tick += ticks * POLL_TICK_US;
+
+            // Counters are all settled after a full debounce period
+            if (ticks > max_ticks) {
+                ticks = max_ticks;
+            }
+
+            if (!ticks) {
+                set_state(debouncer.update(sample, false));
+            }
+            while (ticks--) {
+                set_state(debouncer.update(sample, true));
+            }
+        }
 
     public:
         void init() {
@@ -51,11 +185,18 @@ class Button_Manager {
                 
                 // Continue setting up the button if it has not been disabled
                 if (enabled[i]) {
-                    current_pins->get_button_input(i)->set_mode(Pin::Input);
-                    current_pins->get_button_input(i)->set_pull(Pin::PullUp);
+                    bool hall = (device_config.device_enable & (1 << 2)) && (device_config.hall_mask & (1 << i)) &&
+                        hall_buttons.add(i, device_config.hall_channel[i], device_config.hall_actuation[i]);
 
-                    button_time[i] = Time::time();
-                    last_state[i] = current_pins->get_button_input(i)->get();
+                    if (hall) {
+                        current_pins->get_button_input(i)->set_mode(Pin::Analog);
+                        current_pins->get_button_input(i)->set_pull(Pin::PullNone);
+                    } else {
+                        current_pins->get_button_input(i)->set_mode(Pin::Input);
+                        current_pins->get_button_input(i)->set_pull(Pin::PullUp);
+
+                        enabled_mask |= 1 << i;
+                    }
 
                     mapping[i] = (mapping_config.button_joy_map[i / 2] >> ((i % 2) * 4)) & 0xF;
 
@@ -67,41 +208,80 @@ class Button_Manager {
             }
 
             button_led_manager.init(mapping_config.button_led_fade_time);
-        }
 
-        uint16_t read_buttons() {
-		    uint16_t buttons = 0;
+            state = poll();
+            last_tick = us_clock.now();
+            max_ticks = get_debounce_us() / POLL_TICK_US + 1;
+            debouncer.init(get_debounce_us() / POLL_TICK_US, get_eager_mask(), state);
+
+            if (hall_buttons.get_mask()) {
+                hall_buttons.init(device_config.hall_rapid_trigger);
+                hall_state = hall_buttons.read();
+            }
 
+            if (config.flags & (1 << 9)) {
+                init_sampler();
+            }
+        }
+
+        // Settings that change without setting the inputs up again:
+        // debounce, joystick mapping, LED modes, fade time and colors.
+        void reconfigure() {
             for (uint8_t i = 0; i < current_pins->get_num_buttons(); i++) {
                 if (enabled[i]) {
-                    bool read = current_pins->get_button_input(i)->get();
-
-                    // If state is now different
-                    if (last_state[i] != read) {
-                        // Check if debounce has passed
-                        if ((Time::time() - button_time[i]) >= config.debounce_time)
-                        {
-                            // If yes, set new time and set new state
-                            button_time[i] = Time::time();
-                            last_state[i] = read;
-                        }
-                    }
-
-                    // State reported is always the last state
-                    if (!last_state[i]) {
-                        uint8_t shift = mapping[i] > 0 ? mapping[i] - 1 : i;
-                            buttons |= 1 << shift;
+                    mapping[i] = (mapping_config.button_joy_map[i / 2] >> ((i % 2) * 4)) & 0xF;
+                    button_led_manager.set_mode(i, (LedMode)((mapping_config.button_led_mode[i / 2] >> ((i % 2) * 4)) & 0xF));
+                    if ((mapping_config.button_led_type[i / 2] >> ((i % 2) * 4)) & 0xF) {
+                        rgb_buttons.set_color(i, rgb_config.led_hue[i]);
                     }
                 }
             }
 
-            return buttons;
+            button_led_manager.set_ramp_down(mapping_config.button_led_fade_time);
+
+            if (sampled) {
+                debouncer.init(get_debounce_us() * get_sample_rate() / 1000, get_eager_mask(), state);
+            } else {
+                max_ticks = get_debounce_us() / POLL_TICK_US + 1;
+                debouncer.init(get_debounce_us() / POLL_TICK_US, get_eager_mask(), state);
+            }
+        }
+
+        uint16_t read_buttons() {
+            if (sampled) {
+                read_samples();
+            } else {
+                read_poll();
+            }
+
+            if (hall_buttons.get_mask()) {
+                read_hall();
+            }
+
+            return map_buttons(state | hall_state);
+        }
+
+        // Presses and releases since the last call, including any that
+        // came and went within one read_buttons() in sampled mode.
+        void get_edges(uint16_t& pressed_buttons, uint16_t& released_buttons) {
+            pressed_buttons = map_buttons(pressed);
+            released_buttons = map_buttons(released);
+            pressed = 0;
+            released = 0;
+        }
+
+        uint32_t get_overruns() {
+            return overruns;
+        }
+
+        void reset_overruns() {
+            overruns = 0;
         }
 
         void set_leds_reactive() {
             for (uint8_t i = 0; i < current_pins->get_num_buttons(); i++) {
                 if (enabled[i]) {
-                    button_led_manager.set_led(i, !last_state[i] ^ ((config.flags >> 7) & 0x1));
+                    button_led_manager.set_led(i, (((state | hall_state) >> i) & 0x1) ^ ((config.flags >> 7) & 0x1));
                 }
             }
         }
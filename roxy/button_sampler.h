@@ -0,0 +1,182 @@
+#ifndef BUTTON_SAMPLER_H
+#define BUTTON_SAMPLER_H
+
+#include <rcc/rcc.h>
+#include <gpio/gpio.h>
+#include <dma/dma.h>
+#include <timer/timer.h>
+#include <syscfg/syscfg.h>
+#include <interrupt/interrupt.h>
+#include <stdint.h>
+
+#include "profiler.h"
+#include "ramfunc.h"
+
+#define SAMPLER_DEPTH		1024	// Samples per port, must be a power of two
+#define SAMPLER_RATE_MAX	12		// kHz, half the ring then outlasts a 40 ms page erase
+#define SAMPLER_SLOTS		4
+
+// Copies the input register of every GPIO port with a button on it into a
+// circular buffer at a fixed rate, paced by timer DMA requests. Every sample
+// index refers to the same instant on all ports, so the buffers act as one
+// timestamped ring: sample n was taken n / rate after init().
+//
+// Each port needs its own timer and DMA channel:
+//	Slot 0: TIM7 update		-> DMA2 channel 4 (TC interrupt counts wraps)
+//	Slot 1: TIM16 update	-> DMA1 channel 6 (remapped)
+//	Slot 2: TIM17 update	-> DMA1 channel 7 (remapped)
+//	Slot 3: TIM4 CC2		-> DMA1 channel 4
+//
+// Slot 3 is shared with the magnetic angle sensor, which keeps it when
+// enabled. Boards with buttons on four ports then fall back to polling.
+//
+// The DMA carries on while a config save holds the main loop up, and the
+// wrap count is kept by a RAMFUNC handler above the ones in flash, so the
+// samples of a whole page erase are there to read afterwards.
+class Button_Sampler {
+	private:
+		struct slot_t {
+			TIM_t* tim;
+			DMA_t* dma;
+			uint8_t channel;
+			uint32_t dier;		// DMA request enable
+			uint32_t remap;		// SYSCFG_CFGR1 DMA remap bit
+		};
+
+		const slot_t slots[SAMPLER_SLOTS] = {
+			{&TIM7, &DMA2, 3, 1 << 8, 0},
+			{&TIM16, &DMA1, 5, 1 << 8, 1 << 11},
+			{&TIM17, &DMA1, 6, 1 << 8, 1 << 12},
+			{&TIM4, &DMA1, 3, 1 << 10, 0},
+		};
+
+		GPIO_t* ports[SAMPLER_SLOTS];
+		uint8_t num_ports = 0;
+		uint8_t max_ports = SAMPLER_SLOTS;
+		bool short_of_slots = false;
+
+		volatile uint16_t buf[SAMPLER_SLOTS][SAMPLER_DEPTH];
+		volatile uint32_t wraps = 0;
+		uint8_t rate_khz = 0;
+
+	public:
+		// Leaves TIM4 and DMA1 channel 4 to the magnetic angle sensor.
+		void release_tim4() {
+			max_ports = SAMPLER_SLOTS - 1;
+		}
+
+		// Returns the slot sampling the port, or -1 if all slots are taken.
+		int8_t add_port(GPIO_t* port) {
+			for(uint8_t i = 0; i < num_ports; i++) {
+				if(ports[i] == port) {
+					return i;
+				}
+			}
+			if(num_ports == max_ports) {
+				short_of_slots = true;
+				return -1;
+			}
+			ports[num_ports] = port;
+			return num_ports++;
+		}
+
+		void init(uint8_t rate) {
+			rate_khz = rate;
+
+			RCC.enable(RCC.SYSCFG);
+			RCC.enable(RCC.DMA1);
+			RCC.enable(RCC.DMA2);
+			RCC.enable(RCC.TIM7);
+			RCC.enable(RCC.TIM16);
+			RCC.enable(RCC.TIM17);
+			RCC.enable(RCC.TIM4);
+
+			Interrupt::enable(Interrupt::DMA2_Channel4);
+
+			for(uint8_t i = 0; i < num_ports; i++) {
+				const slot_t& s = slots[i];
+
+				SYSCFG.CFGR1 |= s.remap;
+
+				s.dma->reg.C[s.channel].NDTR = SAMPLER_DEPTH;
+				s.dma->reg.C[s.channel].MAR = (uintptr_t)&buf[i];
+				s.dma->reg.C[s.channel].PAR = (uintptr_t)&ports[i]->reg.IDR;
+				s.dma->reg.C[s.channel].CR = 	(3 << 12) |	// Priority very high
+												(1 << 10) |	// MSIZE = 16-bits
+												(1 << 8) | 	// PSIZE = 16-bits
+												(1 << 7) | 	// Memory increment mode enabled
+												(1 << 5) | 	// Circular mode
+												(0 << 4) | 	// Direction: read from peripheral
+												((i == 0) << 1) |	// Transfer complete interrupt enable
+												(1 << 0);	// Channel enable
+
+				s.tim->PSC = 0;
+				s.tim->ARR = (72000 / rate) - 1;
+				s.tim->CCR2 = 0;
+				s.tim->CNT = 0;
+				s.tim->DIER = s.dier;
+			}
+
+			// Slot 0 keeps the count, so start it last and every other
+			// timer is at least as far along.
+			for(uint8_t i = num_ports; i-- > 0;) {
+				slots[i].tim->CR1 = 1 << 0;
+			}
+		}
+
+		bool is_enabled() {
+			return rate_khz > 0;
+		}
+
+		// A port was refused, so the buttons are polled instead.
+		bool is_short_of_slots() {
+			return short_of_slots;
+		}
+
+		uint8_t get_rate() {
+			return rate_khz;
+		}
+
+		// Number of samples taken on every port since init(). Wraps after
+		// ~2^32 samples, which callers only ever compare by difference.
+		uint32_t get_sample_count() {
+			uint32_t w, ndtr, isr;
+			do {
+				w = wraps;
+				ndtr = DMA2.reg.C[3].NDTR;
+				isr = DMA2.reg.ISR;
+			} while(w != wraps);
+
+			uint32_t pos = SAMPLER_DEPTH - ndtr;
+
+			// Wrapped, but the interrupt has not run yet.
+			if((isr & (1 << 13)) && pos < SAMPLER_DEPTH / 2) {
+				w++;
+			}
+
+			// The other slots' transfers for the latest tick may still be
+			// waiting for their DMA controller, so leave that one out.
+			uint32_t count = w * SAMPLER_DEPTH + pos;
+			return count ? count - 1 : 0;
+		}
+
+		uint16_t get_sample(uint8_t slot, uint32_t index) {
+			return buf[slot][index & (SAMPLER_DEPTH - 1)];
+		}
+
+		RAMFUNC void irq() {
+			DMA2.reg.IFCR = 1 << 12;	// Clears all interrupt flags for Channel 4
+			wraps++;
+		}
+};
+
+Button_Sampler button_sampler;
+
+template<>
+RAMFUNC void interrupt<Interrupt::DMA2_Channel4>() {
+	uint32_t prof = profiler.start();
+	button_sampler.irq();
+	profiler.stop(PROF_DMA, prof);
+}
+
+#endif
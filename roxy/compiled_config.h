@@ -0,0 +1,158 @@
+#ifndef COMPILED_CONFIG_H
+#define COMPILED_CONFIG_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "nkro_keyboard.h"
+
+#include "rgb/rgb_config.h"
+#include "device/device_config.h"
+
+extern config_t config;
+extern rgb_config_t rgb_config;
+extern mapping_config_t mapping_config;
+extern device_config_t device_config;
+
+// LED outputs, in main.cpp
+void breathing_none(int8_t state0, int8_t state1);
+void breathing_only(int8_t state0, int8_t state1);
+void breathing_tlc59711(int8_t state0, int8_t state1);
+void breathing_tlc5973(int8_t state0, int8_t state1);
+void tt_none();
+void tt_only();
+void tt_ws2812b();
+void sdvx_none();
+void sdvx_turbocharger();
+void sdvx_tlc59711();
+
+#define COMPILED_KEYS	20	// 16 buttons and 4 axis directions
+
+// The config decoded for the main loop by compile(), after loading and
+// after every live change. The loop reads masks and calls outputs picked
+// here instead of testing flags and modes, and builds the NKRO report from
+// a table of only the inputs that have a key.
+class Compiled_Config {
+	private:
+		struct key_t {
+			uint8_t input;	// Bit of the inputs
+			uint8_t byte;	// Report byte and bit of the key
+			uint8_t bit;
+		};
+
+		key_t keys[COMPILED_KEYS];
+		uint8_t num_keys = 0;
+
+		// Report bytes holding keys, and which bits
+		uint8_t key_bytes[COMPILED_KEYS];
+		uint8_t key_masks[COMPILED_KEYS];
+		uint8_t num_key_bytes = 0;
+
+		// Bytes of the table build_keys() last ran with, cleared on its next
+		// pass so keys dropped by a remap don't stay held
+		uint8_t stale_bytes[COMPILED_KEYS];
+		uint8_t stale_masks[COMPILED_KEYS];
+		uint8_t num_stale_bytes = 0;
+
+		void add_key(uint8_t input, uint8_t keycode) {
+			key_t k = {input, 0, 0};
+			if(!keycode || !NKRO_Keyboard::locate(keycode, k.byte, k.bit)) {
+				return;
+			}
+			keys[num_keys++] = k;
+
+			for(uint8_t i = 0; i < num_key_bytes; i++) {
+				if(key_bytes[i] == k.byte) {
+					key_masks[i] |= 1 << k.bit;
+					return;
+				}
+			}
+			key_bytes[num_key_bytes] = k.byte;
+			key_masks[num_key_bytes] = 1 << k.bit;
+			num_key_bytes++;
+		}
+
+	public:
+		uint16_t axis_buttons = 0;	// Axis direction bits (12-15) reported as buttons
+		bool joystick = false;
+		bool keyboard = false;
+		bool ps2 = false;
+		bool restage = false;
+
+		void (*breathing)(int8_t state0, int8_t state1) = breathing_none;
+		void (*tt)() = tt_none;
+		void (*sdvx)() = sdvx_none;
+
+		void compile(uint8_t num_buttons) {
+			axis_buttons = (config.flags & (1 << 6)) || config.ps2_mode == 2 || config.ps2_mode == 3 ? 0xf000 : 0;
+			joystick = config.output_mode == 0 || config.output_mode == 2;
+			keyboard = config.output_mode == 1 || config.output_mode == 2;
+			ps2 = config.ps2_mode > 0;
+			restage = config.flags & (1 << 11);
+
+			// Compiled twice without a build, the report still has the older table
+			if(!num_stale_bytes) {
+				for(uint8_t i = 0; i < num_key_bytes; i++) {
+					stale_bytes[i] = key_bytes[i];
+					stale_masks[i] = key_masks[i];
+				}
+				num_stale_bytes = num_key_bytes;
+			}
+
+			num_keys = 0;
+			num_key_bytes = 0;
+			for(uint8_t i = 0; i < num_buttons && i < sizeof(mapping_config.button_kb_map); i++) {
+				add_key(i, mapping_config.button_kb_map[i]);
+			}
+			for(uint8_t i = 0; i < sizeof(mapping_config.axes_kb_map); i++) {
+				add_key(16 + i, mapping_config.axes_kb_map[i]);
+			}
+
+			if(rgb_config.rgb_mode != 1) {
+				breathing = breathing_none;
+			} else if(config.rgb_mode == 2) {
+				breathing = breathing_tlc59711;
+			} else if(config.rgb_mode == 3) {
+				breathing = breathing_tlc5973;
+			} else {
+				breathing = breathing_only;
+			}
+
+			if(rgb_config.rgb_mode != 3) {
+				tt = tt_none;
+			} else if(config.rgb_mode == 1) {
+				tt = tt_ws2812b;
+			} else {
+				tt = tt_only;
+			}
+
+			// TC hardware takes precedence if it is enabled
+			if(device_config.device_enable & (1 << 1)) {
+				sdvx = sdvx_turbocharger;
+			} else if(config.rgb_mode == 2 && rgb_config.rgb_mode == 2) {
+				sdvx = sdvx_tlc59711;
+			} else {
+				sdvx = sdvx_none;
+			}
+		}
+
+		// Sets the keys of the inputs in the NKRO report and clears the rest
+		// of the mapped ones. Buttons are bits 0-15, the axis directions bits
+		// 16-19 (axis 1 CW, CCW, axis 2 CW, CCW). Two inputs on one key share it.
+		void build_keys(uint32_t inputs, uint8_t* report) {
+			for(uint8_t i = 0; i < num_stale_bytes; i++) {
+				report[stale_bytes[i]] &= ~stale_masks[i];
+			}
+			num_stale_bytes = 0;
+			for(uint8_t i = 0; i < num_key_bytes; i++) {
+				report[key_bytes[i]] &= ~key_masks[i];
+			}
+			for(uint8_t i = 0; i < num_keys; i++) {
+				report[keys[i].byte] |= ((inputs >> keys[i].input) & 1) << keys[i].bit;
+			}
+		}
+};
+
+extern Compiled_Config compiled_config;	// In main.cpp
+
+#endif
@@ -14,6 +14,16 @@ struct config_t {
 						// Bit 6:	Enable buttons for the axes
 						// Bit 7:	Invert light signals (always on, press or HID turns them off)
 						// Bit 8:	Enable QE pair mode (divert QE1B and QE2B to X Axis)
+						// Bit 9:	Sample buttons with timer-triggered DMA
+						// Bit 10:	Sync input sampling and reports to USB start of frame
+						// Bit 11:	Replace reports still waiting on a busy endpoint with newer ones
+						// Bit 12:	Profile main loop phases and interrupts (feature report 0xa8)
+						// Bit 13:	Record edge to USB latency histogram (feature report 0xa9)
+						// Bit 14:	Timestamp QE edges, start and reverse the axes on a single edge interval
+						// Bit 15:	High resolution joystick report (16-bit positions, velocity, sample sequence and time)
+						// Bit 16:	Add a mouse interface moved by the axes
+						// Bit 17:	Adapt axis deadzone and sustain to the measured speed
+						// Bit 18:	Read axis 1 from a magnetic angle sensor on SPI1 instead of QE1 (Roxy v2.0)
 	int8_t qe_sens[2];
 	uint8_t ps2_mode;	// 0: Disabled
 						// 1: Pop'n Music
@@ -23,13 +33,33 @@ struct config_t {
 	uint8_t rgb_brightness;
 	uint8_t debounce_time;
 	uint8_t controller_emulation;
-	uint8_t axis_debounce_time;
+	uint8_t axis_debounce_time;	// Unused, kept for the layout
 	uint8_t output_mode;	// 0: Joystick only
 							// 1: Keyboard only
 							// 2: Joystick + Keyboard
 	uint8_t reduction_ratio[2];
 	uint8_t axis_sustain_time;
 	uint8_t deadzone_angle[2];	// Deadzone angle measured in 0.5 deg
+	uint8_t button_sample_rate;	// Button sample rate in kHz (Flag bit 9), 0: 10 kHz, at most 12
+	uint8_t debounce_mode[2];	// 1 bit per button
+								// 0 = Eager (report the first edge, then ignore the input for debounce_time)
+								// 1 = Deferred (report once the input has been stable for debounce_time)
+	uint8_t sof_lead;			// Time to build reports before the next frame in 4 us steps (Flag bit 10), 0: 200 us
+	uint16_t debounce_time_us;		// Overrides debounce_time if set
+	uint16_t axis_sustain_time_us;	// Overrides axis_sustain_time if set
+	uint8_t qe_pair_filter;		// QE pair mode glitch filter (Flag bit 8)
+								// 0 = None (double steps count two in the guessed direction)
+								// 1 = Drop double steps
+								// 2 = Drop double steps, and only take inputs that read the same twice
+	uint8_t analog_filter;		// Analog knob filter time constant, 2^n ms up to 10 (Flag bit 5), 0: off
+	uint8_t mouse_axes;			// Mouse target per axis (Flag bit 16), 1 nibble per axis
+								// 0 = Default (QE1 on X, QE2 on Y)
+								// 1 = X
+								// 2 = Y
+								// 3 = Wheel
+								// 4 = None
+	uint16_t profile_chord;		// Report buttons held together to switch profiles, then button 1-4 picks profile 1-4
+								// 0 = Off
 };
 
 struct mapping_config_t {
@@ -0,0 +1,177 @@
+#ifndef CONFIG_JOB_H
+#define CONFIG_JOB_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "configloader.h"
+#include "us_clock.h"
+
+#define CONFIG_SEGMENT_MAX	60	// Data bytes of a config feature report
+#define ERASE_QUIET_US		5000	// Inputs unchanged for this long before a page erase
+
+struct config_save_stats_t {
+	uint8_t pending;		// Segments waiting to be saved, one bit each, bit 4 the active profile
+	uint8_t saving;			// Segments being saved, one bit each, 0 if none
+	uint16_t queued;		// Feature reports taken
+	uint32_t saved;			// Saves done
+	uint32_t unchanged;		// Saves of the value already stored
+	uint32_t failed;		// Saves that didn't fit in the store
+	uint32_t steps;			// Flash operations
+	uint32_t max_step_us;	// Longest one, the longest the main loop stalled
+} __attribute__((packed));
+
+// Config saves deferred from the USB request to the main loop. A feature
+// report only copies its segment here, and poll() carries the saves out
+// one flash operation per main loop iteration, so inputs keep being read
+// and reported in between. A segment sent again before it was saved is
+// only saved once, with the newest data. Segments queued together are
+// saved as one, so a power cut leaves all or none of them.
+//
+// Pages are only erased by the save that needs it. An erase holds the main
+// loop up for up to 40 ms, and with it the reports and any buttons it
+// polls. The interrupt driven inputs run from RAM and keep counting, see
+// ram_irqs in main.cpp. So the erase waits until the inputs have been still
+// for ERASE_QUIET_US, which moves the stall out of the way of a button
+// press but doesn't shorten it.
+class Config_Job {
+	private:
+		Configloader* loaders[CONFIG_SEGMENTS];
+		uint8_t data[CONFIG_SEGMENTS][CONFIG_SEGMENT_MAX];
+		uint8_t size[CONFIG_SEGMENTS];
+		uint8_t profile[CONFIG_SEGMENTS];
+		uint8_t active_profile = 0;
+
+		uint8_t together = 0;
+		uint32_t last_input = 0;
+		config_save_stats_t stats = {0, 0, 0, 0, 0, 0, 0, 0};
+
+		Config_Store::item_t item(uint8_t i) {
+			if(i == CONFIG_SEGMENTS) {
+				return {CONFIG_PROFILE_KEY, 1, &active_profile};
+			}
+			return loaders[i]->item(size[i], data[i], profile[i]);
+		}
+
+		// Stages the segments of mask as one save.
+		bool begin(uint8_t mask) {
+			Config_Store::item_t items[CONFIG_SEGMENTS + 1];
+			uint32_t n = 0;
+			for(uint8_t i = 0; i <= CONFIG_SEGMENTS; i++) {
+				if(mask & (1 << i)) {
+					items[n++] = item(i);
+				}
+			}
+			return config_store.begin(items, n);
+		}
+
+		bool quiet() {
+			return us_clock.now() - last_input >= ERASE_QUIET_US;
+		}
+
+		void measure(uint32_t start) {
+			uint32_t us = us_clock.now() - start;
+			if(us > stats.max_step_us) {
+				stats.max_step_us = us;
+			}
+		}
+
+		bool holds(uint8_t mask) {
+			for(uint8_t i = 0; i <= CONFIG_SEGMENTS; i++) {
+				Config_Store::item_t it = item(i);
+				if((mask & (1 << i)) && !config_store.holds(it.key, it.size, it.data)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+	public:
+		Config_Job(Configloader& c0, Configloader& c1, Configloader& c2, Configloader& c3) : loaders{&c0, &c1, &c2, &c3} {}
+
+		bool queue(uint8_t segment, uint8_t len, const void* src, uint8_t prof = 0) {
+			if(segment >= CONFIG_SEGMENTS || len > CONFIG_SEGMENT_MAX || prof >= CONFIG_PROFILES) {
+				return false;
+			}
+			memcpy(data[segment], src, len);
+			size[segment] = len;
+			profile[segment] = prof;
+			stats.pending |= 1 << segment;
+			stats.queued++;
+			return true;
+		}
+
+		// Saves the queued segments of mask as one.
+		void queue_together(uint8_t mask) {
+			together |= mask & stats.pending;
+		}
+
+		// Saves which profile to load at startup.
+		void queue_profile(uint8_t prof) {
+			active_profile = prof;
+			stats.pending |= 1 << CONFIG_SEGMENTS;
+		}
+
+		// A button changed or an axis is moving.
+		void input_changed() {
+			last_input = us_clock.now();
+		}
+
+		// Nothing left to write, so it's safe to reset.
+		bool idle() {
+			return !stats.saving && !stats.pending;
+		}
+
+		void poll() {
+			if(!stats.saving) {
+				if(!stats.pending) {
+					return;
+				}
+				uint8_t first = 1 << __builtin_ctz(stats.pending);
+				uint8_t mask = together & first ? together & stats.pending : first;
+				stats.pending &= ~mask;
+				together &= ~mask;
+				if(!begin(mask)) {
+					if(holds(mask)) {
+						stats.unchanged++;
+					} else {
+						stats.failed++;
+					}
+					return;
+				}
+				stats.saving = mask;
+			}
+
+			if(config_store.erasing() && !quiet()) {
+				return;
+			}
+
+			uint32_t start = us_clock.now();
+			bool more = config_store.step();
+			measure(start);
+
+			if(more) {
+				stats.steps++;
+			} else {
+				stats.saved++;
+				stats.saving = 0;
+			}
+		}
+
+		config_save_stats_t get_stats() {
+			return stats;
+		}
+
+		void reset_stats() {
+			stats.queued = 0;
+			stats.saved = 0;
+			stats.unchanged = 0;
+			stats.failed = 0;
+			stats.steps = 0;
+			stats.max_step_us = 0;
+		}
+};
+
+extern Config_Job config_job;	// In main.cpp
+
+#endif
@@ -0,0 +1,425 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flash_writer.h"
+
+#define STORE_BASE		0x8021800	// After the pages of the per-segment Configloader
+#define STORE_PAGES		8
+
+// CRC-32 as zlib computes it, so host tools can check it the same way.
+inline uint32_t crc32_update(uint32_t crc, const void* data, uint32_t len) {
+	static const uint32_t table[16] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+	};
+	const uint8_t* p = (const uint8_t*)data;
+	crc = ~crc;
+	while(len--) {
+		crc ^= *p++;
+		crc = (crc >> 4) ^ table[crc & 0xf];
+		crc = (crc >> 4) ^ table[crc & 0xf];
+	}
+	return ~crc;
+}
+
+// Journal of keyed records over a ring of flash pages. A save appends a
+// record to the active page, and the newest valid record of a key is its
+// value. When the page is full, the newest record of every key is copied
+// to the next page in the ring, which then becomes active. Every page is
+// erased once per trip round the ring.
+//
+// A save is staged in RAM by begin() and carried out one flash operation
+// per step(), so the main loop keeps running between them. write() does
+// it all at once.
+//
+// Several keys can be saved as a batch, which reads as either all old or
+// all new values.
+//
+// Writes are ordered so a power cut at any point leaves either the old or
+// the new value:
+//	A record's commit half-word is programmed last, and records without it
+//	or with a bad CRC are skipped. Its size comes first, so a torn record
+//	is still stepped over.
+//	The records of a batch are chained, each but the last only valid if
+//	the one after it is, so the last commit half-word commits them all. A
+//	page ending in a chained record is never appended to again.
+//	A page is only taken as active once its header is programmed, after
+//	everything copied to it. The highest sequence number wins.
+class Config_Store {
+	public:
+		// One key of a batch.
+		struct item_t {
+			uint16_t key;
+			uint16_t size;
+			const void* data;
+		};
+
+	private:
+		enum {
+			MAGIC = 0xc0f5703e,
+			BATCH_MAX = 8,
+			COMMIT = 0x0000,	// Programmable over any value
+			CHAINED = 0x00c4,	// Valid if the next record is
+		};
+
+		struct page_header_t {
+			uint32_t seq;		// Programmed first
+			uint32_t magic;
+		};
+
+		struct record_t {
+			uint16_t size;		// Data bytes
+			uint16_t key;
+			uint32_t crc;		// Over key, size and data
+			uint16_t commit;
+			uint8_t data[];
+		} __attribute__((packed));
+
+		Flash_Writer& flash;
+		uint32_t base;
+		uint32_t pages;
+
+		int32_t active = -1;
+		uint32_t seq = 0;
+		uint32_t used = FLASH_PAGE_SIZE;	// Offset of the first unwritten record
+
+		uint32_t page_addr(uint32_t page) {
+			return base + page * FLASH_PAGE_SIZE;
+		}
+
+		// Where the next compaction goes
+		uint32_t next_page() {
+			return active < 0 ? 0 : (active + 1) % pages;
+		}
+
+		static uint32_t record_len(uint32_t size) {
+			return (sizeof(record_t) + size + 3) & ~3;
+		}
+
+		static uint32_t record_crc(uint16_t key, uint16_t size, const void* data) {
+			uint16_t head[2] = {key, size};
+			return crc32_update(crc32_update(0, head, sizeof(head)), data, size);
+		}
+
+		bool valid(const record_t* r) {
+			uint32_t offset = uint32_t(uintptr_t(r)) - page_addr(active);
+			while(const record_t* n = next(offset)) {
+				if(n->crc != record_crc(n->key, n->size, n->data)) {
+					return false;
+				}
+				if(n->commit != CHAINED) {
+					return n->commit == COMMIT;
+				}
+			}
+			return false;
+		}
+
+		// Walks the records of the active page, stopping at the free space.
+		const record_t* next(uint32_t& offset) {
+			if(offset + sizeof(record_t) > FLASH_PAGE_SIZE) {
+				return nullptr;
+			}
+			const record_t* r = (const record_t*)uintptr_t(page_addr(active) + offset);
+			if(r->size == 0xffff || offset + record_len(r->size) > FLASH_PAGE_SIZE) {
+				return nullptr;
+			}
+			offset += record_len(r->size);
+			return r;
+		}
+
+		// Only the newest record of the key has its CRC checked, unless it
+		// turns out bad.
+		const record_t* find(uint16_t key) {
+			if(active < 0) {
+				return nullptr;
+			}
+			uint32_t limit = FLASH_PAGE_SIZE;
+			while(true) {
+				const record_t* found = nullptr;
+				uint32_t offset = sizeof(page_header_t);
+				uint32_t found_offset = 0;
+				while(offset < limit) {
+					uint32_t at = offset;
+					const record_t* r = next(offset);
+					if(!r) {
+						break;
+					}
+					if(r->key == key) {
+						found = r;
+						found_offset = at;
+					}
+				}
+				if(!found || valid(found)) {
+					return found;
+				}
+				limit = found_offset;
+			}
+		}
+
+		bool blank(uint32_t page) {
+			const uint32_t* p = (const uint32_t*)uintptr_t(page_addr(page));
+			for(uint32_t i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+				if(p[i] != 0xffffffff) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// A save staged as the image of what it programs, carried out one
+		// flash operation per step(). The seal range goes last: the commit
+		// half-word of an appended record, or the header of a new page.
+		struct job_t {
+			bool erase;
+			uint32_t addr;		// Flash address of stage[0]
+			uint32_t len;
+			uint32_t seal;		// Offset and length of the seal range
+			uint32_t seal_len;
+			uint32_t pos;		// Next offset to program
+			bool sealing;
+			int32_t active;		// State once done
+			uint32_t used;
+		};
+
+		job_t job;
+		bool staged = false;
+		uint8_t stage[FLASH_PAGE_SIZE] __attribute__((aligned(4)));
+
+		// Header and data of a record at offset of the stage.
+		void stage_record(uint32_t offset, uint16_t key, uint16_t size, const void* data, uint16_t commit = COMMIT) {
+			record_t head = {size, key, record_crc(key, size, data), commit};
+			memcpy(stage + offset, &head, sizeof(record_t));
+			memcpy(stage + offset + sizeof(record_t), data, size);
+		}
+
+		static bool saving(uint16_t key, const item_t* items, uint32_t n) {
+			for(uint32_t i = 0; i < n; i++) {
+				if(items[i].key == key) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		static uint32_t items_len(const item_t* items, uint32_t n) {
+			uint32_t len = 0;
+			for(uint32_t i = 0; i < n; i++) {
+				len += record_len(items[i].size);
+			}
+			return len;
+		}
+
+		// Stages the next page of the ring with the newest record of every
+		// other key and the new ones, committed together by the page header.
+		bool stage_compact(const item_t* items, uint32_t n) {
+			uint32_t out = sizeof(page_header_t) + items_len(items, n);
+			if(active >= 0) {
+				uint32_t offset = sizeof(page_header_t);
+				while(const record_t* r = next(offset)) {
+					if(!saving(r->key, items, n) && find(r->key) == r) {
+						out += record_len(r->size);
+					}
+				}
+			}
+			if(out > FLASH_PAGE_SIZE) {
+				return false;
+			}
+
+			uint32_t to = next_page();
+			memset(stage, 0xff, sizeof(stage));
+			page_header_t header = {seq + 1, MAGIC};
+			memcpy(stage, &header, sizeof(header));
+
+			out = sizeof(page_header_t);
+			if(active >= 0) {
+				uint32_t offset = sizeof(page_header_t);
+				while(const record_t* r = next(offset)) {
+					if(saving(r->key, items, n) || find(r->key) != r) {
+						continue;
+					}
+					stage_record(out, r->key, r->size, r->data);
+					out += record_len(r->size);
+				}
+			}
+			for(uint32_t i = 0; i < n; i++) {
+				stage_record(out, items[i].key, items[i].size, items[i].data);
+				out += record_len(items[i].size);
+			}
+
+			job = {!blank(to), page_addr(to), out, 0, sizeof(page_header_t), 0, false, int32_t(to), out};
+			return true;
+		}
+
+	public:
+		Config_Store(Flash_Writer& f, uint32_t b, uint32_t n) : flash(f), base(b), pages(n) {}
+
+		// Finds the active page and its free space.
+		void mount() {
+			active = -1;
+			for(uint32_t i = 0; i < pages; i++) {
+				const page_header_t* h = (const page_header_t*)uintptr_t(page_addr(i));
+				if(h->magic == MAGIC && h->seq != 0xffffffff && (active < 0 || h->seq > seq)) {
+					active = i;
+					seq = h->seq;
+				}
+			}
+
+			used = FLASH_PAGE_SIZE;
+			if(active >= 0) {
+				uint32_t offset = sizeof(page_header_t);
+				const record_t* last = nullptr;
+				while(const record_t* r = next(offset)) {
+					last = r;
+				}
+				// Anything after the last record that isn't blank can't be
+				// trusted, nor can a batch cut short
+				const uint16_t* p = (const uint16_t*)uintptr_t(page_addr(active) + offset);
+				if(offset + sizeof(record_t) <= FLASH_PAGE_SIZE && *p == 0xffff && !(last && last->commit == CHAINED)) {
+					used = offset;
+				}
+			}
+		}
+
+		bool read(uint16_t key, uint32_t size, void* data) {
+			const record_t* r = find(key);
+			if(!r) {
+				return false;
+			}
+			memcpy(data, r->data, r->size < size ? r->size : size);
+			return true;
+		}
+
+		bool holds(uint16_t key, uint32_t size, const void* data) {
+			const record_t* r = find(key);
+			return r && r->size == size && !memcmp(r->data, data, size);
+		}
+
+		// Stages a save for step(). Returns false if the key already has the
+		// value, or it can't be saved. Only one save is staged at a time.
+		bool begin(uint16_t key, uint32_t size, const void* data) {
+			item_t item = {key, uint16_t(size), data};
+			return size < FLASH_PAGE_SIZE && begin(&item, 1);
+		}
+
+		// Stages a batch, leaving out keys that already have their value.
+		// Returns false if none is left, or it can't be saved.
+		bool begin(const item_t* items, uint32_t n) {
+			if(staged || n > BATCH_MAX) {
+				return false;
+			}
+
+			item_t batch[BATCH_MAX];
+			uint32_t count = 0;
+			for(uint32_t i = 0; i < n; i++) {
+				if(!holds(items[i].key, items[i].size, items[i].data)) {
+					batch[count++] = items[i];
+				}
+			}
+
+			uint32_t len = items_len(batch, count);
+			if(!count || len > FLASH_PAGE_SIZE - sizeof(page_header_t)) {
+				return false;
+			}
+
+			if(active >= 0 && used + len <= FLASH_PAGE_SIZE) {
+				memset(stage, 0xff, len);
+				uint32_t out = 0;
+				for(uint32_t i = 0; i < count; i++) {
+					stage_record(out, batch[i].key, batch[i].size, batch[i].data, i + 1 < count ? CHAINED : COMMIT);
+					out += record_len(batch[i].size);
+				}
+				uint32_t seal = out - record_len(batch[count - 1].size) + offsetof(record_t, commit);
+				job = {false, page_addr(active) + used, len, seal, 2, 0, false, active, used + len};
+			} else if(!stage_compact(batch, count)) {
+				return false;
+			}
+
+			staged = true;
+			flash.unlock();
+			return true;
+		}
+
+		bool busy() {
+			return staged;
+		}
+
+		// Whether the next step() is a page erase.
+		bool erasing() {
+			return staged && job.erase;
+		}
+
+		// Carries out one flash operation of the staged save, a page erase
+		// or a half-word. Returns true while there's more to do.
+		bool step() {
+			if(!staged) {
+				return false;
+			}
+
+			if(job.erase) {
+				flash.erase(job.addr);
+				job.erase = false;
+				return true;
+			}
+
+			// Everything outside the seal range, then the seal range. Erased
+			// half-words are left alone.
+			while(true) {
+				uint32_t end = job.sealing ? job.seal + job.seal_len : job.len;
+				if(job.pos >= end) {
+					if(job.sealing) {
+						break;
+					}
+					job.sealing = true;
+					job.pos = job.seal;
+					continue;
+				}
+				uint32_t pos = job.pos;
+				job.pos += 2;
+				if(!job.sealing && pos >= job.seal && pos < job.seal + job.seal_len) {
+					continue;
+				}
+				uint16_t v = stage[pos] | (stage[pos + 1] << 8);
+				if(v != 0xffff) {
+					flash.program(job.addr + pos, v);
+					return true;
+				}
+			}
+
+			if(job.active != active) {
+				seq++;
+			}
+			active = job.active;
+			used = job.used;
+			staged = false;
+			flash.lock();
+			return false;
+		}
+
+		// Saving the value a key already has doesn't touch the flash.
+		bool write(uint16_t key, uint32_t size, const void* data) {
+			item_t item = {key, uint16_t(size), data};
+			return write(&item, 1);
+		}
+
+		bool write(const item_t* items, uint32_t n) {
+			if(staged) {
+				return false;
+			}
+			if(!begin(items, n)) {
+				for(uint32_t i = 0; i < n; i++) {
+					if(!holds(items[i].key, items[i].size, items[i].data)) {
+						return false;
+					}
+				}
+				return true;
+			}
+			while(step());
+			return true;
+		}
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef CONFIG_TRANSFER_H
+#define CONFIG_TRANSFER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "config_store.h"
+#include "live_config.h"
+#include "report_desc.h"
+
+#include "rgb/rgb_config.h"
+#include "device/device_config.h"
+
+// All segments back to back
+#define CONFIG_IMAGE_SIZE	(sizeof(config_t) + sizeof(rgb_config_t) + sizeof(mapping_config_t) + sizeof(device_config_t))
+
+struct config_transfer_status_t {
+	uint16_t image_size;
+	uint16_t segment_size[CONFIG_SEGMENTS];
+	uint32_t crc;			// Of the running image
+	uint32_t staged_crc;	// Of the staged image
+	uint8_t staging;		// 1 while a staged image takes writes
+	uint8_t result;			// Of the last commit
+} __attribute__((packed));
+
+// Config transfer over feature report 0xc2, addressing the segments as one
+// image by byte offset instead of one report per segment.
+//
+// Reading: SET READ with the offset to start from, then each GET returns
+// the next chunk with its offset, until the end of the image. Any other GET
+// returns the status, with the CRC-32 of the running image to check the
+// read against.
+//
+// Writing: SET BEGIN stages a copy of the running image, SET WRITE chunks
+// change it, in any order, and SET COMMIT with the CRC-32 of the whole
+// staged image applies it. A commit with the wrong CRC stalls and leaves
+// the staged image open to fix. All segments are applied together and
+// saved as one, or only applied if flag bit 0 asks for a preview.
+class Config_Transfer {
+	public:
+		enum Op {
+			STATUS = 0,
+			READ = 1,
+			BEGIN = 2,
+			WRITE = 3,
+			COMMIT = 4,
+		};
+
+		enum Result {
+			NONE = 0,
+			DONE = 1,
+			BAD_CRC = 2,
+			NOT_BEGUN = 3,
+			FAILED = 4,
+		};
+
+	private:
+		uint8_t staged[CONFIG_IMAGE_SIZE];
+		bool staging = false;
+		bool reading = false;
+		uint16_t cursor = 0;
+		uint8_t result = NONE;
+
+		static uint8_t* segment(uint8_t s) {
+			switch(s) {
+				case 0:
+					return (uint8_t*)&config;
+
+				case 1:
+					return (uint8_t*)&rgb_config;
+
+				case 2:
+					return (uint8_t*)&mapping_config;
+
+				default:
+					return (uint8_t*)&device_config;
+			}
+		}
+
+		static uint16_t segment_size(uint8_t s) {
+			switch(s) {
+				case 0:
+					return sizeof(config_t);
+
+				case 1:
+					return sizeof(rgb_config_t);
+
+				case 2:
+					return sizeof(mapping_config_t);
+
+				default:
+					return sizeof(device_config_t);
+			}
+		}
+
+		// Copies len bytes of the running image from offset.
+		static void read_image(uint16_t offset, uint8_t* dst, uint16_t len) {
+			for(uint8_t s = 0; s < CONFIG_SEGMENTS && len; s++) {
+				uint16_t size = segment_size(s);
+				if(offset >= size) {
+					offset -= size;
+					continue;
+				}
+				uint16_t n = size - offset < len ? size - offset : len;
+				memcpy(dst, segment(s) + offset, n);
+				dst += n;
+				len -= n;
+				offset = 0;
+			}
+		}
+
+		static uint32_t image_crc() {
+			uint32_t crc = 0;
+			for(uint8_t s = 0; s < CONFIG_SEGMENTS; s++) {
+				crc = crc32_update(crc, segment(s), segment_size(s));
+			}
+			return crc;
+		}
+
+		bool commit(const config_transfer_report_t* report) {
+			if(!staging) {
+				result = NOT_BEGUN;
+				return false;
+			}
+
+			uint32_t crc;
+			memcpy(&crc, report->data, sizeof(crc));
+			if(crc != crc32_update(0, staged, CONFIG_IMAGE_SIZE)) {
+				result = BAD_CRC;
+				return false;
+			}
+
+			const uint8_t* data[CONFIG_SEGMENTS];
+			uint8_t len[CONFIG_SEGMENTS];
+			uint16_t offset = 0;
+			for(uint8_t s = 0; s < CONFIG_SEGMENTS; s++) {
+				data[s] = staged + offset;
+				len[s] = segment_size(s);
+				offset += segment_size(s);
+			}
+
+			if(!live_config.set_segments(data, len, report->flags & (1 << 0))) {
+				result = FAILED;
+				return false;
+			}
+
+			staging = false;
+			result = DONE;
+			return true;
+		}
+
+	public:
+		bool set_report(const config_transfer_report_t* report) {
+			switch(report->op) {
+				case STATUS:
+					reading = false;
+					return true;
+
+				case READ:
+					if(report->offset >= CONFIG_IMAGE_SIZE) {
+						return false;
+					}
+					cursor = report->offset;
+					reading = true;
+					return true;
+
+				case BEGIN:
+					read_image(0, staged, CONFIG_IMAGE_SIZE);
+					staging = true;
+					result = NONE;
+					return true;
+
+				case WRITE:
+					if(!staging || report->size > sizeof(report->data) || report->offset + report->size > CONFIG_IMAGE_SIZE) {
+						return false;
+					}
+					memcpy(staged + report->offset, report->data, report->size);
+					return true;
+
+				case COMMIT:
+					return commit(report);
+			}
+			return false;
+		}
+
+		void get_report(config_transfer_report_t* report) {
+			if(reading) {
+				uint16_t n = CONFIG_IMAGE_SIZE - cursor;
+				if(n > sizeof(report->data)) {
+					n = sizeof(report->data);
+				}
+				*report = {0xc2, READ, uint8_t(n), 0, cursor, {}};
+				read_image(cursor, report->data, n);
+				cursor += n;
+				if(cursor >= CONFIG_IMAGE_SIZE) {
+					reading = false;
+				}
+				return;
+			}
+
+			config_transfer_status_t status = {CONFIG_IMAGE_SIZE, {}, image_crc(), crc32_update(0, staged, CONFIG_IMAGE_SIZE), staging, result};
+			for(uint8_t s = 0; s < CONFIG_SEGMENTS; s++) {
+				status.segment_size[s] = segment_size(s);
+			}
+			*report = {0xc2, STATUS, sizeof(status), 0, 0, {}};
+			memcpy(report->data, &status, sizeof(status));
+		}
+};
+
+extern Config_Transfer config_transfer;	// In main.cpp
+
+#endif
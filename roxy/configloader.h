@@ -1,85 +1,72 @@
 #ifndef CONFIGLOADER_H
 #define CONFIGLOADER_H
 
-#include <rcc/flash.h>
 #include <string.h>
 
+#include "config_store.h"
+
+#define CONFIG_SEGMENTS		4
+#define CONFIG_PROFILES		4
+#define CONFIG_PROFILE_KEY	0x100	// Store key of the active profile number
+
+extern Config_Store config_store;	// In main.cpp
+
+// One config segment, kept in the config store under its key plus
+// CONFIG_SEGMENTS per profile. Until profile 0 is first saved, its reads
+// fall back to the page the segment had to itself before the store, so
+// existing settings carry over.
 class Configloader {
 	private:
 		enum {
 			MAGIC = 0xc0ff600d,
 		};
-		
+
 		struct header_t {
 			uint32_t magic;
 			uint32_t size;
 		};
-		
+
+		uint16_t key;
 		uint32_t flash_addr;
-		
+
+		uint16_t profile_key(uint8_t profile) {
+			return key + profile * CONFIG_SEGMENTS;
+		}
+
 	public:
-		Configloader(uint32_t addr) : flash_addr(addr) {}
-		
-		bool read(uint32_t size, void* data) {
-			header_t* header = (header_t*)flash_addr;
-			
+		Configloader(uint16_t k, uint32_t addr) : key(k), flash_addr(addr) {}
+
+		bool read(uint32_t size, void* data, uint8_t profile = 0) {
+			if(config_store.read(profile_key(profile), size, data)) {
+				return true;
+			}
+
+			if(profile) {
+				return false;
+			}
+
+			header_t* header = (header_t*)uintptr_t(flash_addr);
+
 			if(header->magic != MAGIC) {
 				return false;
 			}
-			
+
 			if(header->size < size) {
 				size = header->size;
 			}
-			
+
 			memcpy(data, (void*)(flash_addr + sizeof(header_t)), size);
-			
+
 			return true;
 		}
-		
-		bool write(uint32_t size, void* data) {
-			header_t header = {MAGIC, size};
-			
-			// Unlock flash.
-			FLASH.KEYR = 0x45670123;
-			FLASH.KEYR = 0xCDEF89AB;
-			
-			// Erase page.
-			FLASH.CR = 1 << 1; // PER
-			FLASH.AR = flash_addr;
-			FLASH.CR = (1 << 6) | (1 << 1); // STRT, PER
-			
-			while(FLASH.SR & (1 << 0)); // BSY
-			
-			FLASH.SR &= ~(1 << 5); // EOP
-			FLASH.CR = 0;
-			
-			// Write header.
-			uint16_t* src = (uint16_t*)&header;
-			uint16_t* dest = (uint16_t*)flash_addr;
-			
-			for(uint32_t n = 0; n < sizeof(header); n += 2) {
-				FLASH.CR = 1 << 0; // PG
-				
-				*dest++ = *src++;
-				
-				while(FLASH.SR & (1 << 0)); // BSY
-			}
-			
-			// Write data.
-			src = (uint16_t*)data;
-			
-			for(uint32_t n = 0; n < size; n += 2) {
-				FLASH.CR = 1 << 0; // PG
-				
-				*dest++ = *src++;
-				
-				while(FLASH.SR & (1 << 0)); // BSY
-			}
-			
-			// Lock flash.
-			FLASH.CR = 1 << 7; // LOCK
-			
-			return true;
+
+		bool write(uint32_t size, void* data, uint8_t profile = 0) {
+			return config_store.write(profile_key(profile), size, data);
+		}
+
+		// The store record of a save, for Config_Store::begin().
+		Config_Store::item_t item(uint32_t size, const void* data, uint8_t profile = 0) {
+			return {profile_key(profile), uint16_t(size), data};
 		}
 };
 
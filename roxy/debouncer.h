@@ -0,0 +1,78 @@
+#ifndef DEBOUNCER_H
+#define DEBOUNCER_H
+
+#include <stdint.h>
+
+#define DEBOUNCE_BITS	16		// Counter width, enough for 255 ms at 255 kHz sampling
+
+// Debounces up to 16 buttons at once with vertical counters: count[k] holds
+// bit k of every button's counter, so each step is a handful of word-wide
+// operations regardless of the number of buttons.
+//
+// Eager buttons report the first edge and then ignore the input until the
+// counter has run out. Deferred buttons report once the input has disagreed
+// with the state for the full count, and start over on every bounce.
+class Debouncer {
+	private:
+		uint16_t count[DEBOUNCE_BITS];
+		uint16_t reload[DEBOUNCE_BITS];	// Threshold, same layout as count
+		uint16_t eager;
+		uint16_t state;
+
+		uint16_t is_zero() {
+			uint16_t nonzero = 0;
+			for(uint8_t k = 0; k < DEBOUNCE_BITS; k++) {
+				nonzero |= count[k];
+			}
+			return ~nonzero;
+		}
+
+		void load(uint16_t mask) {
+			for(uint8_t k = 0; k < DEBOUNCE_BITS; k++) {
+				count[k] = (count[k] & ~mask) | (reload[k] & mask);
+			}
+		}
+
+		void decrement(uint16_t mask) {
+			uint16_t borrow = mask;
+			for(uint8_t k = 0; borrow && k < DEBOUNCE_BITS; k++) {
+				uint16_t c = count[k];
+				count[k] = c ^ borrow;
+				borrow &= ~c;
+			}
+		}
+
+	public:
+		void init(uint16_t threshold, uint16_t eager_mask, uint16_t initial) {
+			for(uint8_t k = 0; k < DEBOUNCE_BITS; k++) {
+				reload[k] = (threshold >> k) & 1 ? 0xffff : 0;
+			}
+			eager = eager_mask;
+			state = initial;
+			load(0xffff);
+		}
+
+		// Sample has one bit per button. Counters only run on ticks, but edges
+		// are picked up on every call.
+		uint16_t update(uint16_t sample, bool tick) {
+			uint16_t diff = sample ^ state;
+
+			load(~eager & ~diff);
+
+			if(tick) {
+				decrement((eager | diff) & ~is_zero());
+			}
+
+			uint16_t change = diff & is_zero();
+			state ^= change;
+			load(change);
+
+			return state;
+		}
+
+		uint16_t get_state() {
+			return state;
+		}
+};
+
+#endif
@@ -6,7 +6,12 @@
 struct device_config_t {
     uint32_t device_enable;     // Bit 0:   Enable SVRE9 lights
                                 // Bit 1:   Enable Turbocharger support on SPI3
+                                // Bit 2:   Enable hall effect buttons on ADC inputs
     uint8_t svre_led_mapping;   //  1 nibble per light, button input mapping
+    uint16_t hall_mask;         // Buttons read from hall effect sensors, 1 bit per button
+    uint8_t hall_channel[12];   // ADC input per button, bits 0-4: channel, bit 7: ADC2 instead of ADC1
+    uint8_t hall_actuation[12]; // Actuation point in 1/256 of full travel, 0: half way
+    uint8_t hall_rapid_trigger; // Travel in 1/256 that releases or re-presses past the actuation point, 0: off
 };
 
 #endif
\ No newline at end of file
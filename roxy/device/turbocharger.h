@@ -130,8 +130,8 @@ class Turbocharger {
             busy = true;
 
 			DMA2.reg.C[1].NDTR = config_sent ? 51 : 6;
-			DMA2.reg.C[1].MAR = (uint32_t)&data_array;
-			DMA2.reg.C[1].PAR = (uint32_t)&SPI3.reg.DR;
+			DMA2.reg.C[1].MAR = (uintptr_t)&data_array;
+			DMA2.reg.C[1].PAR = (uintptr_t)&SPI3.reg.DR;
 			DMA2.reg.C[1].CR = 	(1 << 10) |	// MSIZE = 16-bits
 								(1 << 8) | 	// PSIZE = 16-bits
 								(1 << 7) |	// Memory increment mode enabled
@@ -164,9 +164,9 @@ class Turbocharger {
         }
 
         uint8_t count_bits(uint16_t input) {
-            uint8_t count;
+            uint8_t count = 0;
             for (uint8_t i = 0; i < 16; i++) {
-                if((input >> i) & 0x1 == 1) {
+                if((input >> i) & 0x1) {
                     count++;
                 }
             }
@@ -0,0 +1,77 @@
+#ifndef EP_RESTAGE_H
+#define EP_RESTAGE_H
+
+#include <usb/usb.h>
+#include <stdint.h>
+
+#include "us_clock.h"
+
+#define EPR_CTR_RX		(1 << 15)
+#define EPR_CTR_TX		(1 << 7)
+#define EPR_DTOG_TX		(1 << 6)
+#define EPR_STAT_TX		(3 << 4)
+#define EPR_STAT_TX_NAK	(2 << 4)
+#define EPR_STAT_TX_VALID	(3 << 4)
+#define EPR_KEEP		0x070f		// EP_TYPE, EP_KIND, EA
+
+#define USB_FS_BITS_PER_US	12
+#define USB_PACKET_OVERHEAD	4			// SYNC, PID and CRC16 bytes around the data
+#define USB_HANDSHAKE_BITS	48			// Inter-packet gap, turnaround and the host's ACK
+
+// Swaps the packet armed on an interrupt IN endpoint for a newer one before
+// the host collects it, so the next poll always gets the latest state.
+//
+// The USB peripheral only double buffers bulk and isochronous endpoints, so
+// the endpoint is NAKed instead, checked for a packet that went out in the
+// meantime and written again. DTOG_TX flips on every acknowledged packet,
+// which tells whether the old one was sent.
+class Ep_Restage {
+	private:
+		// Toggle bits are written as 0 to leave them alone, CTR bits as 1.
+		void toggle_stat_tx(uint32_t epr, uint32_t ep) {
+			USB.reg.EPR[ep] = (epr & EPR_KEEP) | EPR_CTR_RX | EPR_CTR_TX | (1 << 4);
+		}
+
+		// Time for a packet of len data bytes at full speed with worst case
+		// bit stuffing (one bit in six) and EOP, until its ACK is in.
+		static uint32_t packet_us(uint32_t len) {
+			uint32_t bits = (len + USB_PACKET_OVERHEAD) * 8 * 7 / 6 + 3 + USB_HANDSHAKE_BITS;
+			return (bits + USB_FS_BITS_PER_US - 1) / USB_FS_BITS_PER_US;
+		}
+
+	public:
+		// True if the packet was replaced. False means the old one went out,
+		// and the endpoint is ready for a normal write.
+		bool replace(USB_generic* usb, uint32_t ep, uint32_t* bufp, uint32_t len) {
+			uint32_t epr = USB.reg.EPR[ep];
+			if((epr & EPR_STAT_TX) != EPR_STAT_TX_VALID) {
+				return false;
+			}
+
+			// VALID -> NAK
+			toggle_stat_tx(epr, ep);
+
+			// An IN token that came before the NAK still gets its packet.
+			// Give it time to finish.
+			us_clock.delay(packet_us(len));
+
+			uint32_t now = USB.reg.EPR[ep];
+
+			// Sent between the read and the write, and the toggle armed it
+			// again. Back to NAK; at worst the host sees the old state twice.
+			if((now & EPR_STAT_TX) == EPR_STAT_TX_VALID) {
+				toggle_stat_tx(now, ep);
+			}
+
+			if((now ^ epr) & EPR_DTOG_TX) {
+				return false;
+			}
+
+			usb->write(ep, bufp, len);
+			return true;
+		}
+};
+
+Ep_Restage ep_restage;
+
+#endif
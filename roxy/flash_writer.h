@@ -0,0 +1,49 @@
+#ifndef FLASH_WRITER_H
+#define FLASH_WRITER_H
+
+#include <rcc/flash.h>
+#include <stdint.h>
+
+#include "ramfunc.h"
+
+#define FLASH_PAGE_SIZE	2048
+
+// Page erase and half-word programming of the internal flash, waiting on
+// BSY. Virtual so host benchmarks can run the same callers on an emulator.
+//
+// The operations run from RAM, so interrupts with their handlers in RAM
+// are still taken while they wait.
+class Flash_Writer {
+	public:
+		virtual void unlock() {
+			FLASH.KEYR = 0x45670123;
+			FLASH.KEYR = 0xCDEF89AB;
+		}
+
+		virtual void lock() {
+			FLASH.CR = 1 << 7; // LOCK
+		}
+
+		RAMFUNC virtual void erase(uint32_t addr) {
+			FLASH.CR = 1 << 1; // PER
+			FLASH.AR = addr;
+			FLASH.CR = (1 << 6) | (1 << 1); // STRT, PER
+
+			while(FLASH.SR & (1 << 0)); // BSY
+
+			FLASH.SR &= ~(1 << 5); // EOP
+			FLASH.CR = 0;
+		}
+
+		RAMFUNC virtual void program(uint32_t addr, uint16_t value) {
+			FLASH.CR = 1 << 0; // PG
+
+			*(volatile uint16_t*)uintptr_t(addr) = value;
+
+			while(FLASH.SR & (1 << 0)); // BSY
+
+			FLASH.CR = 0;
+		}
+};
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef HALL_BUTTONS_H
+#define HALL_BUTTONS_H
+
+#include <rcc/rcc.h>
+#include <adc/adc_f3.h>
+#include <dma/dma.h>
+#include <syscfg/syscfg.h>
+#include <os/time.h>
+#include <stdint.h>
+
+#include "board_define.h"
+
+#define HALL_SCANS		4		// Conversions per channel averaged by read()
+#define HALL_MAX_KEYS	16		// Regular sequence length per ADC
+#define HALL_MIN_SPAN	1000	// Smallest full travel, in sums of HALL_SCANS 12-bit conversions (~0.2 V)
+#define HALL_HYSTERESIS	8		// Travel in 1/256 below the actuation point that releases
+
+// Hall effect key switches on ADC inputs. Each ADC scans its keys' channels
+// continuously into a circular DMA buffer holding the last HALL_SCANS scans,
+// so read() only sums memory.
+//
+// Travel is 0-255 from the rest level captured at init() to the largest
+// distance from it seen so far, which covers either magnet polarity. A key
+// presses at its actuation point and releases HALL_HYSTERESIS above it.
+// With rapid trigger, while it stays past the actuation point it also
+// releases on any upward movement of rt from the deepest point it reached,
+// and presses again on any downward movement of rt from where it turned.
+//
+// Uses the same ADCs and DMA channels as the analog knobs:
+//	ADC1 -> DMA1 channel 1
+//	ADC2 -> DMA2 channel 3 (ADC24_DMA_RMP)
+class Hall_Buttons {
+	private:
+		struct adc_t {
+			ADC_t* adc;
+			DMA_t* dma;
+			uint8_t channel;
+			uint32_t remap;		// SYSCFG_CFGR1 DMA remap bit
+		};
+
+		const adc_t adcs[2] = {
+			{&ADC1, &DMA1, 0, 0},
+			{&ADC2, &DMA2, 2, 1 << 8},
+		};
+
+		struct key_t {
+			uint8_t adc;
+			uint8_t index;		// Position in the ADC's scan sequence
+			uint8_t actuation;
+			uint8_t extreme;	// Deepest travel while pressed, shallowest while released
+			bool active;		// Past the actuation point
+			bool pressed;
+			uint16_t rest;
+			uint16_t span;
+		};
+
+		uint8_t channels[2][HALL_MAX_KEYS];
+		uint8_t num_channels[2] = {0, 0};
+		volatile uint16_t buf[2][HALL_SCANS * HALL_MAX_KEYS];
+
+		key_t keys[MAX_BUTTONS];
+		uint16_t mask = 0;
+		uint16_t state = 0;
+		uint8_t rt = 0;
+
+		uint32_t sum(const key_t& k) {
+			uint32_t n = num_channels[k.adc];
+			uint32_t s = 0;
+			for(uint32_t i = 0; i < HALL_SCANS; i++) {
+				s += buf[k.adc][i * n + k.index];
+			}
+			return s;
+		}
+
+		void enable_adc(uint8_t a) {
+			const adc_t& c = adcs[a];
+			ADC_t& adc = *c.adc;
+			uint32_t n = num_channels[a];
+
+			// Turn on ADC regulator.
+			adc.CR &= ~((1 << 28) | (1 << 29));	// Reset ADVREGEN
+			adc.CR |= 1 << 28;	// Turn on ADVREGEN
+			Time::sleep(2);		// Wait for regulator to turn on
+
+			// Calibrate ADC.
+			adc.CR &= ~(1 << 30);	// ADCALDIF = 0 (single ended)
+			adc.CR |= 1 << 31;	// Enable ADCAL
+			while(!(adc.CR & (1 << 31)));	// Wait for ADCAL to finish
+
+			SYSCFG.CFGR1 |= c.remap;
+
+			c.dma->reg.C[c.channel].NDTR = n * HALL_SCANS;
+			c.dma->reg.C[c.channel].MAR = (uintptr_t)&buf[a];
+			c.dma->reg.C[c.channel].PAR = (uintptr_t)&adc.DR;
+			c.dma->reg.C[c.channel].CR = 	(1 << 12) |	// Priority medium
+											(1 << 10) |	// MSIZE = 16-bits
+											(1 << 8) | 	// PSIZE = 16-bits
+											(1 << 7) | 	// Memory increment mode enabled
+											(1 << 5) | 	// Circular mode
+											(0 << 4) | 	// Direction: read from peripheral
+											(1 << 0);	// Channel enable
+
+			// Scan the sequence continuously, right aligned into DMA.
+			adc.CFGR = (1 << 13) | (1 << 12) | (1 << 1) | (1 << 0); // CONT, OVRMOD, DMACFG, DMAEN
+
+			volatile uint32_t* sqr[4] = {&adc.SQR1, &adc.SQR2, &adc.SQR3, &adc.SQR4};
+			uint32_t sq[4] = {n - 1, 0, 0, 0};	// L
+			uint32_t smpr[2] = {0, 0};
+			for(uint32_t i = 0; i < n; i++) {
+				uint32_t ch = channels[a][i];
+				uint32_t pos = i + 1;	// SQ1 shares SQR1 with L
+				sq[pos / 5] |= ch << ((pos % 5) * 6);
+				// 601.5 cycles, 8.5 us per key
+				if(ch < 10) {
+					smpr[0] |= 7 << (ch * 3);
+				} else {
+					smpr[1] |= 7 << ((ch - 10) * 3);
+				}
+			}
+			for(uint32_t i = 0; i < 4; i++) {
+				*sqr[i] = sq[i];
+			}
+			adc.SMPR1 = smpr[0];
+			adc.SMPR2 = smpr[1];
+
+			// Enable ADC.
+			adc.CR |= 1 << 0; // ADEN
+			while(!(adc.ISR & (1 << 0))); // ADRDY
+			adc.ISR = (1 << 0); // ADRDY
+
+			// Start conversion.
+			adc.CR |= 1 << 2; // ADSTART
+		}
+
+	public:
+		// channel: bits 0-4 ADC input, bit 7 ADC2 instead of ADC1.
+		// Actuation in 1/256 of full travel, 0 for half way.
+		bool add(uint8_t button, uint8_t channel, uint8_t actuation) {
+			uint8_t a = channel >> 7;
+			if(button >= MAX_BUTTONS || num_channels[a] == HALL_MAX_KEYS) {
+				return false;
+			}
+
+			key_t& k = keys[button];
+			k.adc = a;
+			k.index = num_channels[a];
+			k.actuation = actuation ? actuation : 128;
+			if(k.actuation < HALL_HYSTERESIS * 2) {
+				k.actuation = HALL_HYSTERESIS * 2;
+			}
+			k.active = false;
+			k.pressed = false;
+
+			channels[a][num_channels[a]++] = channel & 0x1f;
+			mask |= 1 << button;
+			return true;
+		}
+
+		// Keys must be at rest, their levels now are taken as fully up.
+		void init(uint8_t rapid_trigger) {
+			rt = rapid_trigger;
+
+			RCC.enable(RCC.ADC12);
+			RCC.enable(RCC.SYSCFG);
+			RCC.enable(RCC.DMA1);
+			RCC.enable(RCC.DMA2);
+
+			for(uint8_t a = 0; a < 2; a++) {
+				if(num_channels[a]) {
+					enable_adc(a);
+				}
+			}
+
+			// Fill the buffers once before taking the rest levels
+			Time::sleep(2);
+
+			for(uint8_t i = 0; i < MAX_BUTTONS; i++) {
+				if(mask & (1 << i)) {
+					keys[i].rest = sum(keys[i]);
+					keys[i].span = HALL_MIN_SPAN;
+				}
+			}
+		}
+
+		uint16_t get_mask() {
+			return mask;
+		}
+
+		// Travel of a key in 1/256, widening its span when it goes further.
+		uint8_t get_travel(uint8_t button) {
+			key_t& k = keys[button];
+			int32_t d = int32_t(sum(k)) - k.rest;
+			uint32_t dist = d < 0 ? -d : d;
+			if(dist > k.span) {
+				k.span = dist;
+			}
+			return dist * 255 / k.span;
+		}
+
+		// 1 = pressed, by button bit.
+		uint16_t read() {
+			for(uint8_t i = 0; i < MAX_BUTTONS; i++) {
+				if(!(mask & (1 << i))) {
+					continue;
+				}
+				key_t& k = keys[i];
+				uint8_t t = get_travel(i);
+
+				if(!k.active) {
+					if(t >= k.actuation) {
+						k.active = true;
+						k.pressed = true;
+						k.extreme = t;
+					}
+				} else if(t + HALL_HYSTERESIS < k.actuation) {
+					k.active = false;
+					k.pressed = false;
+				} else if(!rt) {
+					// Plain threshold
+				} else if(k.pressed) {
+					if(t > k.extreme) {
+						k.extreme = t;
+					} else if(t + rt <= k.extreme) {
+						k.pressed = false;
+						k.extreme = t;
+					}
+				} else {
+					if(t < k.extreme) {
+						k.extreme = t;
+					} else if(t >= k.extreme + rt) {
+						k.pressed = true;
+						k.extreme = t;
+					}
+				}
+
+				if(k.pressed) {
+					state |= 1 << i;
+				} else {
+					state &= ~(1 << i);
+				}
+			}
+			return state;
+		}
+};
+
+Hall_Buttons hall_buttons;
+
+#endif
@@ -5,9 +5,17 @@
 
 #include "config.h"
 #include "configloader.h"
+#include "config_job.h"
+#include "live_config.h"
+#include "config_transfer.h"
 #include "report_desc.h"
 
 #include "button_manager.h"
+#include "usb_sof.h"
+#include "hid_idle.h"
+#include "profiler.h"
+#include "latency_hist.h"
+#include "axis.h"
 
 #include "rgb/rgb_config.h"
 #include "rgb/ws2812b_spi.h"
@@ -20,10 +28,6 @@
 
 extern bool do_reset_bootloader;
 extern bool do_reset;
-extern Configloader configloader;
-extern Configloader rgb_configloader;
-extern Configloader mapping_configloader;
-extern Configloader device_configloader;
 
 extern config_t config;
 extern rgb_config_t rgb_config;
@@ -31,6 +35,12 @@ extern mapping_config_t mapping_config;
 extern device_config_t device_config;
 
 extern Button_Manager button_manager; 	// In button_manager.h
+extern Usb_Sof usb_sof;	// In usb_sof.h
+extern Hid_Idle joy_idle;
+extern Profiler profiler;	// In profiler.h
+extern Latency_Hist latency_hist;	// In latency_hist.h
+extern IntAxis axis_int;	// In main.cpp
+extern MagAxis axis_mag;	// In main.cpp
 
 #if defined(ROXY)
 extern WS2812B_Spi ws2812b;	// In rgb/ws2812b_spi.h
@@ -48,6 +58,11 @@ class HID_arcin : public USB_HID {
 	private:
 		uint8_t config_id = 0;
 
+		// Reports are packed, the endpoint takes them as words.
+		void write_report(const void* report, uint32_t len) {
+			usb.write(0, (uint32_t*)report, len);
+		}
+
 		bool set_feature_bootloader(bootloader_report_t* report) {
 			switch(report->func) {
 				case 0:
@@ -66,43 +81,40 @@ class HID_arcin : public USB_HID {
 			}
 		}
 		
+		// Applied right away, and saved from the main loop unless flag bit
+		// 0 asks for a preview. Save progress is in report 0xac.
 		bool set_feature_config(config_report_t* report) {
-			if(report->segment == 0) {
-				configloader.write(report->size, report->data);
-			} else if(report->segment == 1) {
-				rgb_configloader.write(report->size, report->data);
-			} else if(report->segment == 2) {
-				mapping_configloader.write(report->size, report->data);
-			} else if(report->segment == 3) {
-				device_configloader.write(report->size, report->data);
-			}
-			else {
+			if(report->size > sizeof(report->data)) {
 				return false;
 			}
-			
-			return true;
+			return live_config.set_segment(report->segment, report->data, report->size, report->flags & (1 << 0));
+		}
+
+		// Segment is the profile to load.
+		bool set_feature_profile(config_report_t* report) {
+			return live_config.select(report->segment);
 		}
 		
 		bool get_feature_config() {
 			if(config_id == 0) {
-				config_report_t report = {0xc0, 0, sizeof(config)};
+				config_report_t report = {0xc0, 0, sizeof(config), 0, {}};
 				memcpy(report.data, &config, sizeof(config));
-				usb.write(0, (uint32_t*)&report, sizeof(report));
+				write_report(&report, sizeof(report));
 				config_id = 1;
 			} else if(config_id == 1) {
-				config_report_t rgb_report = {0xc0, 1, sizeof(rgb_config)};
+				config_report_t rgb_report = {0xc0, 1, sizeof(rgb_config), 0, {}};
 				memcpy(rgb_report.data, &rgb_config, sizeof(rgb_config));
-				usb.write(0, (uint32_t*)&rgb_report, sizeof(rgb_report));
+				write_report(&rgb_report, sizeof(rgb_report));
 				config_id = 2;
 			} else if(config_id == 2) {
-				config_report_t mapping_report = {0xc0, 2, sizeof(mapping_config)};
+				config_report_t mapping_report = {0xc0, 2, sizeof(mapping_config), 0, {}};
 				memcpy(mapping_report.data, &mapping_config, sizeof(mapping_config));
-				usb.write(0, (uint32_t*)&mapping_report, sizeof(mapping_report));
+				write_report(&mapping_report, sizeof(mapping_report));
 				config_id = 3;
 			} else {
-				config_report_t device_report = {0xc0, 3, sizeof(device_config)};
+				config_report_t device_report = {0xc0, 3, sizeof(device_config), 0, {}};
 				memcpy(device_report.data, &device_config, sizeof(device_config));
-				usb.write(0, (uint32_t*)&device_report, sizeof(device_report));
+				write_report(&device_report, sizeof(device_report));
 				config_id = 0;
 			}
 			
@@ -141,14 +153,14 @@ class HID_arcin : public USB_HID {
 			if(len > 60) {
 				len = 60;
 			}
-			config_report_t version_report = {0xa0, 0, len};
+			config_report_t version_report = {0xa0, 0, len, 0, {}};
 			memcpy(version_report.data, VERSION, len);
-			usb.write(0, (uint32_t*)&version_report, sizeof(version_report));
+			write_report(&version_report, sizeof(version_report));
 			return true;
 		}
 
 		bool get_board_version_report() {
-			config_report_t version_report = {0xa4, 0, 0};
+			config_report_t version_report = {0xa4, 0, 0, 0, {}};
 			switch(board_version.board) {
 				case Board_Version::UNDEF:
 					version_report.size = 9;
@@ -163,7 +175,75 @@ class HID_arcin : public USB_HID {
 					memcpy(version_report.data, "Roxy v2.0", version_report.size);
 					break;
 			}
-			usb.write(0, (uint32_t*)&version_report, sizeof(version_report));
+			write_report(&version_report, sizeof(version_report));
+			return true;
+		}
+
+		bool get_sof_report() {
+			sof_stats_t stats = usb_sof.get_stats();
+			config_report_t sof_report = {0xa5, 0, sizeof(stats), 0, {}};
+			memcpy(sof_report.data, &stats, sizeof(stats));
+			write_report(&sof_report, sizeof(sof_report));
+			return true;
+		}
+
+		// One group of phases per read, numbered by the segment field.
+		bool get_profile_report() {
+			prof_stat_t stats[PROF_PER_SEGMENT];
+			uint8_t num;
+			uint8_t segment = profiler.get_stats(stats, num);
+			config_report_t profile_report = {0xa8, segment, uint8_t(num * sizeof(prof_stat_t)), 0, {}};
+			memcpy(profile_report.data, stats, num * sizeof(prof_stat_t));
+			write_report(&profile_report, sizeof(profile_report));
+			return true;
+		}
+
+		// Summary in segment 0, then the buckets.
+		bool get_latency_report() {
+			config_report_t latency_report = {0xa9, 0, 0, 0, {}};
+			latency_report.segment = latency_hist.get_report(latency_report.data, latency_report.size);
+			write_report(&latency_report, sizeof(latency_report));
+			return true;
+		}
+
+		bool get_qe_pair_report() {
+			qe_pair_stats_t stats = axis_int.get_stats();
+			config_report_t qe_report = {0xaa, 0, sizeof(stats), 0, {}};
+			memcpy(qe_report.data, &stats, sizeof(stats));
+			write_report(&qe_report, sizeof(qe_report));
+			return true;
+		}
+
+		bool get_config_save_report() {
+			config_save_stats_t stats = config_job.get_stats();
+			config_report_t save_report = {0xac, 0, sizeof(stats), 0, {}};
+			memcpy(save_report.data, &stats, sizeof(stats));
+			write_report(&save_report, sizeof(save_report));
+			return true;
+		}
+
+		bool get_config_transfer_report() {
+			config_transfer_report_t report;
+			config_transfer.get_report(&report);
+			write_report(&report, sizeof(report));
+			return true;
+		}
+
+		bool get_profile_status_report() {
+			profile_status_t status = live_config.get_status();
+			config_report_t profile_report = {0xc1, 0, sizeof(status), 0, {}};
+			memcpy(profile_report.data, &status, sizeof(status));
+			write_report(&profile_report, sizeof(profile_report));
+			return true;
+		}
+
+		bool get_mag_report() {
+			mag_stats_t stats = axis_mag.get_stats();
+			stats.sampler_off = button_sampler.is_short_of_slots();
+			stats.sampler_overruns = button_manager.get_overruns();
+			config_report_t mag_report = {0xab, 0, sizeof(stats), 0, {}};
+			memcpy(mag_report.data, &stats, sizeof(stats));
+			write_report(&mag_report, sizeof(mag_report));
 			return true;
 		}
 	
@@ -171,6 +251,22 @@ class HID_arcin : public USB_HID {
 		HID_arcin(USB_generic& usbd, desc_t rdesc) : USB_HID(usbd, rdesc, 0, 1, 64) {}
 	
 	protected:
+		virtual SetupStatus handle_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(wIndex == interface) {
+				SetupStatus res = joy_idle.handle_setup(usb, bmRequestType, bRequest, wValue);
+				if(res != SetupStatus::Unhandled) {
+					return res;
+				}
+			}
+
+			return USB_HID::handle_setup(bmRequestType, bRequest, wValue, wIndex, wLength);
+		}
+
+		virtual void handle_set_configuration(uint8_t configuration) {
+			joy_idle.reset();
+			USB_HID::handle_set_configuration(configuration);
+		}
+
 		virtual bool set_output_report(uint32_t* buf, uint32_t len) {
 			if(len != sizeof(output_report_t)) {
 				return false;
@@ -227,6 +323,20 @@ class HID_arcin : public USB_HID {
 					
 					return set_feature_config((config_report_t*)buf);
 				
+				case 0xc1:
+					if(len != sizeof(config_report_t)) {
+						return false;
+					}
+					
+					return set_feature_profile((config_report_t*)buf);
+				
+				case 0xc2:
+					if(len != sizeof(config_transfer_report_t)) {
+						return false;
+					}
+					
+					return config_transfer.set_report((config_transfer_report_t*)buf);
+				
 				case 0xd0:
 					if(len != sizeof(device_report_t)) {
 						return false;
@@ -234,6 +344,47 @@ class HID_arcin : public USB_HID {
 
 					return set_feature_command((device_report_t*)buf);
 
+				case 0xa8:	// Any write clears the profile
+					if(len != sizeof(config_report_t)) {
+						return false;
+					}
+
+					profiler.reset();
+					return true;
+
+				case 0xa9:	// Any write clears the histogram
+					if(len != sizeof(config_report_t)) {
+						return false;
+					}
+
+					latency_hist.reset();
+					return true;
+
+				case 0xaa:	// Any write clears the counters
+					if(len != sizeof(config_report_t)) {
+						return false;
+					}
+
+					axis_int.reset_stats();
+					return true;
+
+				case 0xab:	// Any write clears the counters
+					if(len != sizeof(config_report_t)) {
+						return false;
+					}
+
+					axis_mag.reset_stats();
+					button_manager.reset_overruns();
+					return true;
+
+				case 0xac:	// Any write clears the counters
+					if(len != sizeof(config_report_t)) {
+						return false;
+					}
+
+					config_job.reset_stats();
+					return true;
+
 				default:
 					return false;
 			}
@@ -244,12 +395,36 @@ class HID_arcin : public USB_HID {
 				case 0xc0:
 					return get_feature_config();
 
+				case 0xc1:
+					return get_profile_status_report();
+
+				case 0xc2:
+					return get_config_transfer_report();
+
 				case 0xa0:
 					return get_fw_version_report();
 
 				case 0xa4:
 					return get_board_version_report();
 
+				case 0xa5:
+					return get_sof_report();
+
+				case 0xa8:
+					return get_profile_report();
+
+				case 0xa9:
+					return get_latency_report();
+
+				case 0xaa:
+					return get_qe_pair_report();
+
+				case 0xab:
+					return get_mag_report();
+
+				case 0xac:
+					return get_config_save_report();
+
 				default:
 					return false;
 			}
@@ -0,0 +1,83 @@
+#ifndef HID_IDLE_H
+#define HID_IDLE_H
+
+#include <usb/usb.h>
+#include <os/time.h>
+#include <string.h>
+#include <stdint.h>
+
+#define HID_IDLE_MAX_REPORT	32
+
+// Report-on-change for an interrupt IN endpoint with HID idle rate handling.
+// A report is only sent when it differs from the last one sent, or when the
+// idle period has passed since then. An idle rate of 0 never repeats.
+class Hid_Idle {
+	private:
+		uint8_t last[HID_IDLE_MAX_REPORT];
+		bool valid = false;
+		uint8_t rate;			// 4 ms units
+		uint8_t default_rate;
+		uint32_t last_time;
+
+	public:
+		Hid_Idle(uint8_t r) : rate(r), default_rate(r) {}
+
+		void reset() {
+			rate = default_rate;
+			valid = false;
+		}
+
+		// True if the report should be sent, in which case it is recorded as sent.
+		bool due(const void* report, uint32_t len) {
+			if(len > HID_IDLE_MAX_REPORT) {
+				return true;
+			}
+
+			uint32_t now = Time::time();
+
+			if(valid && !memcmp(last, report, len) && (!rate || now - last_time < rate * 4u)) {
+				return false;
+			}
+
+			memcpy(last, report, len);
+			valid = true;
+			last_time = now;
+			return true;
+		}
+
+		// For a report about to replace the last one before it was sent. The
+		// idle period keeps running from the original.
+		bool differs(const void* report, uint32_t len) {
+			return len > HID_IDLE_MAX_REPORT || !valid || memcmp(last, report, len);
+		}
+
+		void replace(const void* report, uint32_t len) {
+			if(len <= HID_IDLE_MAX_REPORT) {
+				memcpy(last, report, len);
+			}
+		}
+
+		// SET_IDLE and GET_IDLE. Every interface has a single input report,
+		// so the report ID is ignored.
+		SetupStatus handle_setup(USB_generic& usb, uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue) {
+			// Set idle.
+			if(bmRequestType == 0x21 && bRequest == 0x0a) {
+				rate = wValue >> 8;
+				// Restart the idle period from now.
+				last_time = Time::time();
+				usb.write(0, nullptr, 0);
+				return SetupStatus::Ok;
+			}
+
+			// Get idle.
+			if(bmRequestType == 0xa1 && bRequest == 0x02) {
+				uint32_t buf = rate;
+				usb.write(0, &buf, 1);
+				return SetupStatus::Ok;
+			}
+
+			return SetupStatus::Unhandled;
+		}
+};
+
+#endif
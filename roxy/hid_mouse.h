@@ -0,0 +1,115 @@
+#ifndef HID_MOUSE_H
+#define HID_MOUSE_H
+
+#include <usb/usb.h>
+#include <usb/hid.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "report_desc.h"
+#include "hid_idle.h"
+
+extern config_t config;
+
+// Relative mouse on interface 2, moved by the unwrapped axis positions at
+// full encoder resolution. Each axis drives X, Y or the wheel (config
+// mouse_axes). The wheel moves a detent per MOUSE_WHEEL_MULTIPLIER counts,
+// or a high resolution step per count once the host sets the resolution
+// multiplier.
+//
+// Movement the report can't carry is held back for the next one, so no
+// counts are lost while the endpoint is busy.
+class HID_mouse : public USB_HID {
+	private:
+		Hid_Idle idle;				// Only for SET_IDLE and GET_IDLE, reports are sent on movement
+		uint8_t multiplier = 0;		// Resolution multiplier feature, 0 or 1
+		uint8_t target[2] = {0, 0};	// 0: X, 1: Y, 2: Wheel, 3: None
+		int32_t sent[2];			// Positions reported so far
+		bool enabled = false;
+
+	public:
+		HID_mouse(USB_generic& usbd, desc_t rdesc) : USB_HID(usbd, rdesc, 2, 3, 64), idle(0) {}
+
+		void init(int32_t pos0, int32_t pos1) {
+			for(uint8_t i = 0; i < 2; i++) {
+				uint8_t m = (config.mouse_axes >> (i * 4)) & 0xf;
+				target[i] = m ? m - 1 : i;
+			}
+			sent[0] = pos0;
+			sent[1] = pos1;
+			enabled = true;
+		}
+
+		// Sends the movement since the last report, if there is any and the
+		// endpoint is free.
+		void update(int32_t pos0, int32_t pos1) {
+			if(!enabled || !usb.ep_ready(3)) {
+				return;
+			}
+
+			int32_t pos[2] = {pos0, pos1};
+			int32_t move[3] = {0, 0, 0};
+			for(uint8_t i = 0; i < 2; i++) {
+				int32_t delta = pos[i] - sent[i];
+				if(target[i] == 2) {
+					int32_t div = multiplier ? 1 : MOUSE_WHEEL_MULTIPLIER;
+					int32_t steps = delta / div;
+					steps = steps > 127 ? 127 : steps < -127 ? -127 : steps;
+					move[2] += steps;
+					sent[i] += steps * div;
+				} else if(target[i] < 2) {
+					delta = delta > 32767 ? 32767 : delta < -32767 ? -32767 : delta;
+					move[target[i]] += delta;
+					sent[i] += delta;
+				}
+			}
+
+			if(!move[0] && !move[1] && !move[2]) {
+				return;
+			}
+
+			mouse_report_t report = {
+				int16_t(move[0] > 32767 ? 32767 : move[0] < -32767 ? -32767 : move[0]),
+				int16_t(move[1] > 32767 ? 32767 : move[1] < -32767 ? -32767 : move[1]),
+				int8_t(move[2] > 127 ? 127 : move[2] < -127 ? -127 : move[2]),
+			};
+			const void* data = &report;
+			usb.write(3, (uint32_t*)data, sizeof(report));
+		}
+
+	protected:
+		virtual SetupStatus handle_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(wIndex == interface) {
+				SetupStatus res = idle.handle_setup(usb, bmRequestType, bRequest, wValue);
+				if(res != SetupStatus::Unhandled) {
+					return res;
+				}
+			}
+
+			return USB_HID::handle_setup(bmRequestType, bRequest, wValue, wIndex, wLength);
+		}
+
+		virtual void handle_set_configuration(uint8_t configuration) {
+			idle.reset();
+			multiplier = 0;
+			USB_HID::handle_set_configuration(configuration);
+		}
+
+		// The only feature report is the resolution multiplier.
+		virtual bool set_feature_report(uint32_t* buf, uint32_t len) {
+			if(len != 1) {
+				return false;
+			}
+
+			multiplier = *buf & 1;
+			return true;
+		}
+
+		virtual bool get_feature_report(uint8_t) {
+			uint32_t buf = multiplier;
+			usb.write(0, &buf, 1);
+			return true;
+		}
+};
+
+#endif
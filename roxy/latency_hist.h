@@ -0,0 +1,199 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <string.h>
+#include <stdint.h>
+
+#include "us_clock.h"
+
+#define LATENCY_BUCKETS		32
+#define LATENCY_PER_SEGMENT	15		// Buckets per feature report
+
+struct latency_summary_t {
+	uint32_t count;
+	uint32_t min;			// us
+	uint32_t max;
+	uint32_t avg;
+} __attribute__((packed));
+
+// Time from a debounced button edge or axis direction change until the
+// joystick report carrying it has been collected by the host, on the
+// microsecond clock.
+//
+// Buckets are half octaves: 0-3 us one each, then [4, 6), [6, 8), [8, 12)
+// and so on up to bucket 31, which holds everything from 49152 us.
+class Latency_Hist {
+	private:
+		uint32_t press_time[16];
+		uint32_t release_time[16];
+		uint32_t axis_time[2];
+		uint8_t axis_pending = 0;
+		int8_t last_dir[2] = {0, 0};
+		uint16_t current = 0;
+
+		// Report on the endpoint, and the last one the host collected
+		bool in_flight = false;
+		uint16_t flight_buttons;
+		uint8_t flight_axis[2];
+		uint16_t done_buttons = 0;
+		uint8_t done_axis[2] = {0, 0};
+
+		uint32_t count;
+		uint32_t min;
+		uint32_t max;
+		uint64_t sum;
+		uint32_t buckets[LATENCY_BUCKETS];
+
+		uint8_t segment = 0;
+		bool enabled = false;
+
+		static uint8_t bucket(uint32_t us) {
+			if(us < 4) {
+				return us;
+			}
+			uint8_t msb = 31 - __builtin_clz(us);
+			uint8_t b = 2 * msb + ((us >> (msb - 1)) & 1);
+			return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+		}
+
+		void add(uint32_t us) {
+			count++;
+			sum += us;
+			if(us < min) {
+				min = us;
+			}
+			if(us > max) {
+				max = us;
+			}
+			buckets[bucket(us)]++;
+		}
+
+	public:
+		void init() {
+			reset();
+			enabled = true;
+		}
+
+		bool is_enabled() {
+			return enabled;
+		}
+
+		void reset() {
+			count = 0;
+			min = UINT32_MAX;
+			max = 0;
+			sum = 0;
+			for(uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+				buckets[i] = 0;
+			}
+			segment = 0;
+		}
+
+		// Stamps the edges in the button state, plus any the caller saw in between.
+		void update_buttons(uint16_t buttons, uint16_t pressed, uint16_t released) {
+			if(!enabled) {
+				return;
+			}
+
+			pressed |= buttons & ~current;
+			released |= ~buttons & current;
+			current = buttons;
+
+			if(!(pressed | released)) {
+				return;
+			}
+
+			uint32_t now = us_clock.now();
+			for(uint8_t i = 0; i < 16; i++) {
+				if(pressed & (1 << i)) {
+					press_time[i] = now;
+				}
+				if(released & (1 << i)) {
+					release_time[i] = now;
+				}
+			}
+		}
+
+		// Stamps a change of direction, including coming to a stop.
+		void update_axis(uint8_t i, int8_t dir) {
+			if(!enabled || dir == last_dir[i]) {
+				return;
+			}
+			last_dir[i] = dir;
+
+			// A stop shows up in no report, so it only ends the wait.
+			if(dir) {
+				axis_time[i] = us_clock.now();
+				axis_pending |= 1 << i;
+			} else {
+				axis_pending &= ~(1 << i);
+			}
+		}
+
+		// Call whenever a joystick report is written, or replaces the one on the endpoint.
+		void sent(uint16_t buttons, uint8_t x, uint8_t y) {
+			if(!enabled) {
+				return;
+			}
+
+			in_flight = true;
+			flight_buttons = buttons;
+			flight_axis[0] = x;
+			flight_axis[1] = y;
+		}
+
+		// Call every loop with the joystick endpoint state. The report counts
+		// as collected the first time the endpoint is seen free again.
+		void poll(bool ready) {
+			if(!enabled || !in_flight || !ready) {
+				return;
+			}
+			in_flight = false;
+
+			uint32_t now = us_clock.now();
+
+			uint16_t pressed = flight_buttons & ~done_buttons;
+			uint16_t released = ~flight_buttons & done_buttons;
+			for(uint8_t i = 0; i < 16; i++) {
+				if(pressed & (1 << i)) {
+					add(now - press_time[i]);
+				}
+				if(released & (1 << i)) {
+					add(now - release_time[i]);
+				}
+			}
+			done_buttons = flight_buttons;
+
+			for(uint8_t i = 0; i < 2; i++) {
+				if((axis_pending & (1 << i)) && flight_axis[i] != done_axis[i]) {
+					add(now - axis_time[i]);
+					axis_pending &= ~(1 << i);
+				}
+				done_axis[i] = flight_axis[i];
+			}
+		}
+
+		// Segment 0 is a latency_summary_t, the rest hold the buckets in
+		// order. Successive calls go round all of them.
+		uint8_t get_report(uint8_t* data, uint8_t& size) {
+			uint8_t seg = segment;
+
+			if(seg == 0) {
+				latency_summary_t s = {count, count ? min : 0, max, count ? uint32_t(sum / count) : 0};
+				memcpy(data, &s, sizeof(s));
+				size = sizeof(s);
+			} else {
+				uint8_t first = (seg - 1) * LATENCY_PER_SEGMENT;
+				uint8_t num = LATENCY_BUCKETS - first < LATENCY_PER_SEGMENT ? LATENCY_BUCKETS - first : LATENCY_PER_SEGMENT;
+				memcpy(data, &buckets[first], num * sizeof(uint32_t));
+				size = num * sizeof(uint32_t);
+			}
+
+			segment = seg * LATENCY_PER_SEGMENT < LATENCY_BUCKETS ? seg + 1 : 0;
+			return seg;
+		}
+};
+
+Latency_Hist latency_hist;
+
+#endif
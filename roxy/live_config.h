@@ -0,0 +1,385 @@
+#ifndef LIVE_CONFIG_H
+#define LIVE_CONFIG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "configloader.h"
+#include "config_job.h"
+#include "compiled_config.h"
+#include "board_define.h"
+#include "button_manager.h"
+#include "axis.h"
+
+#include "rgb/rgb_config.h"
+#include "rgb/ws2812b_spi.h"
+#include "rgb/ws2812b_timer.h"
+#include "rgb/tlc59711.h"
+#include "rgb/tlc5973.h"
+#include "rgb/led_breathing.h"
+#include "rgb/sdvx_led_strip.h"
+#include "rgb/tt_led.h"
+
+#include "device/device_config.h"
+
+extern config_t config;
+extern rgb_config_t rgb_config;
+extern mapping_config_t mapping_config;
+extern device_config_t device_config;
+
+extern Configloader configloader;	// In main.cpp
+extern Configloader rgb_configloader;
+extern Configloader mapping_configloader;
+extern Configloader device_configloader;
+
+extern Button_Manager button_manager;	// In button_manager.h
+
+#if defined(ROXY)
+extern WS2812B_Spi ws2812b;	// In rgb/ws2812b_spi.h
+#elif defined(ARCIN)
+extern WS2812B_Timer ws2812b;	// In rgb/ws2812b_timer.h
+#endif
+extern TLC59711 tlc59711;	// In rgb/tlc59711.h
+extern TLC5973 tlc5973;	// In rgb/tlc5973.h
+extern Sdvx_Leds sdvx_leds;	// In rgb/sdvx_led_strip.h
+extern Led_Breathing breathing_leds;	// In rgb/led_breathing.h
+extern Turntable_Leds tt_leds;	// In rgb/tt_led.h
+
+struct profile_status_t {
+	uint8_t active;		// Profile in use
+	uint8_t stored;		// Profiles with a saved segment, one bit each
+	uint8_t restart;	// Segments changed in ways that take a reset, one bit each
+	uint8_t preview;	// Segments changed but not saved, one bit each
+} __attribute__((packed));
+
+// Applies config segments while running. Settings the main loop or the
+// drivers can pick up again take effect right away, anything that sets up
+// the hardware or the USB descriptors is saved but only used after a reset;
+// until then the running config keeps the old value and the segment's
+// restart bit is set.
+class Live_Config {
+	private:
+		Axis* axes[2];
+		bool mag;
+		uint8_t profile = 0;
+		uint8_t restart = 0;
+		uint8_t preview = 0;
+
+		template<typename T>
+		static bool differs(const T& a, const T& b) {
+			return memcmp(&a, &b, sizeof(T));
+		}
+
+		// Flags read again every loop or applied below.
+		static const uint32_t live_flags = (1 << 3) | (1 << 4) | (1 << 6) | (1 << 7) | (1 << 11) | (1 << 17);
+
+		// Copies the settings that can change while running.
+		static void take_live(config_t& to, const config_t& from) {
+			to.flags = (to.flags & ~live_flags) | (from.flags & live_flags);
+			to.rgb_brightness = from.rgb_brightness;
+			to.debounce_time = from.debounce_time;
+			to.debounce_time_us = from.debounce_time_us;
+			memcpy(to.debounce_mode, from.debounce_mode, sizeof(to.debounce_mode));
+			to.axis_debounce_time = from.axis_debounce_time;
+			to.axis_sustain_time = from.axis_sustain_time;
+			to.axis_sustain_time_us = from.axis_sustain_time_us;
+			memcpy(to.reduction_ratio, from.reduction_ratio, sizeof(to.reduction_ratio));
+			memcpy(to.deadzone_angle, from.deadzone_angle, sizeof(to.deadzone_angle));
+			to.output_mode = from.output_mode;
+			to.profile_chord = from.profile_chord;
+
+			// Switching between PS2 modes, not turning the port on or off
+			if(to.ps2_mode && from.ps2_mode) {
+				to.ps2_mode = from.ps2_mode;
+			}
+		}
+
+		static void take_live(rgb_config_t& to, const rgb_config_t& from) {
+			uint8_t rgb_mode = to.rgb_mode;
+			to = from;
+
+			// TLC59711 chain length is set up by the mode
+			if(config.rgb_mode == 2) {
+				to.rgb_mode = rgb_mode;
+			}
+		}
+
+		static void take_live(mapping_config_t& to, const mapping_config_t& from) {
+			uint8_t led_type[sizeof(to.button_led_type)];
+			memcpy(led_type, to.button_led_type, sizeof(led_type));
+			to = from;
+			memcpy(to.button_led_type, led_type, sizeof(led_type));
+		}
+
+		static void take_live(device_config_t&, const device_config_t&) {}
+
+		// Overlays data on the running segment, applies what can be and
+		// returns whether anything was left for a reset.
+		template<typename T>
+		bool update(T& running, const void* data, uint8_t len) {
+			T next = running;
+			memcpy(&next, data, len < sizeof(T) ? len : sizeof(T));
+
+			T check = next;
+			take_live(check, running);
+			bool needs_restart = differs(check, running);
+
+			T old = running;
+			take_live(running, next);
+			apply(old);
+
+			return needs_restart;
+		}
+
+		void apply(const config_t& old) {
+			if(old.axis_sustain_time != config.axis_sustain_time ||
+			   old.axis_sustain_time_us != config.axis_sustain_time_us ||
+			   differs(old.reduction_ratio, config.reduction_ratio) ||
+			   differs(old.deadzone_angle, config.deadzone_angle) ||
+			   ((old.flags ^ config.flags) & (1 << 17))) {
+				apply_axes();
+			}
+
+			if((old.flags ^ config.flags) & ((1 << 3) | (1 << 4))) {
+				apply_leds();
+			}
+
+			if(old.debounce_time != config.debounce_time ||
+			   old.debounce_time_us != config.debounce_time_us ||
+			   differs(old.debounce_mode, config.debounce_mode)) {
+				button_manager.reconfigure();
+			}
+
+			if(old.rgb_brightness != config.rgb_brightness) {
+				apply_brightness();
+			}
+		}
+
+		void apply(const rgb_config_t& old) {
+			apply_rgb();
+
+			if(config.rgb_mode == 2 && rgb_config.rgb_mode == 2) {
+				sdvx_leds.set_left_hue(rgb_config.led1_hue);
+				sdvx_leds.set_right_hue(rgb_config.led2_hue);
+			}
+
+			if(differs(old.led_hue, rgb_config.led_hue)) {
+				button_manager.reconfigure();
+			}
+		}
+
+		void apply(const mapping_config_t&) {
+			button_manager.reconfigure();
+		}
+
+		void apply(const device_config_t&) {}
+
+		void apply_leds() {
+			for(int i = 0; i < current_pins->get_num_leds(); i++) {
+				Pin* led = current_pins->get_led(i);
+				if(config.flags & (1 << (3 + i))) {
+					led->on();
+				} else {
+					led->off();
+				}
+			}
+		}
+
+		void apply_brightness() {
+			switch(config.rgb_mode) {
+				case 2:
+					tlc59711.set_brightness(config.rgb_brightness / 2);
+					break;
+
+				case 3:
+					if(!mag) {
+						tlc5973.set_brightness(config.rgb_brightness);
+					}
+					break;
+			}
+
+			if(rgb_config.rgb_mode == 3) {
+				tt_leds.set_brightness(config.rgb_brightness);
+			}
+		}
+
+		void write(uint8_t segment, const void* data, uint8_t len) {
+			bool needs_restart = false;
+			switch(segment) {
+				case 0:
+					needs_restart = update(config, data, len);
+					break;
+
+				case 1:
+					needs_restart = update(rgb_config, data, len);
+					break;
+
+				case 2:
+					needs_restart = update(mapping_config, data, len);
+					break;
+
+				case 3:
+					needs_restart = update(device_config, data, len);
+					break;
+			}
+
+			if(needs_restart) {
+				restart |= 1 << segment;
+			} else {
+				restart &= ~(1 << segment);
+			}
+
+			compiled_config.compile(current_pins->get_num_buttons());
+		}
+
+		template<typename T>
+		void load_segment(uint8_t segment, Configloader& loader, T& running, uint8_t p) {
+			// Segments the profile hasn't saved come from profile 0
+			T next = running;
+			loader.read(sizeof(next), &next);
+			loader.read(sizeof(next), &next, p);
+
+			write(segment, &next, sizeof(next));
+		}
+
+	public:
+		void init(Axis* axis0, Axis* axis1, bool m, uint8_t p) {
+			axes[0] = axis0;
+			axes[1] = axis1;
+			mag = m;
+			profile = p;
+			apply_axes();
+		}
+
+		uint8_t get_profile() {
+			return profile;
+		}
+
+		void apply_axes() {
+			uint32_t sustain_us = config.axis_sustain_time_us ? config.axis_sustain_time_us : config.axis_sustain_time * 1000;
+			for(int i = 0; i < 2; i++) {
+				axes[i]->set_config(sustain_us, config.reduction_ratio[i], config.deadzone_angle[i]);
+				axes[i]->set_edge_start(config.flags & (1 << 14));
+				axes[i]->set_adaptive(config.flags & (1 << 17));
+			}
+		}
+
+		// Software RGB modes, the drivers are set up in main.
+		void apply_rgb() {
+			switch(rgb_config.rgb_mode) {
+				case 1:
+					breathing_leds.set_hue(0, rgb_config.led1_hue);
+					breathing_leds.set_hue(1, rgb_config.led2_hue);
+					break;
+
+				case 3:
+					tt_leds.init(
+						rgb_config.tt_num_leds,
+						(Turntable_Leds::Mode)rgb_config.tt_mode,
+						(Turntable_Leds::SpinType)(rgb_config.tt_spin & 0xF),
+						(Turntable_Leds::SpinDirection)((rgb_config.tt_spin >> 4) & 0xF));
+					if(rgb_config.tt_mode == Turntable_Leds::Solid) {
+						tt_leds.set_solid(rgb_config.tt_hue, rgb_config.tt_sat, rgb_config.tt_val);
+					}
+					tt_leds.set_brightness(config.rgb_brightness);
+					if(config.rgb_mode == 1) {
+						ws2812b.set_num_leds(rgb_config.tt_num_leds);
+					}
+					break;
+			}
+		}
+
+		// Config feature report. A preview is only applied, anything else
+		// is also saved to the active profile.
+		bool set_segment(uint8_t segment, const void* data, uint8_t len, bool is_preview) {
+			if(segment >= CONFIG_SEGMENTS) {
+				return false;
+			}
+
+			if(!is_preview && !config_job.queue(segment, len, data, profile)) {
+				return false;
+			}
+
+			write(segment, data, len);
+
+			if(is_preview) {
+				preview |= 1 << segment;
+			} else {
+				preview &= ~(1 << segment);
+			}
+			return true;
+		}
+
+		// Every segment at once, saved as one unless it's a preview.
+		bool set_segments(const uint8_t* const data[CONFIG_SEGMENTS], const uint8_t len[CONFIG_SEGMENTS], bool is_preview) {
+			if(!is_preview) {
+				for(uint8_t s = 0; s < CONFIG_SEGMENTS; s++) {
+					if(len[s] > CONFIG_SEGMENT_MAX) {
+						return false;
+					}
+				}
+				for(uint8_t s = 0; s < CONFIG_SEGMENTS; s++) {
+					config_job.queue(s, len[s], data[s], profile);
+				}
+				config_job.queue_together((1 << CONFIG_SEGMENTS) - 1);
+			}
+
+			for(uint8_t s = 0; s < CONFIG_SEGMENTS; s++) {
+				write(s, data[s], len[s]);
+			}
+			preview = is_preview ? (1 << CONFIG_SEGMENTS) - 1 : 0;
+			return true;
+		}
+
+		// Loads a saved profile, dropping previews, and starts with it from
+		// now on.
+		bool select(uint8_t p) {
+			if(p >= CONFIG_PROFILES) {
+				return false;
+			}
+
+			load_segment(0, configloader, config, p);
+			load_segment(1, rgb_configloader, rgb_config, p);
+			load_segment(2, mapping_configloader, mapping_config, p);
+			load_segment(3, device_configloader, device_config, p);
+
+			preview = 0;
+			if(p != profile) {
+				profile = p;
+				config_job.queue_profile(p);
+			}
+			return true;
+		}
+
+		// Holding the chord buttons, a press of button 1-4 picks the profile.
+		void poll(uint16_t buttons, uint16_t pressed) {
+			uint16_t chord = config.profile_chord;
+			if(!chord || (buttons & chord) != chord) {
+				return;
+			}
+
+			uint16_t pick = pressed & ~chord & 0xf;
+			if(pick) {
+				select(__builtin_ctz(pick));
+			}
+		}
+
+		profile_status_t get_status() {
+			profile_status_t status = {profile, 0, restart, preview};
+			uint8_t scratch;
+			for(uint8_t p = 0; p < CONFIG_PROFILES; p++) {
+				for(uint8_t s = 0; s < CONFIG_SEGMENTS; s++) {
+					if(config_store.read(s + p * CONFIG_SEGMENTS, 1, &scratch)) {
+						status.stored |= 1 << p;
+						break;
+					}
+				}
+			}
+			return status;
+		}
+};
+
+extern Live_Config live_config;	// In main.cpp
+
+#endif
@@ -10,19 +10,31 @@
 #include <spi/spi.h>
 #include <syscfg/syscfg.h>
 #include <interrupt/exti.h>
+#include <stddef.h>
 
 #include "board_define.h"
 #include "board_version.h"
 #include "report_desc.h"
 #include "usb_strings.h"
 #include "configloader.h"
+#include "config_job.h"
+#include "live_config.h"
+#include "config_transfer.h"
+#include "compiled_config.h"
 #include "config.h"
 #include "button_leds.h"
 #include "button_manager.h"
+#include "button_latch.h"
+#include "ep_restage.h"
 #include "axis.h"
 #include "hid_arcin.h"
+#include "hid_idle.h"
+#include "hid_mouse.h"
 #include "nkro_keyboard.h"
 #include "spi_ps.h"
+#include "usb_sof.h"
+#include "profiler.h"
+#include "latency_hist.h"
 
 #include "rgb/rgb_config.h"
 #include "rgb/ws2812b_timer.h"
@@ -53,10 +65,38 @@ void reset_bootloader() {
 	reset();
 }
 
-Configloader configloader(0x801f800);
-Configloader rgb_configloader(0x8020000);
-Configloader mapping_configloader(0x8020800);
-Configloader device_configloader(0x8021000);
+Flash_Writer flash_writer;
+Config_Store config_store(flash_writer, STORE_BASE, STORE_PAGES);
+
+// Keyed by segment, with the pages each segment had before the store
+Configloader configloader(0, 0x801f800);
+Configloader rgb_configloader(1, 0x8020000);
+Configloader mapping_configloader(2, 0x8020800);
+Configloader device_configloader(3, 0x8021000);
+
+Config_Job config_job(configloader, rgb_configloader, mapping_configloader, device_configloader);
+Live_Config live_config;
+Config_Transfer config_transfer;
+Compiled_Config compiled_config;
+
+// Vector table in RAM, so interrupts with RAMFUNC handlers are taken while
+// a config save keeps the flash busy. 16 + 82 vectors, aligned to the next
+// power of two.
+static const uint32_t* firmware_vectors = (uint32_t*)0x8002000;
+uint32_t ram_vectors[98] __attribute__((aligned(512)));
+
+// Interrupts with RAMFUNC handlers. A handler in flash taken while the
+// flash is busy stalls on its first fetch, and holds off everything of the
+// same or lower priority until the operation is done. These run a level
+// above everything else, SysTick included, so they preempt it.
+extern const Interrupt::IRQ ram_irqs[] = {
+	Interrupt::TIM1_BRK_TIM15,	// Microsecond clock
+	Interrupt::TIM2, Interrupt::TIM3, Interrupt::EXTI1, Interrupt::EXTI9_5,
+	Interrupt::DMA1_Channel2,	// Magnetic sensor
+	Interrupt::DMA2_Channel4,	// Button sampler wraps
+	Interrupt::SPI2,			// PS controller
+};
+extern const uint32_t num_ram_irqs = sizeof(ram_irqs) / sizeof(ram_irqs[0]);
 
 config_t config;
 rgb_config_t rgb_config;
@@ -81,10 +121,66 @@ auto conf_desc = configuration_desc(2, 1, 0, 0xc0, 0,
 	)
 );
 
+// Same, with the high resolution joystick report
+auto hires_conf_desc = configuration_desc(2, 1, 0, 0xc0, 0,
+	// HID interface.
+	interface_desc(0, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(hires_report_desc)),
+		endpoint_desc(0x81, 0x03, 16, 1)
+	),
+	// Keyboard interface
+	interface_desc(1, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(keyboard_report_desc)),
+		endpoint_desc(0x82, 0x03, 32, 1)
+	)
+);
+
+// Both again with the mouse interface (Flag bit 16), so hosts only see it when it's used
+auto mouse_conf_desc = configuration_desc(3, 1, 0, 0xc0, 0,
+	// HID interface.
+	interface_desc(0, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(report_desc)),
+		endpoint_desc(0x81, 0x03, 16, 1)
+	),
+	// Keyboard interface
+	interface_desc(1, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(keyboard_report_desc)),
+		endpoint_desc(0x82, 0x03, 32, 1)
+	),
+	// Mouse interface
+	interface_desc(2, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(mouse_report_desc)),
+		endpoint_desc(0x83, 0x03, 8, 1)
+	)
+);
+
+auto hires_mouse_conf_desc = configuration_desc(3, 1, 0, 0xc0, 0,
+	// HID interface.
+	interface_desc(0, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(hires_report_desc)),
+		endpoint_desc(0x81, 0x03, 16, 1)
+	),
+	// Keyboard interface
+	interface_desc(1, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(keyboard_report_desc)),
+		endpoint_desc(0x82, 0x03, 32, 1)
+	),
+	// Mouse interface
+	interface_desc(2, 0, 1, 0x03, 0x00, 0x00, 0,
+		hid_desc(0x111, 0, 1, 0x22, sizeof(mouse_report_desc)),
+		endpoint_desc(0x83, 0x03, 8, 1)
+	)
+);
+
 desc_t dev_desc_p = {sizeof(dev_desc), (void*)&dev_desc};
 desc_t conf_desc_p = {sizeof(conf_desc), (void*)&conf_desc};
+desc_t hires_conf_desc_p = {sizeof(hires_conf_desc), (void*)&hires_conf_desc};
+desc_t mouse_conf_desc_p = {sizeof(mouse_conf_desc), (void*)&mouse_conf_desc};
+desc_t hires_mouse_conf_desc_p = {sizeof(hires_mouse_conf_desc), (void*)&hires_mouse_conf_desc};
 desc_t report_desc_p = {sizeof(report_desc), (void*)&report_desc};
+desc_t hires_report_desc_p = {sizeof(hires_report_desc), (void*)&hires_report_desc};
 desc_t keyboard_desc_p = {sizeof(keyboard_report_desc), (void*)&keyboard_report_desc};
+desc_t mouse_desc_p = {sizeof(mouse_report_desc), (void*)&mouse_report_desc};
 
 auto iidx_dev_desc = device_desc(0x200, 0, 0, 0, 64, 0x1ccf, 0x8048, 0x100, 1, 2, 3, 1);
 auto konami_conf_desc = configuration_desc(1, 1, 0, 0xc0, 0,
@@ -111,9 +207,17 @@ extern Roxy_v20_Pins roxy_v20_pins;
 extern Button_Leds button_led_manager;	// In button_leds.h
 Button_Manager button_manager; 	// In button_manager.h
 
+// Short presses are held until each consumer has sent them
+Button_Latch joy_latch;
+Button_Latch kb_latch;
+Button_Latch ps_latch;
+
 extern Board_Version board_version;	// In board_version.h
 
 USB_f1 roxy_usb(USB, dev_desc_p, conf_desc_p);
+USB_f1 hires_usb(USB, dev_desc_p, hires_conf_desc_p);
+USB_f1 mouse_usb(USB, dev_desc_p, mouse_conf_desc_p);
+USB_f1 hires_mouse_usb(USB, dev_desc_p, hires_mouse_conf_desc_p);
 USB_f1 iidx_usb(USB, iidx_dev_desc_p, konami_conf_desc_p);
 USB_f1 sdvx_usb(USB, sdvx_dev_desc_p, konami_conf_desc_p);
 
@@ -123,7 +227,9 @@ WS2812B_Spi ws2812b;	// In rgb/ws2812b_spi.h
 WS2812B_Timer ws2812b;	// In rgb/ws2812b_timer.h
 template <>
 void interrupt<Interrupt::DMA1_Channel7>() {
+	uint32_t prof = profiler.start();
 	ws2812b.irq();
+	profiler.stop(PROF_DMA, prof);
 }
 #endif
 
@@ -137,6 +243,13 @@ Turntable_Leds tt_leds;	// In rgb/tt_led.h
 
 uint32_t last_led_time;
 
+Us_Clock us_clock;	// In us_clock.h
+
+template<>
+RAMFUNC void interrupt<Interrupt::TIM1_BRK_TIM15>() {
+	us_clock.irq();
+}
+
 // Other vendor devices
 SVRE9LED svre9leds;		// In devices/svre9led.h
 Turbocharger tcleds;	// In devices/turbocharger.h
@@ -144,70 +257,217 @@ Turbocharger tcleds;	// In devices/turbocharger.h
 #if defined(ROXY)
 template <>
 void interrupt<Interrupt::DMA2_Channel2>() {
+	uint32_t prof = profiler.start();
 	ws2812b.irq();
 	tcleds.irq();
 	tlc59711.irq();
 	tlc5973.irq(Interrupt::DMA2_Channel2);
+	profiler.stop(PROF_DMA, prof);
 }
 #elif defined(ARCIN)
 template <>
 void interrupt<Interrupt::DMA2_Channel2>() {
+	uint32_t prof = profiler.start();
 	tcleds.irq();
 	tlc59711.irq();
 	tlc5973.irq(Interrupt::DMA2_Channel2);
+	profiler.stop(PROF_DMA, prof);
 }
 #endif
 
 template<>
 void interrupt<Interrupt::DMA1_Channel3>() {
+	uint32_t prof = profiler.start();
 	tlc5973.irq(Interrupt::DMA1_Channel3);
+	profiler.stop(PROF_DMA, prof);
 }
 
+// Reports are only sent on change or when the idle rate runs out, which
+// defaults to never for the joystick and 500 ms for the keyboard.
+Hid_Idle joy_idle(0);
+Hid_Idle kb_idle(125);
+
 class HID_keyboard : public USB_HID {
 	public:
 		HID_keyboard(USB_generic& usbd, desc_t rdesc) : USB_HID(usbd, rdesc, 1, 2, 64) {}
+
+	protected:
+		virtual SetupStatus handle_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(wIndex == interface) {
+				SetupStatus res = kb_idle.handle_setup(usb, bmRequestType, bRequest, wValue);
+				if(res != SetupStatus::Unhandled) {
+					return res;
+				}
+			}
+
+			return USB_HID::handle_setup(bmRequestType, bRequest, wValue, wIndex, wLength);
+		}
+
+		virtual void handle_set_configuration(uint8_t configuration) {
+			kb_idle.reset();
+			USB_HID::handle_set_configuration(configuration);
+		}
 };
 
 HID_arcin usb_roxy_hid(roxy_usb, report_desc_p);
+HID_arcin usb_hires_hid(hires_usb, hires_report_desc_p);
+HID_arcin usb_mouse_hid(mouse_usb, report_desc_p);
+HID_arcin usb_hires_mouse_hid(hires_mouse_usb, hires_report_desc_p);
 HID_arcin usb_iidx_hid(iidx_usb, report_desc_p);
 HID_arcin usb_sdvx_hid(sdvx_usb, report_desc_p);
 
 USB_strings usb_roxy_strings(roxy_usb, config.label, 0);
+USB_strings usb_hires_strings(hires_usb, config.label, 0);
+USB_strings usb_mouse_strings(mouse_usb, config.label, 0);
+USB_strings usb_hires_mouse_strings(hires_mouse_usb, config.label, 0);
 USB_strings usb_iidx_strings(iidx_usb, config.label, 1);
 USB_strings usb_sdvx_strings(sdvx_usb, config.label, 2);
 
 HID_keyboard usb_keyboard(roxy_usb, keyboard_desc_p);
+HID_keyboard usb_hires_keyboard(hires_usb, keyboard_desc_p);
+HID_keyboard usb_mouse_keyboard(mouse_usb, keyboard_desc_p);
+HID_keyboard usb_hires_mouse_keyboard(hires_mouse_usb, keyboard_desc_p);
+
+HID_mouse usb_mouse(mouse_usb, mouse_desc_p);
+HID_mouse usb_hires_mouse(hires_mouse_usb, mouse_desc_p);
 
 NullAxis null_axis;
 
-QEAxis axis_qe1(TIM2);
-QEAxis axis_qe2(TIM3);
+QEAxis axis_qe1(TIM2, Interrupt::TIM2);
+QEAxis axis_qe2(TIM3, Interrupt::TIM3);
+
+template<>
+RAMFUNC void interrupt<Interrupt::TIM2>() {
+	uint32_t prof = profiler.start();
+	axis_qe1.irq();
+	profiler.stop(PROF_EXTI, prof);
+}
+
+template<>
+RAMFUNC void interrupt<Interrupt::TIM3>() {
+	uint32_t prof = profiler.start();
+	axis_qe2.irq();
+	profiler.stop(PROF_EXTI, prof);
+}
 
 IntAxis axis_int;
 
 template<>
-void interrupt<Interrupt::EXTI1>() {
+RAMFUNC void interrupt<Interrupt::EXTI1>() {
+	uint32_t prof = profiler.start();
 	if(EXTI.PR1 & (1 << 1)) {
 		EXTI.PR1 |= (1 << 1);	// Clear flag
 		axis_int.updateEncoder();
 	}
+	profiler.stop(PROF_EXTI, prof);
 }
 
 template<>
-void interrupt<Interrupt::EXTI9_5>() {
+RAMFUNC void interrupt<Interrupt::EXTI9_5>() {
+	uint32_t prof = profiler.start();
 	if(EXTI.PR1 & (1 << 7)) {
 		EXTI.PR1 |= (1 << 7);	// Clear flag
 		axis_int.updateEncoder();
 	}
+	profiler.stop(PROF_EXTI, prof);
 }
 
-AnalogAxis axis_ana1(ADC1, 2);
-AnalogAxis axis_ana2(ADC2, 4);
+AnalogAxis axis_ana1(ADC1, 2, DMA1, 0, 0);			// DMA1 channel 1
+AnalogAxis axis_ana2(ADC2, 4, DMA2, 2, 1 << 8);		// DMA2 channel 3 (ADC24_DMA_RMP)
+
+MagAxis axis_mag;	// SPI1, TIM4, DMA1 channels 2 and 4
+
+template<>
+RAMFUNC void interrupt<Interrupt::DMA1_Channel2>() {
+	uint32_t prof = profiler.start();
+	axis_mag.irq();
+	profiler.stop(PROF_EXTI, prof);
+}
 
 extern NKRO_Keyboard nkro;	// In "nkro_keyboard.h"
 
+// LED outputs, picked by Compiled_Config
+void breathing_none(int8_t, int8_t) {}
+
+void breathing_only(int8_t state0, int8_t state1) {
+	breathing_leds.update(state0, state1);
+}
+
+void breathing_tlc59711(int8_t state0, int8_t state1) {
+	if(breathing_leds.update(state0, state1)) {
+		CRGB temp1 = breathing_leds.get_led(0);
+		CRGB temp2 = breathing_leds.get_led(1);
+		tlc59711.set_led_8bit(3, temp1.r, temp1.g, temp1.b);
+		tlc59711.set_led_8bit(2, temp2.r, temp2.g, temp2.b);
+		tlc59711.schedule_dma();
+	}
+}
+
+void breathing_tlc5973(int8_t state0, int8_t state1) {
+	if(breathing_leds.update(state0, state1)) {
+		CRGB temp1 = breathing_leds.get_led(0);
+		CRGB temp2 = breathing_leds.get_led(1);
+		tlc5973.set_led_8bit(0, temp1.r, temp1.g, temp1.b);
+		tlc5973.set_led_8bit(1, temp2.r, temp2.g, temp2.b);
+		tlc5973.schedule_dma();
+	}
+}
+
+void tt_none() {}
+
+void tt_only() {
+	tt_leds.update();
+}
+
+void tt_ws2812b() {
+	if(tt_leds.update()) {
+		CRGB* leds = tt_leds.get_leds();
+		uint8_t num_leds = tt_leds.get_num_leds();
+		for(uint8_t i = 0; i < num_leds; i++) {
+			ws2812b.set_led(i, leds[i].r, leds[i].g, leds[i].b, i == (num_leds - 1));
+		}
+	}
+}
+
+void sdvx_none() {}
+
+void sdvx_turbocharger() {
+	if(sdvx_leds.update()) {
+		for(uint8_t i = 0; i < sdvx_leds.get_num_leds(); i++) {
+			tcleds.set_left_led(i, sdvx_leds.get_left_brightness(i));
+			tcleds.set_right_led(i, sdvx_leds.get_right_brightness(i));
+		}
+		tcleds.schedule_dma();
+	}
+}
+
+void sdvx_tlc59711() {
+	if(sdvx_leds.update()) {
+		for( int i = 0; i < sdvx_leds.get_num_leds(); i++) {
+			CRGB temp = sdvx_leds.get_led(i);
+			tlc59711.set_led_8bit(i, temp.b, temp.r, temp.g);
+		}
+		tlc59711.schedule_dma();
+	}
+}
+
+int16_t saturate16(int32_t v) {
+	return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+}
+
 int main() {
 	rcc_init();
+
+	memcpy(ram_vectors, firmware_vectors, sizeof(ram_vectors));
+	SCB.VTOR = (uintptr_t)ram_vectors;
+
+	for(uint32_t i = 0; i < sizeof(ram_vectors) / 4 - 16; i++) {
+		Interrupt::set_priority(Interrupt::IRQ(i), 0x10);
+	}
+	SCB.SHPR[11] = 0x10;	// SysTick
+	for(Interrupt::IRQ n : ram_irqs) {
+		Interrupt::set_priority(n, 0);
+	}
 	
 	// Set ADC12PRES to /1
 	RCC.CFGR2 |= (0x10 << 4);
@@ -215,12 +475,28 @@ int main() {
 	// Initialize system timer.
 	STK.LOAD = 72000000 / 8 / 1000; // 1000 Hz.
 	STK.CTRL = 0x03;
+
+	us_clock.init();
 	
 	// Load config.
+	config_store.mount();
 	configloader.read(sizeof(config), &config);
 	rgb_configloader.read(sizeof(rgb_config), &rgb_config);
 	mapping_configloader.read(sizeof(mapping_config), &mapping_config);
 	device_configloader.read(sizeof(device_config), &device_config);
+
+	// Then what the active profile changed
+	uint8_t profile = 0;
+	config_store.read(CONFIG_PROFILE_KEY, 1, &profile);
+	if(profile >= CONFIG_PROFILES) {
+		profile = 0;
+	}
+	if(profile) {
+		configloader.read(sizeof(config), &config, profile);
+		rgb_configloader.read(sizeof(rgb_config), &rgb_config, profile);
+		mapping_configloader.read(sizeof(mapping_config), &mapping_config, profile);
+		device_configloader.read(sizeof(device_config), &device_config, profile);
+	}
 	
 	RCC.enable(RCC.GPIOA);
 	RCC.enable(RCC.GPIOB);
@@ -245,7 +521,11 @@ int main() {
 			usb = &sdvx_usb;
 			break;
 		default:
-			usb = &roxy_usb;
+			if(config.flags & (1 << 16)) {
+				usb = config.flags & (1 << 15) ? &hires_mouse_usb : &mouse_usb;
+			} else {
+				usb = config.flags & (1 << 15) ? &hires_usb : &roxy_usb;
+			}
 			break;
 	}
 
@@ -267,6 +547,13 @@ int main() {
 	}
 #endif
 
+	// The magnetic sensor needs TIM4 and DMA1 channel 4, so the button
+	// sampler must not claim them first. Reported as sampler_off in 0xab.
+	bool mag = (config.flags & (1 << 18)) && board_version.board == Board_Version::V2_0;
+	if(mag && !(config.flags & (1 << 8))) {
+		button_sampler.release_tim4();
+	}
+
 	button_manager.init();	
 	
 	for(int i = 0; i < current_pins->get_num_leds(); i++) {
@@ -278,8 +565,10 @@ int main() {
 		}
 	}
 
-	// Configure QE / Analog
+	// Configure QE / Analog, hall effect buttons take the ADCs from the knobs
 	Axis* axis[2];
+	AnalogAxis* knob[2] = {nullptr, nullptr};	// Analog axes, for their filtered readings
+	bool analog = (config.flags & (1 << 5)) && !hall_buttons.get_mask();
 	if(config.flags & (1 << 8)) {
 		// Setup interrupts on pins PA1 and PA7
 		RCC.enable(RCC.SYSCFG);	// Enable SYSCFG
@@ -293,24 +582,46 @@ int main() {
 		current_pins->qe2b.set_mode(Pin::Input);
 		current_pins->qe1b.set_pull(Pin::PullUp);
 		current_pins->qe2b.set_pull(Pin::PullUp);
-		axis_int.set_pins(current_pins->qe1b, current_pins->qe1b);
+		axis_int.set_pins(current_pins->qe_pair_port, current_pins->qe1b_bit, current_pins->qe2b_bit);
 
-		axis_int.enable(config.flags & (1 << 1), config.qe_sens[0]);
+		axis_int.enable(config.flags & (1 << 1), config.qe_sens[0], config.qe_pair_filter);
 		
 		axis[0] = &axis_int;
 		axis[1] = &null_axis;
 	} else {
-		if(config.flags & (1 << 5)) {
+		if(mag) {
+			spi1_sck.set_af(5);
+			spi1_mosi.set_af(5);
+			spi1_miso.set_af(5);
+			spi1_cs.set_af(2);
+			spi1_sck.set_mode(Pin::AF);
+			spi1_mosi.set_mode(Pin::AF);
+			spi1_miso.set_mode(Pin::AF);
+			spi1_cs.set_mode(Pin::AF);
+			spi1_sck.set_speed(Pin::High);
+			spi1_mosi.set_speed(Pin::High);
+			spi1_miso.set_pull(Pin::PullUp);	// No sensor reads as errors
+			spi1_cs.set_speed(Pin::High);
+
+			axis_mag.enable(config.flags & (1 << 1), config.qe_sens[0]);
+
+			axis[0] = &axis_mag;
+
+		} else if(analog) {
 			RCC.enable(RCC.ADC12);
 			
-			axis_ana1.enable();
+			axis_ana1.enable(config.analog_filter);
 			
 			axis[0] = &axis_ana1;
+			knob[0] = &axis_ana1;
 			
 		} else {
 			RCC.enable(RCC.TIM2);
 			
 			axis_qe1.enable(config.flags & (1 << 1), config.qe_sens[0]);
+			if(config.flags & (1 << 14)) {
+				axis_qe1.enable_capture();
+			}
 			
 			current_pins->qe1a.set_af(1);
 			current_pins->qe1b.set_af(1);
@@ -322,17 +633,21 @@ int main() {
 			axis[0] = &axis_qe1;
 		}
 		
-		if(config.flags & (1 << 5)) {
+		if(analog) {
 			RCC.enable(RCC.ADC12);
 			
-			axis_ana2.enable();
+			axis_ana2.enable(config.analog_filter);
 			
 			axis[1] = &axis_ana2;
+			knob[1] = &axis_ana2;
 			
 		} else {
 			RCC.enable(RCC.TIM3);
 			
 			axis_qe2.enable(config.flags & (1 << 2), config.qe_sens[1]);
+			if(config.flags & (1 << 14)) {
+				axis_qe2.enable_capture();
+			}
 			
 			current_pins->qe2a.set_af(2);
 			current_pins->qe2b.set_af(2);
@@ -344,8 +659,13 @@ int main() {
 			axis[1] = &axis_qe2;
 		}
 	}
-	axis[0]->set_config(config.axis_debounce_time, config.axis_sustain_time, config.reduction_ratio[0], config.deadzone_angle[0]);
-	axis[1]->set_config(config.axis_debounce_time, config.axis_sustain_time, config.reduction_ratio[1], config.deadzone_angle[1]);
+	live_config.init(axis[0], axis[1], mag, profile);
+
+	// Mouse, only on the devices that have the interface
+	HID_mouse* mouse = usb == &hires_mouse_usb ? &usb_hires_mouse : &usb_mouse;
+	if(usb == &mouse_usb || usb == &hires_mouse_usb) {
+		mouse->init(axis[0]->get_position(), axis[1]->get_position());
+	}
 
 	// Initialize Playstation Mode
 	if(config.ps2_mode > 0) {
@@ -353,26 +673,7 @@ int main() {
 	}
 
 	// Initialize RGB modes
-	switch(rgb_config.rgb_mode) {
-		case 1:
-			breathing_leds.set_hue(0, rgb_config.led1_hue);
-			breathing_leds.set_hue(1, rgb_config.led2_hue);
-			break;
-		case 3:
-			tt_leds.init(
-				rgb_config.tt_num_leds, 
-				(Turntable_Leds::Mode)rgb_config.tt_mode, 
-				(Turntable_Leds::SpinType)(rgb_config.tt_spin & 0xF), 
-				(Turntable_Leds::SpinDirection)((rgb_config.tt_spin >> 4) & 0xF));
-			if(rgb_config.tt_mode == Turntable_Leds::Solid) {
-				tt_leds.set_solid(rgb_config.tt_hue, rgb_config.tt_sat, rgb_config.tt_val);
-			}
-			tt_leds.set_brightness(config.rgb_brightness);
-			if(config.rgb_mode == 1) {
-				ws2812b.set_num_leds(rgb_config.tt_num_leds);
-			}
-			break;
-	}
+	live_config.apply_rgb();
 	
 	// Set RGB Interfaces
 	switch(config.rgb_mode) {
@@ -396,8 +697,11 @@ int main() {
 			}
 			break;
 		case 3:
-			tlc5973.init();
-			tlc5973.set_brightness(config.rgb_brightness);
+			// Shares SPI1 with the magnetic encoder on v2.0
+			if(!mag) {
+				tlc5973.init();
+				tlc5973.set_brightness(config.rgb_brightness);
+			}
 			break;
 	}
 
@@ -419,144 +723,179 @@ int main() {
 	
 	// int8_t last_axis_state[2] = {0, 0};
 	// uint32_t qe_count[2] = {0, 0};
-	uint32_t axis_buttons[4] = {(1 << 12), (1 << 13), (1 << 14), (1 << 15)};
+
+	// Flags, modes and key map decoded once, and again on live changes
+	compiled_config.compile(current_pins->get_num_buttons());
+
+	if(config.flags & (1 << 10)) {
+		usb_sof.init(config.sof_lead ? config.sof_lead * 4 : 200);
+	}
+
+	// High resolution reports count input samples, so the host can tell
+	// how many it missed. They change every sample and go out every frame.
+	bool hires = config.flags & (1 << 15);
+	uint16_t sample_seq = 0;
+
+	if(config.flags & (1 << 12)) {
+		profiler.init();
+	}
+
+	if(config.flags & (1 << 13)) {
+		latency_hist.init();
+	}
 
 	while(1) {
+		uint32_t loop_start = profiler.start();
+
+		uint32_t prof = profiler.start();
 		usb->process();
-		uint32_t current_time = Time::time();
-		
-		uint16_t buttons = button_manager.read_buttons();
+		profiler.stop(PROF_USB, prof);
+
+		latency_hist.poll(usb->ep_ready(1));
 		
-		if(do_reset_bootloader) {
+		// Not until saved config is in flash
+		if(do_reset_bootloader && config_job.idle()) {
 			Time::sleep(10);
 			reset_bootloader();
 		}
 		
-		if(do_reset) {
+		if(do_reset && config_job.idle()) {
 			Time::sleep(10);
 			reset();
 		}	
-		
-		for(int i = 0; i < 2; i++) {
-			// Process axis
-			axis[i]->process();
-
-			// Set lights and/or buttons
-			if(axis[i]->dir_state > 0) {
-				sdvx_leds.set_active(i, true);
-				if(i == rgb_config.tt_axis) {
-					tt_leds.set_direction(Turntable_Leds::CW);
-				}
-				if(config.flags & (1 << 6)) {
-					buttons |= axis_buttons[2 * i];
-				}
-			} else if(axis[i]->dir_state < 0) {
-				sdvx_leds.set_active(i, false);
-				if(i == rgb_config.tt_axis) {
-					tt_leds.set_direction(Turntable_Leds::CCW);
-				}
-				if(config.flags & (1 << 6)) {
-					buttons |= axis_buttons[2 * i + 1];
+
+		// Sample inputs and build reports, just ahead of the next frame in SOF sync mode
+		if(usb_sof.due()) {
+			sample_seq++;
+			uint16_t sample_time = us_clock.now();
+
+			prof = profiler.start();
+			uint16_t buttons = button_manager.read_buttons();
+			profiler.stop(PROF_BUTTONS, prof);
+
+			prof = profiler.start();
+			uint16_t axis_dirs = 0;	// Bits 12-15: axis 1 CW, CCW, axis 2 CW, CCW
+			for(int i = 0; i < 2; i++) {
+				// Process axis
+				axis[i]->process();
+				latency_hist.update_axis(i, axis[i]->dir_state);
+
+				// Set lights
+				if(axis[i]->dir_state > 0) {
+					sdvx_leds.set_active(i, true);
+					if(i == rgb_config.tt_axis) {
+						tt_leds.set_direction(Turntable_Leds::CW);
+					}
+					axis_dirs |= 1 << (12 + 2 * i);
+				} else if(axis[i]->dir_state < 0) {
+					sdvx_leds.set_active(i, false);
+					if(i == rgb_config.tt_axis) {
+						tt_leds.set_direction(Turntable_Leds::CCW);
+					}
+					axis_dirs |= 1 << (13 + 2 * i);
 				}
 			}
 
 			// Translate axis to buttons if enabled, or if IIDX PS2 mode is on
-			if(axis[i]->dir_state > 0 && (config.flags & (1 << 6) || config.ps2_mode == 2 || config.ps2_mode == 3)) {
-				buttons |= axis_buttons[2 * i];
-			} else if(axis[i]->dir_state < 0 && (config.flags & (1 << 6) || config.ps2_mode == 2 || config.ps2_mode == 3)) {
-				buttons |= axis_buttons[2 * i + 1];
-			}
-		}
+			buttons |= axis_dirs & compiled_config.axis_buttons;
+			profiler.stop(PROF_AXES, prof);
 		
-		input_report_t report = {1, buttons, uint8_t(axis[0]->count), uint8_t(axis[1]->count)};
-
-		// PS2 (if enabled)
-		if(config.ps2_mode > 0) {
-			spi_ps.set_buttons(buttons);
-		}
-			
-		// Joystick
-		if(usb->ep_ready(1) && (config.output_mode == 0 || config.output_mode == 2)) {
-			usb->write(1, (uint32_t*)&report, sizeof(report));
-		}
-
-		// Keyboard
-		if(usb->ep_ready(2) && (config.output_mode == 1 || config.output_mode == 2)) {
-			for (int i = 0; i < current_pins->get_num_buttons(); i++) {
-				if (buttons & (1 << i) && mapping_config.button_kb_map[i] > 0) {
-					nkro.set_key(mapping_config.button_kb_map[i]);
-				} else {
-					nkro.reset_key(mapping_config.button_kb_map[i]);
+			prof = profiler.start();
+			uint16_t pressed, released;
+			button_manager.get_edges(pressed, released);
+			if(pressed || released || axis_dirs) {
+				config_job.input_changed();
+			}
+			live_config.poll(buttons, pressed);
+			joy_latch.update(buttons, pressed, released);
+			kb_latch.update(buttons, pressed, released);
+			ps_latch.update(buttons, pressed, released);
+			latency_hist.update_buttons(buttons, pressed, released);
+
+			// PS2 (if enabled)
+			if(compiled_config.ps2) {
+				uint16_t sent;
+				if(spi_ps.get_sent(sent)) {
+					ps_latch.commit(sent);
 				}
+				spi_ps.set_buttons(ps_latch.peek());
 			}
-			for (int i = 0; i < 2; i++) {
-				if (axis[i]->dir_state == 1 && mapping_config.axes_kb_map[2 * i] > 0) {
-					nkro.set_key(mapping_config.axes_kb_map[2 * i]);
-				} else {
-					nkro.reset_key(mapping_config.axes_kb_map[2 * i]);
+			
+			// Joystick
+			bool joy_ready = usb->ep_ready(1);
+			if((joy_ready || compiled_config.restage) && compiled_config.joystick) {
+				input_report_t report = {1, joy_ready ? joy_latch.peek() : joy_latch.peek_replace(), uint8_t(axis[0]->count), uint8_t(axis[1]->count)};
+				hires_input_report_t hires_report = {1, report.buttons,
+					int16_t(knob[0] ? knob[0]->value : axis[0]->position),
+					int16_t(knob[1] ? knob[1]->value : axis[1]->position),
+					saturate16(axis[0]->edge_velocity), saturate16(axis[1]->edge_velocity),
+					sample_seq, sample_time};
+				void* data = hires ? (void*)&hires_report : (void*)&report;
+				uint32_t len = hires ? sizeof(hires_report) : sizeof(report);
+				// Sequence and time change every loop, only restage for new input
+				uint32_t input_len = hires ? offsetof(hires_input_report_t, sequence) : sizeof(report);
+				if(joy_ready) {
+					if(joy_idle.due(data, len)) {
+						usb->write(1, (uint32_t*)data, len);
+						joy_latch.commit(report.buttons);
+						latency_hist.sent(report.buttons, report.axis_x, report.axis_y);
+					}
+				} else if(joy_idle.differs(data, input_len) && ep_restage.replace(usb, 1, (uint32_t*)data, len)) {
+					joy_idle.replace(data, len);
+					joy_latch.commit_replace(report.buttons);
+					latency_hist.sent(report.buttons, report.axis_x, report.axis_y);
 				}
-				if (axis[i]->dir_state == -1 && mapping_config.axes_kb_map[2 * i + 1] > 0) {
-					nkro.set_key(mapping_config.axes_kb_map[2 * i + 1]);
-				} else {
-					nkro.reset_key(mapping_config.axes_kb_map[2 * i + 1]);
+			}
+
+			// Mouse
+			mouse->update(axis[0]->position, axis[1]->position);
+			profiler.stop(PROF_REPORTS, prof);
+
+			// Keyboard
+			prof = profiler.start();
+			bool kb_ready = usb->ep_ready(2);
+			if((kb_ready || compiled_config.restage) && compiled_config.keyboard) {
+				uint16_t kb_buttons = kb_ready ? kb_latch.peek() : kb_latch.peek_replace();
+				compiled_config.build_keys(kb_buttons | (uint32_t(axis_dirs) << 4), nkro.get_data());
+				if(kb_ready) {
+					if(kb_idle.due(nkro.get_data(), 32)) {
+						usb->write(2, (uint32_t*)nkro.get_data(), 32);
+						kb_latch.commit(kb_buttons);
+					}
+				} else if(kb_idle.differs(nkro.get_data(), 32) && ep_restage.replace(usb, 2, (uint32_t*)nkro.get_data(), 32)) {
+					kb_idle.replace(nkro.get_data(), 32);
+					kb_latch.commit_replace(kb_buttons);
 				}
 			}
-			usb->write(2, (uint32_t*)nkro.get_data(), 32);
+			profiler.stop(PROF_NKRO, prof);
 		}
 
+		prof = profiler.start();
 		if(Time::time() - last_led_time > 1000) {
 			button_manager.set_leds_reactive();
 
 			// Breathing LEDs
-			if(rgb_config.rgb_mode == 1) {
-				if(breathing_leds.update(axis[0]->dir_state, axis[1]->dir_state)) { 
-					CRGB temp1 = breathing_leds.get_led(0);
-					CRGB temp2 = breathing_leds.get_led(1);
-					if(config.rgb_mode == 2) {
-						tlc59711.set_led_8bit(3, temp1.r, temp1.g, temp1.b);
-						tlc59711.set_led_8bit(2, temp2.r, temp2.g, temp2.b);
-						tlc59711.schedule_dma();
-					} else if(config.rgb_mode == 3) {
-						tlc5973.set_led_8bit(0, temp1.r, temp1.g, temp1.b);
-						tlc5973.set_led_8bit(1, temp2.r, temp2.g, temp2.b);
-						tlc5973.schedule_dma();
-					}
-				}
-			}
+			compiled_config.breathing(axis[0]->dir_state, axis[1]->dir_state);
 		}	
 
+		profiler.stop(PROF_LEDS, prof);
+
 		// TT LEDs
-		if(rgb_config.rgb_mode == 3) {
-			if(tt_leds.update()) {
-				CRGB* leds = tt_leds.get_leds();
-				if(config.rgb_mode == 1) {
-					uint8_t num_leds = tt_leds.get_num_leds();
-					for(uint8_t i = 0; i < num_leds; i++) {
-						ws2812b.set_led(i, leds[i].r, leds[i].g, leds[i].b, i == (num_leds - 1));
-					}
-				}
-			}
-		}
+		prof = profiler.start();
+		compiled_config.tt();
+
+		profiler.stop(PROF_TT_LEDS, prof);
 
 		// SDVX LED strips
-		if(device_config.device_enable & (1 << 1)) {
-			// TC hardware takes precedent if it is enabled
-			if(sdvx_leds.update()) {
-				for(uint8_t i = 0; i < sdvx_leds.get_num_leds(); i++) {
-					tcleds.set_left_led(i, sdvx_leds.get_left_brightness(i));
-					tcleds.set_right_led(i, sdvx_leds.get_right_brightness(i));
-				}
-				tcleds.schedule_dma();
-			}
-		} else if(config.rgb_mode == 2 && rgb_config.rgb_mode == 2) {
-			// TLC59711 mode
-			if(sdvx_leds.update()) {
-				for( int i = 0; i < sdvx_leds.get_num_leds(); i++) {
-					CRGB temp = sdvx_leds.get_led(i);
-					tlc59711.set_led_8bit(i, temp.b, temp.r, temp.g);
-				}
-				tlc59711.schedule_dma();
-			}
-		}
+		prof = profiler.start();
+		compiled_config.sdvx();
+		profiler.stop(PROF_SDVX_LEDS, prof);
+
+		// One flash operation of any config save, after the reports are out
+		prof = profiler.start();
+		config_job.poll();
+		profiler.stop(PROF_FLASH, prof);
+
+		profiler.stop(PROF_LOOP, loop_start);
 	}
 }
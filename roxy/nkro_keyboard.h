@@ -14,24 +14,28 @@ class NKRO_Keyboard {
 			}
 		}
 
-		void reset_key(uint8_t keycode) {
-			uint8_t bit = keycode % 8;
-			uint8_t byte = (keycode / 8) + 1;
+		// Report byte and bit of a key, false if the report hasn't got it.
+		static bool locate(uint8_t keycode, uint8_t& byte, uint8_t& bit) {
+			bit = keycode % 8;
+			byte = (keycode / 8) + 1;
 
 			if(keycode >= 240 && keycode <= 247) {
-				nkro_report[0] &= ~(1 << bit);
-			} else if(byte > 0 && byte <= 31) {
+				byte = 0;
+				return true;
+			}
+			return byte > 0 && byte <= 31;
+		}
+
+		void reset_key(uint8_t keycode) {
+			uint8_t byte, bit;
+			if(locate(keycode, byte, bit)) {
 				nkro_report[byte] &= ~(1 << bit);
 			}
 		}
 
 		void set_key(uint8_t keycode) {
-			uint8_t bit = keycode % 8;
-			uint8_t byte = (keycode / 8) + 1;
-
-			if(keycode >= 240 && keycode <= 247) {
-				nkro_report[0] |= (1 << bit);
-			} else if(byte > 0 && byte <= 31) {
+			uint8_t byte, bit;
+			if(locate(keycode, byte, bit)) {
 				nkro_report[byte] |= (1 << bit);
 			}
 		}
@@ -0,0 +1,121 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+#include "ramfunc.h"
+
+struct Prof_DWT_t {
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+};
+
+#define PROF_DWT	(*(Prof_DWT_t*)0xe0001000)
+#define PROF_DEMCR	(*(volatile uint32_t*)0xe000edfc)
+
+enum Profile_Phase {
+	PROF_LOOP,			// Whole main loop iteration
+	PROF_USB,			// usb->process()
+	PROF_BUTTONS,		// Button_Manager::read_buttons()
+	PROF_AXES,			// Axis::process() and axis buttons
+	PROF_REPORTS,		// Latches, PS2, joystick and mouse reports
+	PROF_NKRO,			// Keyboard report
+	PROF_LEDS,			// Reactive and breathing LEDs
+	PROF_TT_LEDS,		// Turntable LEDs
+	PROF_SDVX_LEDS,		// SDVX LED strips
+	PROF_TIM6,			// Button LED interrupt
+	PROF_DMA,			// DMA interrupts
+	PROF_EXTI,			// Encoder interrupts, EXTI, QE timers and magnetic encoder DMA
+	PROF_SPI2,			// PS2 interrupt
+	PROF_FLASH,			// Config save steps
+	PROF_PHASES,
+};
+
+#define PROF_PER_SEGMENT	3	// Phases per feature report
+
+struct prof_stat_t {
+	uint32_t count;
+	uint32_t min;			// Cycles at 72 MHz
+	uint32_t max;
+	uint32_t avg;
+} __attribute__((packed));
+
+// Cycle counts for the main loop phases and interrupt handlers, taken with
+// the DWT cycle counter. Main loop phases include any interrupts that hit
+// them. Only runs when enabled, otherwise start() and stop() do nothing.
+class Profiler {
+	private:
+		struct phase_t {
+			uint32_t count;
+			uint32_t min;
+			uint32_t max;
+			uint64_t sum;
+		};
+
+		volatile phase_t phases[PROF_PHASES];
+		bool enabled = false;
+		uint8_t segment = 0;
+
+	public:
+		void init() {
+			PROF_DEMCR |= 1 << 24;	// TRCENA
+			PROF_DWT.CYCCNT = 0;
+			PROF_DWT.CTRL |= 1 << 0;	// CYCCNTENA
+			reset();
+			enabled = true;
+		}
+
+		void reset() {
+			for(uint8_t i = 0; i < PROF_PHASES; i++) {
+				phases[i].count = 0;
+				phases[i].min = UINT32_MAX;
+				phases[i].max = 0;
+				phases[i].sum = 0;
+			}
+			segment = 0;
+		}
+
+		RAMINLINE uint32_t start() {
+			return enabled ? PROF_DWT.CYCCNT : 0;
+		}
+
+		RAMINLINE void stop(Profile_Phase phase, uint32_t start) {
+			if(!enabled) {
+				return;
+			}
+
+			uint32_t cycles = PROF_DWT.CYCCNT - start;
+			volatile phase_t& p = phases[phase];
+			p.count++;
+			p.sum += cycles;
+			if(cycles < p.min) {
+				p.min = cycles;
+			}
+			if(cycles > p.max) {
+				p.max = cycles;
+			}
+		}
+
+		// Fills in the next group of phases and returns its segment number.
+		// Successive calls go round all of them.
+		uint8_t get_stats(prof_stat_t* stats, uint8_t& num) {
+			uint8_t seg = segment;
+			uint8_t first = seg * PROF_PER_SEGMENT;
+
+			num = PROF_PHASES - first < PROF_PER_SEGMENT ? PROF_PHASES - first : PROF_PER_SEGMENT;
+			for(uint8_t i = 0; i < num; i++) {
+				volatile phase_t& p = phases[first + i];
+				stats[i].count = p.count;
+				stats[i].min = p.count ? p.min : 0;
+				stats[i].max = p.max;
+				stats[i].avg = p.count ? p.sum / p.count : 0;
+			}
+
+			segment = first + num < PROF_PHASES ? seg + 1 : 0;
+			return seg;
+		}
+};
+
+Profiler profiler;
+
+#endif
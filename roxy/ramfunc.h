@@ -0,0 +1,20 @@
+#ifndef RAMFUNC_H
+#define RAMFUNC_H
+
+// Code that has to keep running while the flash is busy erasing or
+// programming. Any fetch from flash stalls the core until the operation
+// is done, so these go with .data, which the startup code copies to RAM.
+// long_call since RAM is out of branch range from flash.
+//
+// RAMFUNC functions only call other RAMFUNC or RAMINLINE functions, and
+// only read data from RAM.
+#if defined(SIM)
+#define RAMFUNC
+#else
+#define RAMFUNC		__attribute__((section(".data.ramfunc"), long_call, noinline))
+#endif
+
+// Small helpers of RAMFUNC code, inlined into RAM and flash callers alike.
+#define RAMINLINE	inline __attribute__((always_inline))
+
+#endif
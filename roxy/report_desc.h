@@ -3,28 +3,10 @@
 
 #include <usb/hid.h>
 
-auto report_desc = joystick(
-	// Inputs.
-	report_id(1),
-	
-	buttons(16),
-	
-	usage_page(UsagePage::Desktop),
-	usage(DesktopUsage::X),
-	logical_minimum(-128),
-	logical_maximum(127),
-	report_count(1),
-	report_size(8),
-	input(0x02),
+#define MOUSE_WHEEL_MULTIPLIER	16		// Counts per wheel detent, and high resolution steps per detent
 
-	usage_page(UsagePage::Desktop),
-	usage(DesktopUsage::Y),
-	logical_minimum(-128),
-	logical_maximum(127),
-	report_count(1),
-	report_size(8),
-	input(0x02),
-	
+// Outputs and feature reports, shared by the joystick report descriptors.
+auto report_desc_common = pack(
 	// Outputs.
 	report_id(2),
 	logical_minimum(0),
@@ -264,12 +246,50 @@ auto report_desc = joystick(
 	usage(0xc001),
 	feature(0x02), // Config segment size
 	
-	feature(0x01), // Padding
+	usage(0xc002),
+	feature(0x02), // Flags (bit 0: preview, apply without saving)
 	
 	usage(0xc0ff),
 	report_count(60),
 	feature(0x02), // Config data
 
+	// Profile
+	report_id(0xc1),
+
+	usage(0xc100),
+	report_count(1),
+	feature(0x02), // Profile to load
+
+	usage(0xc101),
+	feature(0x02), // Size
+
+	feature(0x01), // Padding
+
+	usage(0xc1ff),
+	report_count(60),
+	feature(0x02), // Status
+
+	// Config transfer
+	report_id(0xc2),
+
+	usage(0xc200),
+	report_count(1),
+	feature(0x02), // Operation
+
+	usage(0xc201),
+	feature(0x02), // Size
+
+	usage(0xc202),
+	feature(0x02), // Flags (bit 0: preview, apply without saving)
+
+	usage(0xc203),
+	report_count(2),
+	feature(0x02), // Offset in the image
+
+	usage(0xc2ff),
+	report_count(58),
+	feature(0x02), // Data
+
 	// Devices
 	report_id(0xd0),
 
@@ -301,9 +321,195 @@ auto report_desc = joystick(
 
 	usage(0xd001),
 	report_count(4),
+	feature(0x02),	// Data
+
+	// USB frame timing
+	report_id(0xa5),
+
+	usage(0xa500),
+	report_count(1),
+	feature(0x02),	// Page
+
+	usage(0xa501),
+	feature(0x02),	// Size
+
+	feature(0x01),	// Padding
+
+	usage(0xa5ff),
+	report_count(60),
+	feature(0x02),	// Data
+
+	// Cycle profile
+	report_id(0xa8),
+
+	usage(0xa800),
+	report_count(1),
+	feature(0x02),	// Segment
+
+	usage(0xa801),
+	feature(0x02),	// Size
+
+	feature(0x01),	// Padding
+
+	usage(0xa8ff),
+	report_count(60),
+	feature(0x02),	// Data
+
+	// Edge to USB latency histogram
+	report_id(0xa9),
+
+	usage(0xa900),
+	report_count(1),
+	feature(0x02),	// Segment
+
+	usage(0xa901),
+	feature(0x02),	// Size
+
+	feature(0x01),	// Padding
+
+	usage(0xa9ff),
+	report_count(60),
+	feature(0x02),	// Data
+
+	// QE pair decoder counters
+	report_id(0xaa),
+
+	usage(0xaa00),
+	report_count(1),
+	feature(0x02),	// Page
+
+	usage(0xaa01),
+	feature(0x02),	// Size
+
+	feature(0x01),	// Padding
+
+	usage(0xaaff),
+	report_count(60),
+	feature(0x02),	// Data
+
+	// Magnetic encoder counters
+	report_id(0xab),
+
+	usage(0xab00),
+	report_count(1),
+	feature(0x02),	// Page
+
+	usage(0xab01),
+	feature(0x02),	// Size
+
+	feature(0x01),	// Padding
+
+	usage(0xabff),
+	report_count(60),
+	feature(0x02),	// Data
+
+	// Config save progress
+	report_id(0xac),
+
+	usage(0xac00),
+	report_count(1),
+	feature(0x02),	// Page
+
+	usage(0xac01),
+	feature(0x02),	// Size
+
+	feature(0x01),	// Padding
+
+	usage(0xacff),
+	report_count(60),
 	feature(0x02)	// Data
 );
 
+auto report_desc = joystick(
+	// Inputs.
+	report_id(1),
+	
+	buttons(16),
+	
+	usage_page(UsagePage::Desktop),
+	usage(DesktopUsage::X),
+	logical_minimum(-128),
+	logical_maximum(127),
+	report_count(1),
+	report_size(8),
+	input(0x02),
+
+	usage_page(UsagePage::Desktop),
+	usage(DesktopUsage::Y),
+	logical_minimum(-128),
+	logical_maximum(127),
+	report_count(1),
+	report_size(8),
+	input(0x02),
+
+	report_desc_common
+);
+
+// Joystick input report for high resolution mode (Flag bit 15)
+auto hires_report_desc = joystick(
+	// Inputs.
+	report_id(1),
+	
+	buttons(16),
+	
+	// Unwrapped position in counts, wrapping at 16 bits. Analog knobs
+	// (Flag bit 5) send their filtered reading instead, full scale 0xffff.
+	usage_page(UsagePage::Desktop),
+	usage(DesktopUsage::X),
+	usage(DesktopUsage::Y),
+	logical_minimum(-32768),
+	logical_maximum(32767),
+	report_count(2),
+	report_size(16),
+	input(0x0a),	// Wrap
+
+	// Velocity in counts per second
+	usage(0x40),	// Vx
+	usage(0x41),	// Vy
+	report_count(2),
+	input(0x02),
+
+	// Input sample sequence number and time in us, both wrapping at 16 bits
+	usage_page(0xff55),
+	usage(0x0101),
+	usage(0x0102),
+	report_count(2),
+	input(0x0a),
+	
+	report_desc_common
+);
+
+// Relative mouse (Flag bit 16). The resolution multiplier feature lets the
+// host take MOUSE_WHEEL_MULTIPLIER wheel steps per detent.
+auto mouse_report_desc = mouse(
+	usage_page(UsagePage::Desktop),
+	usage(DesktopUsage::X),
+	usage(DesktopUsage::Y),
+	logical_minimum(-32767),
+	logical_maximum(32767),
+	report_size(16),
+	report_count(2),
+	input(0x06),	// Relative
+
+	collection(Collection::Logical,
+		usage(DesktopUsage::ResolutionMultiplier),
+		logical_minimum(0),
+		logical_maximum(1),
+		physical_minimum(1),
+		physical_maximum(MOUSE_WHEEL_MULTIPLIER),
+		report_size(8),
+		report_count(1),
+		feature(0x02),
+
+		usage(DesktopUsage::Wheel),
+		logical_minimum(-127),
+		logical_maximum(127),
+		physical_minimum(0),
+		physical_maximum(0),
+		input(0x06)	// Relative
+	)
+);
+
 auto keyboard_report_desc = keyboard(
 	// Modifiers
 	report_size(1),
@@ -326,6 +532,12 @@ auto keyboard_report_desc = keyboard(
 	input(0x02)
 );
 
+struct mouse_report_t {
+	int16_t x;
+	int16_t y;
+	int8_t wheel;
+} __attribute__((packed));
+
 struct input_report_t {
 	uint8_t report_id;
 	uint16_t buttons;
@@ -333,6 +545,17 @@ struct input_report_t {
 	uint8_t axis_y;
 } __attribute__((packed));
 
+struct hires_input_report_t {
+	uint8_t report_id;
+	uint16_t buttons;
+	int16_t axis_x;
+	int16_t axis_y;
+	int16_t velocity_x;
+	int16_t velocity_y;
+	uint16_t sequence;
+	uint16_t timestamp;
+} __attribute__((packed));
+
 struct output_report_t {
 	uint8_t report_id;
 	uint16_t leds;
@@ -354,10 +577,19 @@ struct config_report_t {
 	uint8_t report_id;
 	uint8_t segment;
 	uint8_t size;
-	uint8_t pad;
+	uint8_t flags;
 	uint8_t data[60];
 } __attribute__((packed));
 
+struct config_transfer_report_t {
+	uint8_t report_id;
+	uint8_t op;
+	uint8_t size;
+	uint8_t flags;
+	uint16_t offset;
+	uint8_t data[58];
+} __attribute__((packed));
+
 struct device_report_t {
 	uint8_t report_id;
 	uint16_t command_id;
@@ -1,10 +1,12 @@
 #include <os/time.h>
 #include "led_breathing.h"
+#include "../us_clock.h"
 
 // Return TRUE if there is an update that should be pushed to the LED driver
 bool Led_Breathing::update(int8_t state0, int8_t state1) {
 
-	if((Time::time() - last_update) < update_period) {
+	uint32_t now = us_clock.now();
+	if((now - last_update) < update_period * 1000u) {
 		return false;
 	}
 	input_state[0] = state0;
@@ -46,7 +48,7 @@ bool Led_Breathing::update(int8_t state0, int8_t state1) {
 		leds[i] = CHSV(led_hue[i], led_hue[i] == 255 ? 0 : 255, led_brightness[i]);
 	}
 
-	last_update = Time::time();
+	last_update = now;
 
 	return true;
 }
\ No newline at end of file
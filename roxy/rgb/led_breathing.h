@@ -39,7 +39,7 @@ class Led_Breathing {
 		};
 
 		void set_hue(uint8_t index, uint8_t col) {
-			if(index >= 0 && index < BREATHING_NUM_LEDS)
+			if(index < BREATHING_NUM_LEDS)
 				led_hue[index] = col;
 		}
 };
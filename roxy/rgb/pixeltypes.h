@@ -106,6 +106,9 @@ struct CRGB {
     {
     }
 
+    /// allow copy construction
+	inline CRGB(const CRGB& rhs) __attribute__((always_inline)) = default;
+
     /// allow construction from HSV color
 	inline CRGB(const CHSV& rhs) __attribute__((always_inline))
     {
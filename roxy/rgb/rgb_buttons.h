@@ -33,6 +33,7 @@
 
 #include "../board_define.h"
 #include "../board_version.h"
+#include "../profiler.h"
 #include "hsv2rgb.h"
 
 class Rgb_Buttons {
@@ -60,8 +61,8 @@ class Rgb_Buttons {
 
             if(current_timer == Timer1) {
                 DMA1.reg.C[4].NDTR = 26;
-                DMA1.reg.C[4].MAR = (uint32_t)&dmabuf;
-                DMA1.reg.C[4].PAR = (uint32_t)dma_src;
+                DMA1.reg.C[4].MAR = (uintptr_t)&dmabuf;
+                DMA1.reg.C[4].PAR = (uintptr_t)dma_src;
                 DMA1.reg.C[4].CR = 	(0 << 10) |	// MSIZE = 8-bits
                                     (1 << 8) | 	// PSIZE = 16-bits
                                     (1 << 7) | 	// Memory increment mode enabled
@@ -71,8 +72,8 @@ class Rgb_Buttons {
                                     (1 << 0);	// Channel enable
             } else {
                 DMA2.reg.C[0].NDTR = 26;
-                DMA2.reg.C[0].MAR = (uint32_t)&dmabuf;
-                DMA2.reg.C[0].PAR = (uint32_t)dma_src;
+                DMA2.reg.C[0].MAR = (uintptr_t)&dmabuf;
+                DMA2.reg.C[0].PAR = (uintptr_t)dma_src;
                 DMA2.reg.C[0].CR = 	(0 << 10) |	// MSIZE = 8-bits
                                     (1 << 8) | 	// PSIZE = 16-bits
                                     (1 << 7) | 	// Memory increment mode enabled
@@ -433,12 +434,16 @@ Rgb_Buttons rgb_buttons;
 
 template<>
 void interrupt<Interrupt::DMA1_Channel5>() {
+	uint32_t prof = profiler.start();
 	rgb_buttons.irq_dma(Interrupt::DMA1_Channel5);
+	profiler.stop(PROF_DMA, prof);
 }
 
 template<>
 void interrupt<Interrupt::DMA2_Channel1>() {
+    uint32_t prof = profiler.start();
     rgb_buttons.irq_dma(Interrupt::DMA2_Channel1);
+    profiler.stop(PROF_DMA, prof);
 }
 
 #endif
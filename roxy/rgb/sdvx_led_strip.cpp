@@ -2,6 +2,7 @@
 #include <cmath>
 #include <cstring>
 #include "sdvx_led_strip.h"
+#include "../us_clock.h"
 
 void Sdvx_Leds::update_left() {
 	if(burst_pos_left >= 0 && burst_pos_left < SDVX_NUM_LEDS) {
@@ -43,8 +44,15 @@ void Sdvx_Leds::init(Mode mode) {
 
 // Return TRUE if there is an update that should be pushed to the LED driver
 bool Sdvx_Leds::update() {
-	// Don't update if there's no scrolling, or we didn't hit the update time yet
-	if((!scroll_left && !scroll_right) || (Time::time() - last_update) < scroll_speed) {
+	// Don't update if there's no scrolling, or we didn't hit the update time yet.
+	// While idle the next frame is kept due, so a scroll starting however
+	// long after, clock wrap included, steps at once.
+	uint32_t now = us_clock.now();
+	if(!scroll_left && !scroll_right) {
+		last_update = now - scroll_speed * 1000u;
+		return false;
+	}
+	if((now - last_update) < scroll_speed * 1000u) {
 		return false;
 	}
 
@@ -75,7 +83,7 @@ bool Sdvx_Leds::update() {
 	update_left();
 	update_right();
 
-	last_update = Time::time();
+	last_update = now;
 
 	return true;
 }
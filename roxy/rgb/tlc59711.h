@@ -87,8 +87,8 @@ class TLC59711 {
 			busy = true;
 
 			DMA2.reg.C[1].NDTR = (2 + 12) * numdrivers;
-			DMA2.reg.C[1].MAR = (uint32_t)&pwmbuffer;
-			DMA2.reg.C[1].PAR = (uint32_t)&SPI3.reg.DR;
+			DMA2.reg.C[1].MAR = (uintptr_t)&pwmbuffer;
+			DMA2.reg.C[1].PAR = (uintptr_t)&SPI3.reg.DR;
 			DMA2.reg.C[1].CR = 	(1 << 10) |	// MSIZE = 16-bits
 								(1 << 8) | 	// PSIZE = 16-bits
 								(1 << 7) |	// Memory increment mode enabled
@@ -121,9 +121,9 @@ class TLC59711 {
 
 		void set_brightness(uint8_t r, uint8_t g, uint8_t b) {
 			// BC valid range 0-127
-			bcr = r > 127 ? 127 : (r < 0 ? 0 : r);
-			bcg = g > 127 ? 127 : (g < 0 ? 0 : g);
-			bcb = b > 127 ? 127 : (b < 0 ? 0 : b);
+			bcr = r > 127 ? 127 : r;
+			bcg = g > 127 ? 127 : g;
+			bcb = b > 127 ? 127 : b;
 
 			set_command_buffer();
 		}
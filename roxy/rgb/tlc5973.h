@@ -109,8 +109,8 @@ class TLC5973 {
 			busy = true;
 
 			dma->reg.C[dma_chan].NDTR = 52;
-			dma->reg.C[dma_chan].MAR = (uint32_t)&buf;
-			dma->reg.C[dma_chan].PAR = (uint32_t)&(spi->reg.DR);
+			dma->reg.C[dma_chan].MAR = (uintptr_t)&buf;
+			dma->reg.C[dma_chan].PAR = (uintptr_t)&(spi->reg.DR);
 			dma->reg.C[dma_chan].CR = 	(1 << 10) |	// MSIZE = 16-bits
 										(1 << 8) | 	// PSIZE = 16-bits
 										(1 << 7) |	// Memory increment mode enabled
@@ -5,6 +5,7 @@
 
 #include "rgb_config.h"
 #include "pixeltypes.h"
+#include "../us_clock.h"
 
 #define TT_MAX_LEDS 60
 
@@ -99,7 +100,7 @@ class Turntable_Leds {
 			mod_val = num_leds / num_groups;
 
 			switch(mode) {
-				case Marquee:
+				case Marquee: {
 					switch(spin_dir) {
 						case CWIdle:
 						case LastDirection:
@@ -108,6 +109,8 @@ class Turntable_Leds {
 						case CCWIdle:
 							marquee_state = NeutralCCW;
 							break;
+						default:
+							break;
 					}
 					gamma[0] = 1.0f;
 					gamma_inv[0] = 1.0f;
@@ -117,6 +120,9 @@ class Turntable_Leds {
 						gamma_inv[i + 1] = 0.6 - sub * (mod_val - 2 - i);
 					}
 					break;
+				}
+				default:
+					break;
 			}
 		}
 
@@ -165,10 +171,11 @@ class Turntable_Leds {
 			// 	}
 			// }
 
-			if((Time::time() - last_update) < update_speed) {
+			uint32_t now = us_clock.now();
+			if((now - last_update) < update_speed * 1000u) {
 				return false;
 			}
-			last_update = Time::time();
+			last_update = now;
 
 			switch(mode) {
 				case Marquee:
@@ -232,11 +239,15 @@ class Turntable_Leds {
 									marquee_state = NeutralCCW;
 								}
 								break;
+							default:
+								break;
 						}
 						timeout_count = 0;
 						cycle_count = num_slow_cycles;	// Force an update on the next cycle
 					}
 					break;
+				default:
+					break;
 			}			
 
 			return true;
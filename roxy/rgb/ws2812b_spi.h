@@ -28,8 +28,8 @@ class WS2812B_Spi {
 			cnt--;
 			
 			DMA2.reg.C[1].NDTR = 10;
-			DMA2.reg.C[1].MAR = (uint32_t)&dmabuf;
-			DMA2.reg.C[1].PAR = (uint32_t)&SPI3.reg.DR8;
+			DMA2.reg.C[1].MAR = (uintptr_t)&dmabuf;
+			DMA2.reg.C[1].PAR = (uintptr_t)&SPI3.reg.DR8;
 			DMA2.reg.C[1].CR = 	(0 << 10) |	// MSIZE = 8-bits
 								(0 << 8) | 	// PSIZE = 8-bits
 								(1 << 7) |	// Memory increment mode enabled
@@ -29,8 +29,8 @@ class WS2812B_Timer {
 			
 #if defined(ROXY)
 			DMA2.reg.C[0].NDTR = 26;
-			DMA2.reg.C[0].MAR = (uint32_t)&dmabuf;
-			DMA2.reg.C[0].PAR = (uint32_t)&TIM8.CCR3;
+			DMA2.reg.C[0].MAR = (uintptr_t)&dmabuf;
+			DMA2.reg.C[0].PAR = (uintptr_t)&TIM8.CCR3;
 			DMA2.reg.C[0].CR = 	(0 << 10) |	// MSIZE = 8-bits 
 								(1 << 8) | 	// PSIZE = 16-bits
 								(1 << 7) | 	// Memory increment mode enabled
@@ -40,8 +40,8 @@ class WS2812B_Timer {
 								(1 << 0);	// Channel enable
 #elif defined(ARCIN)
 			DMA1.reg.C[6].NDTR = 26;
-			DMA1.reg.C[6].MAR = (uint32_t)&dmabuf;
-			DMA1.reg.C[6].PAR = (uint32_t)&TIM4.CCR3;
+			DMA1.reg.C[6].MAR = (uintptr_t)&dmabuf;
+			DMA1.reg.C[6].PAR = (uintptr_t)&TIM4.CCR3;
 			DMA1.reg.C[6].CR = (0 << 10) | (1 << 8) | (1 << 7) | (0 << 6) | (1 << 4) | (1 << 1) | (1 << 0);
 #endif
 		}
@@ -6,6 +6,8 @@
 #include <interrupt/interrupt.h>
 #include "board_define.h"
 #include "config.h"
+#include "profiler.h"
+#include "ramfunc.h"
 
 extern config_t config;
 
@@ -32,8 +34,11 @@ class SPI_PS {
         uint8_t state;
         uint16_t button_state;
         uint16_t button_cache;  // Cached value of buttons to ensure a transmission stays consistent
+        uint16_t buttons_cache; // Unmapped buttons behind button_cache
+        volatile uint16_t sent_buttons;
+        volatile bool sent;
 
-        bool process_data(uint8_t data) {
+        RAMFUNC bool process_data(uint8_t data) {
             bool ack = false;
             if(data == 0x01) {
                 // Reset state upon receiving 0x01 (first byte)
@@ -58,11 +63,13 @@ class SPI_PS {
                 case 2:
                     // Lower byte button state
                     SPI2.reg.DR8 = (uint8_t)(button_cache & 0xFF);
+                    sent_buttons = buttons_cache;
                     ack = true;
                     break;
                 case 3:
                     // Upper byte button state
                     SPI2.reg.DR8 = (uint8_t)((button_cache >> 8) & 0xFF);
+                    sent = true;
                     ack = true;
                     break;
                 case 4:
@@ -252,9 +259,20 @@ class SPI_PS {
                     break;
             }
             button_cache = button_state;
+            buttons_cache = buttons;
         }
 
-        void irq() {
+        // Returns true once per poll, with the buttons the console was sent.
+        bool get_sent(uint16_t& buttons) {
+            if(!sent) {
+                return false;
+            }
+            sent = false;
+            buttons = sent_buttons;
+            return true;
+        }
+
+        RAMFUNC void irq() {
             if(!enabled) {
                 return;
             }
@@ -280,8 +298,10 @@ class SPI_PS {
 SPI_PS spi_ps;
 
 template <>
-void interrupt<Interrupt::SPI2>() {
+RAMFUNC void interrupt<Interrupt::SPI2>() {
+    uint32_t prof = profiler.start();
     spi_ps.irq();
+    profiler.stop(PROF_SPI2, prof);
 }
 
 #undef SELECT
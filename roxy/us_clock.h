@@ -0,0 +1,70 @@
+#ifndef US_CLOCK_H
+#define US_CLOCK_H
+
+#include <rcc/rcc.h>
+#include <timer/timer.h>
+#include <interrupt/interrupt.h>
+#include <stdint.h>
+
+#include "ramfunc.h"
+
+// Free-running microsecond clock. TIM15 counts at 1 MHz and its update
+// interrupt extends it to 32 bits, which wraps after ~71 minutes. Callers
+// only ever compare times by difference.
+//
+// Started first thing in main(), everything timing related runs on it.
+class Us_Clock {
+	private:
+		volatile uint32_t high = 0;
+
+	public:
+		void init() {
+			RCC.enable(RCC.TIM15);
+
+			TIM15.PSC = 72 - 1;		// 1 MHz
+			TIM15.ARR = 0xffff;
+			TIM15.EGR = 1 << 0;		// Load prescaler
+			TIM15.SR &= ~(1 << 0);
+			TIM15.DIER = 1 << 0;	// Update interrupt
+			TIM15.CR1 = 1 << 0;
+
+			Interrupt::enable(Interrupt::TIM1_BRK_TIM15);
+		}
+
+		RAMFUNC uint32_t now() {
+			uint32_t h, cnt, sr;
+			do {
+				h = high;
+				cnt = TIM15.CNT;
+				sr = TIM15.SR;
+			} while(h != high);
+
+			// Wrapped, but the interrupt has not run yet.
+			if((sr & (1 << 0)) && cnt < 0x8000) {
+				h += 0x10000;
+			}
+
+			return h + cnt;
+		}
+
+		// Busy-waits at least us microseconds.
+		void delay(uint32_t us) {
+#if defined(SIM)
+			(void)us;	// Code takes no simulated time
+#else
+			uint32_t start = now();
+			while(now() - start <= us);
+#endif
+		}
+
+		RAMFUNC void irq() {
+			if(TIM15.SR & (1 << 0)) {
+				TIM15.SR &= ~(1 << 0);	// Clear UIF
+				high += 0x10000;
+			}
+		}
+};
+
+extern Us_Clock us_clock;	// In main.cpp
+
+#endif
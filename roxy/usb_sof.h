@@ -0,0 +1,141 @@
+#ifndef USB_SOF_H
+#define USB_SOF_H
+
+#include <usb/usb.h>
+#include <interrupt/interrupt.h>
+#include <os/time.h>
+#include <stdint.h>
+
+#include "us_clock.h"
+
+struct sof_stats_t {
+	uint32_t frames;		// Start of frames seen
+	uint32_t reports;		// Reports assembled in sync
+	uint32_t late;			// Frames skipped because the loop overran the target
+	uint16_t lead;			// Configured lead time in us
+	int16_t phase_min;		// Assembly time relative to the target in us,
+	int16_t phase_max;		// min/max since the last read
+	int16_t phase_avg;
+} __attribute__((packed));
+
+// Schedules input sampling and report assembly a fixed lead time before the
+// next USB start of frame, so the endpoint holds the freshest state when the
+// host's IN token arrives.
+//
+// laks polls the USB peripheral with all interrupt masks clear, so only SOFM
+// is enabled here and the interrupt handles nothing else. Frames are
+// timestamped with the microsecond clock.
+class Usb_Sof {
+	private:
+		volatile uint32_t sof_time;
+		volatile uint32_t sof_count = 0;
+		volatile uint32_t sof_ms = 0;
+		uint32_t done_count = 0;
+		uint16_t target;		// us after SOF
+		bool enabled = false;
+
+		sof_stats_t stats;
+		int32_t phase_avg16;	// Moving average, 4 fractional bits
+
+		void reset_phase() {
+			stats.phase_min = INT16_MAX;
+			stats.phase_max = INT16_MIN;
+		}
+
+	public:
+		void init(uint16_t lead) {
+			if(lead > 900) {
+				lead = 900;
+			}
+			target = 1000 - lead;
+
+			stats = {0, 0, 0, lead, 0, 0, 0};
+			reset_phase();
+			phase_avg16 = 0;
+
+			USB.reg.CNTR |= 1 << 9;	// SOFM
+			Interrupt::enable(Interrupt::USB_LP_CAN_RX0);
+
+			enabled = true;
+		}
+
+		// True once per frame when the target time has passed. Runs free
+		// while there are no frames, e.g. before enumeration.
+		bool due() {
+			if(!enabled) {
+				return true;
+			}
+
+			// A bus reset may have cleared the mask
+			if(!(USB.reg.CNTR & (1 << 9))) {
+				USB.reg.CNTR |= 1 << 9;
+			}
+
+			uint32_t count;
+			uint32_t t;
+			do {
+				count = sof_count;
+				t = sof_time;
+			} while(count != sof_count);
+
+			if(Time::time() - sof_ms > 2) {
+				return true;
+			}
+
+			if(count == done_count) {
+				return false;
+			}
+
+			int32_t phase = int32_t(us_clock.now() - t) - target;
+			if(phase < 0) {
+				return false;
+			}
+
+			if(done_count && count - done_count > 1) {
+				stats.late += count - done_count - 1;
+			}
+			done_count = count;
+
+			stats.reports++;
+			if(phase < stats.phase_min) {
+				stats.phase_min = phase;
+			}
+			if(phase > stats.phase_max) {
+				stats.phase_max = phase;
+			}
+			phase_avg16 += phase - (phase_avg16 >> 4);
+
+			return true;
+		}
+
+		bool is_enabled() {
+			return enabled;
+		}
+
+		// Clears min/max so every read covers the time since the last one.
+		sof_stats_t get_stats() {
+			sof_stats_t s = stats;
+			s.frames = sof_count;
+			s.phase_avg = phase_avg16 >> 4;
+			reset_phase();
+			return s;
+		}
+
+		void irq() {
+			if(USB.reg.ISTR & (1 << 9)) {
+				USB.reg.ISTR = ~(1 << 9);	// Clears SOF only
+				sof_time = us_clock.now();
+				sof_ms = Time::time();
+				sof_count++;
+			}
+		}
+};
+
+Usb_Sof usb_sof;
+
+template<>
+void interrupt<Interrupt::USB_LP_CAN_RX0>() {
+	usb_sof.irq();
+}
+
+#endif
@@ -27,7 +27,7 @@ class USB_strings : public USB_class_driver {
 		}
 	
 	protected:
-		virtual SetupStatus handle_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+		virtual SetupStatus handle_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t, uint16_t) {
 			// Get string descriptor.
 			if(bmRequestType == 0x80 && bRequest == 0x06 && (wValue & 0xff00) == 0x0300) {
 				const void* desc = nullptr;
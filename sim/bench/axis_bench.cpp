@@ -0,0 +1,334 @@
+// Host microbenchmark for Axis::process(): the integer pipeline in
+// roxy/axis.h against the float version it replaced, kept below as the
+// reference. Checks that both agree on movement that does not wrap the
+// counter, then times each.
+//
+//   scons sim && build/sim/axis-bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../../roxy/axis.h"
+
+Us_Clock us_clock;
+
+uint32_t input;
+
+// Moves the microsecond clock to t, through the TIM15 wrap if needed.
+void set_time(uint32_t t) {
+	if((t & 0xffff) < TIM15.CNT) {
+		TIM15.SR |= 1 << 0;
+		us_clock.irq();
+	}
+	TIM15.CNT = t & 0xffff;
+}
+
+class Bench_Axis : public Axis {
+	public:
+		void enable(int8_t sens) {
+			set_range(sens, false);
+		}
+
+		virtual int32_t get_position() final {
+			return input;
+		}
+};
+
+// With an edge per change of input and adaptive mode on, so the edge
+// velocity, interpolation and adaptive sustain are timed as well. Not part
+// of the lockstep check, the float version has none of them.
+class Edge_Axis : public Bench_Axis {
+	private:
+		axis_edge_t last = {};
+		uint32_t last_input = 0;
+
+	public:
+		virtual bool get_edge(axis_edge_t& edge) final {
+			if(input != last_input) {
+				uint32_t t = us_clock.now();
+				int8_t dir = int32_t(input - last_input) > 0 ? 1 : -1;
+				uint32_t counts = dir > 0 ? input - last_input : last_input - input;
+				last.interval = dir == last.dir ? t - last.time : 0;
+				last.counts = counts;
+				last.time = t;
+				last.position = input;
+				last.dir = dir;
+				last.seq++;
+				last_input = input;
+			}
+			edge = last;
+			return true;
+		}
+};
+
+// Axis::process() before the integer rewrite, otherwise unchanged.
+class Float_Axis {
+	private:
+		uint32_t axis_sustain_start;
+		uint32_t last_axis = 0;
+		uint32_t axis_sustain_time = 0;
+		uint8_t reduction_ratio = 0;
+		float deadzone_angle = 0.0f;
+		uint16_t max_count = 255;
+		int8_t sensitivity = 0;
+
+	public:
+		uint32_t count;
+		int8_t dir_state = 0;
+
+		void enable(int8_t sens) {
+			if(sens < 0) {
+				if(sens == -127) {
+					max_count = (600 * 4) - 1;
+				} else if(sens == -126) {
+					max_count = (400 * 4) - 1;
+				} else if(sens == -125) {
+					max_count = (360 * 4) - 1;
+				} else {
+					max_count = 256 * -sens - 1;
+				}
+			} else {
+				max_count = 256 - 1;
+			}
+			sensitivity = sens;
+		}
+
+		void set_config(uint32_t _sustain, uint8_t _reduction, uint8_t _deadzone) {
+			axis_sustain_time = _sustain;
+			reduction_ratio = _reduction;
+			deadzone_angle = (float)_deadzone / 2.0f;
+		}
+
+		__attribute__((noinline)) uint32_t get() {
+			return input;
+		}
+
+		void process() {
+			uint32_t current_time = us_clock.now();
+			count = get();
+
+			// Perform reduction
+			uint32_t qe_temp = count;
+			if(reduction_ratio > 0) {
+				qe_temp = uint32_t((float)count / (4.0f * float(reduction_ratio) * 0.5f + 1.0f));
+				qe_temp = uint32_t((float)qe_temp * (4.0f * float(reduction_ratio) * 0.5f + 1.0f));
+			}
+
+			// Get delta
+			int8_t delta = qe_temp - last_axis;
+			// Detect rollover
+			if ((last_axis > (max_count / 2)) && qe_temp < (max_count / 4)) {
+				delta += max_count;
+			}
+			float delta_angle = (float)delta / (float)max_count * 360.0f;
+
+			// Logic:
+			// If QE was stationary and is now moving, change must exceed deadzone
+			// If QE was moving and is now stationary, it sustains for a set time / resets deadzone
+			// If QE was moving and is now moving in the opposite direction, change must exceed deadzone to trigger
+
+			switch(dir_state) {
+				case 0:   // Not moving
+					// Deadzone goes here
+					if(delta > 0 && delta_angle >= deadzone_angle) {
+						last_axis = qe_temp;
+						dir_state = 1;
+					} else if(delta < 0 && delta_angle <= -deadzone_angle) {
+						last_axis = qe_temp;
+						dir_state = -1;
+					}
+					break;
+				case 1:   // Started moving CW
+					if(delta == 0) {
+						axis_sustain_start = current_time;
+						last_axis = qe_temp;
+						dir_state = 2;
+					} else if(delta < 0 && delta_angle <= -deadzone_angle) {
+						last_axis = qe_temp;
+						dir_state = -1;
+					} else if(delta > 0) {
+						last_axis = qe_temp;
+					}
+					break;
+				case 2:   // Sustaining CW
+					if(delta <= 0 && ((current_time - axis_sustain_start) > axis_sustain_time)) {
+						last_axis = qe_temp;
+						dir_state = 0;
+					} else if(delta > 0) {
+						axis_sustain_start = current_time;
+						last_axis = qe_temp;
+					} else if(delta < 0 && delta_angle <= -deadzone_angle) {
+						last_axis = qe_temp;
+						dir_state = -1;
+					}
+					break;
+				case -1:  // Started moving CCW
+					if(delta == 0) {
+						axis_sustain_start = current_time;
+						last_axis = qe_temp;
+						dir_state = -2;
+					} else if(delta > 0 && delta_angle >= deadzone_angle) {
+						last_axis = qe_temp;
+						dir_state = 1;
+					} else if(delta < 0) {
+						last_axis = qe_temp;
+					}
+					break;
+				case -2:  // Sustaining CCW
+					if(delta >= 0 && ((current_time - axis_sustain_start) > axis_sustain_time)) {
+						last_axis = qe_temp;
+						dir_state = 0;
+					} else if(delta < 0) {
+						axis_sustain_start = current_time;
+						last_axis = qe_temp;
+					} else if(delta > 0 && delta_angle >= deadzone_angle) {
+						last_axis = qe_temp;
+						dir_state = 1;
+					}
+					break;
+			}
+
+			if(sensitivity == -127) {
+				count = last_axis * (256.0f / (600.0f * 4.0f));
+			} else if(sensitivity == -126) {
+				count = last_axis * (256.0f / (400.0f * 4.0f));
+			} else if(sensitivity == -125) {
+				count = last_axis * (256.0f / (360.0f * 4.0f));
+			} else if(sensitivity < 0) {
+				count = last_axis / -sensitivity;
+			} else if(sensitivity > 0) {
+				count = last_axis * sensitivity;
+			} else {
+				count = last_axis;
+			}
+
+			count -= 128;
+		}
+};
+
+struct Setup {
+	int8_t sens;
+	uint8_t reduction;
+	uint8_t deadzone;
+};
+
+const Setup setups[] = {
+	{0, 0, 0}, {0, 2, 6}, {-2, 0, 10}, {-4, 1, 3}, {3, 0, 0},
+	{-127, 0, 4}, {-126, 3, 0}, {-125, 0, 20},
+};
+
+// Random walk with bursts of movement and pauses, kept away from the wrap
+// and within the +-127 counts per call the float version can handle.
+struct Walk {
+	uint32_t lo, hi;
+	uint32_t pos;
+	int32_t speed = 0;
+	uint32_t seed = 1;
+
+	Walk(uint32_t max) : lo(max / 4), hi(max * 3 / 4), pos(max / 2) {}
+
+	uint32_t rand() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 16;
+	}
+
+	uint32_t next() {
+		if(rand() % 50 == 0) {
+			speed = int32_t(rand() % 9) - 4;
+		}
+		int32_t p = int32_t(pos) + speed;
+		if(p < int32_t(lo) || p > int32_t(hi)) {
+			speed = -speed;
+			p = pos;
+		}
+		pos = p;
+		return pos;
+	}
+};
+
+template <class A>
+double run(A& axis, uint32_t max, uint32_t steps) {
+	Walk walk(max);
+	uint32_t t = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < steps; i++) {
+		input = walk.next();
+		set_time(t += 250);
+		axis.process();
+	}
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	return double(ns) / steps;
+}
+
+uint32_t turn(int8_t sens) {
+	return sens == -127 ? 2400 : sens == -126 ? 1600 : sens == -125 ? 1440 : sens < 0 ? 256 * -sens : 256;
+}
+
+int main() {
+	const uint32_t check_steps = 200000;
+	const uint32_t time_steps = 5000000;
+	bool ok = true;
+
+	printf("%-16s %10s %10s %10s %10s\n", "sens/red/dz", "mismatch", "float ns", "int ns", "edge ns");
+	for(const Setup& s : setups) {
+		uint32_t max = turn(s.sens) - 1;
+
+		// Lockstep check
+		Bench_Axis a;
+		Float_Axis f;
+		a.enable(s.sens);
+		f.enable(s.sens);
+		a.set_config(5000, s.reduction, s.deadzone);
+		f.set_config(5000, s.reduction, s.deadzone);
+
+		// Both start at count 0, which the float version's int8_t delta gets
+		// wrong for a jump to mid-scale. Ramp up to the start and let them
+		// settle there first.
+		Walk walk(max);
+		uint32_t t = 0;
+		for(uint32_t i = 0; i < walk.pos + 100; i++) {
+			input = i < walk.pos ? i : walk.pos;
+			set_time(t += 250);
+			a.process();
+			f.process();
+		}
+
+		uint32_t mismatch = 0;
+		for(uint32_t i = 0; i < check_steps; i++) {
+			input = walk.next();
+			set_time(t += 250);
+			a.process();
+			f.process();
+			if(a.dir_state != f.dir_state || a.count != f.count) {
+				mismatch++;
+			}
+		}
+		if(mismatch) {
+			ok = false;
+		}
+
+		// Timing, on fresh instances
+		Bench_Axis ta;
+		Float_Axis tf;
+		ta.enable(s.sens);
+		tf.enable(s.sens);
+		ta.set_config(5000, s.reduction, s.deadzone);
+		tf.set_config(5000, s.reduction, s.deadzone);
+		double float_ns = run(tf, max, time_steps);
+		double int_ns = run(ta, max, time_steps);
+
+		Edge_Axis te;
+		te.enable(s.sens);
+		te.set_config(5000, s.reduction, s.deadzone);
+		te.set_edge_start(true);
+		te.set_adaptive(true);
+		double edge_ns = run(te, max, time_steps);
+
+		char name[32];
+		snprintf(name, sizeof(name), "%d/%u/%u", s.sens, s.reduction, s.deadzone);
+		printf("%-16s %10u %10.2f %10.2f %10.2f\n", name, mismatch, float_ns, int_ns, edge_ns);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+// Host benchmark for Compiled_Config in roxy/compiled_config.h: the config
+// decisions of one main loop iteration (axis buttons, PS2, report outputs,
+// NKRO keys and LED outputs), made by testing config fields as the loop
+// did before, against the compiled masks, outputs and key table. Checks
+// both give the same buttons, outputs and NKRO report for random inputs
+// under each config, then times them in TSC cycles per iteration. The LED
+// outputs only count their calls.
+//
+//   scons sim && build/sim/compiled-config-bench
+
+#include <cstdio>
+#include <cstring>
+#include <x86intrin.h>
+
+#include "../../roxy/compiled_config.h"
+
+config_t config;
+rgb_config_t rgb_config;
+mapping_config_t mapping_config;
+device_config_t device_config;
+
+uint32_t led_calls[8];
+
+void breathing_none(int8_t, int8_t) {}
+void breathing_only(int8_t, int8_t) { led_calls[0]++; }
+void breathing_tlc59711(int8_t, int8_t) { led_calls[1]++; }
+void breathing_tlc5973(int8_t, int8_t) { led_calls[2]++; }
+void tt_none() {}
+void tt_only() { led_calls[3]++; }
+void tt_ws2812b() { led_calls[4]++; }
+void sdvx_none() {}
+void sdvx_turbocharger() { led_calls[5]++; }
+void sdvx_tlc59711() { led_calls[6]++; }
+
+Compiled_Config compiled_config;
+
+const uint8_t num_buttons = 11;
+
+struct Inputs {
+	uint16_t buttons;
+	int8_t dir[2];
+};
+
+struct Outputs {
+	uint16_t buttons;
+	bool joystick;
+	bool keyboard;
+	bool ps2;
+	bool restage;
+};
+
+uint32_t seed = 1;
+
+uint32_t rnd() {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+// The loop before Compiled_Config, less the drivers.
+__attribute__((noinline)) void step_before(const Inputs& in, Outputs& out, NKRO_Keyboard& nkro) {
+	uint32_t axis_buttons[4] = {(1 << 12), (1 << 13), (1 << 14), (1 << 15)};
+	uint16_t buttons = in.buttons;
+	for(int i = 0; i < 2; i++) {
+		if(in.dir[i] > 0) {
+			if(config.flags & (1 << 6)) {
+				buttons |= axis_buttons[2 * i];
+			}
+		} else if(in.dir[i] < 0) {
+			if(config.flags & (1 << 6)) {
+				buttons |= axis_buttons[2 * i + 1];
+			}
+		}
+
+		if(in.dir[i] > 0 && (config.flags & (1 << 6) || config.ps2_mode == 2 || config.ps2_mode == 3)) {
+			buttons |= axis_buttons[2 * i];
+		} else if(in.dir[i] < 0 && (config.flags & (1 << 6) || config.ps2_mode == 2 || config.ps2_mode == 3)) {
+			buttons |= axis_buttons[2 * i + 1];
+		}
+	}
+	out.buttons = buttons;
+	out.ps2 = config.ps2_mode > 0;
+	out.restage = config.flags & (1 << 11);
+	out.joystick = config.output_mode == 0 || config.output_mode == 2;
+	out.keyboard = config.output_mode == 1 || config.output_mode == 2;
+
+	if(out.keyboard) {
+		for (int i = 0; i < num_buttons; i++) {
+			if (buttons & (1 << i) && mapping_config.button_kb_map[i] > 0) {
+				nkro.set_key(mapping_config.button_kb_map[i]);
+			} else {
+				nkro.reset_key(mapping_config.button_kb_map[i]);
+			}
+		}
+		for (int i = 0; i < 2; i++) {
+			if (in.dir[i] == 1 && mapping_config.axes_kb_map[2 * i] > 0) {
+				nkro.set_key(mapping_config.axes_kb_map[2 * i]);
+			} else {
+				nkro.reset_key(mapping_config.axes_kb_map[2 * i]);
+			}
+			if (in.dir[i] == -1 && mapping_config.axes_kb_map[2 * i + 1] > 0) {
+				nkro.set_key(mapping_config.axes_kb_map[2 * i + 1]);
+			} else {
+				nkro.reset_key(mapping_config.axes_kb_map[2 * i + 1]);
+			}
+		}
+	}
+
+	if(rgb_config.rgb_mode == 1) {
+		if(config.rgb_mode == 2) {
+			breathing_tlc59711(in.dir[0], in.dir[1]);
+		} else if(config.rgb_mode == 3) {
+			breathing_tlc5973(in.dir[0], in.dir[1]);
+		} else {
+			breathing_only(in.dir[0], in.dir[1]);
+		}
+	}
+	if(rgb_config.rgb_mode == 3) {
+		if(config.rgb_mode == 1) {
+			tt_ws2812b();
+		} else {
+			tt_only();
+		}
+	}
+	if(device_config.device_enable & (1 << 1)) {
+		sdvx_turbocharger();
+	} else if(config.rgb_mode == 2 && rgb_config.rgb_mode == 2) {
+		sdvx_tlc59711();
+	}
+}
+
+__attribute__((noinline)) void step_after(const Inputs& in, Outputs& out, NKRO_Keyboard& nkro) {
+	uint16_t axis_dirs = 0;
+	for(int i = 0; i < 2; i++) {
+		if(in.dir[i] > 0) {
+			axis_dirs |= 1 << (12 + 2 * i);
+		} else if(in.dir[i] < 0) {
+			axis_dirs |= 1 << (13 + 2 * i);
+		}
+	}
+	uint16_t buttons = in.buttons | (axis_dirs & compiled_config.axis_buttons);
+	out.buttons = buttons;
+	out.ps2 = compiled_config.ps2;
+	out.restage = compiled_config.restage;
+	out.joystick = compiled_config.joystick;
+	out.keyboard = compiled_config.keyboard;
+
+	if(out.keyboard) {
+		compiled_config.build_keys(buttons | (uint32_t(axis_dirs) << 4), nkro.get_data());
+	}
+
+	compiled_config.breathing(in.dir[0], in.dir[1]);
+	compiled_config.tt();
+	compiled_config.sdvx();
+}
+
+struct Setup {
+	const char* name;
+	uint32_t flags;
+	uint8_t ps2_mode;
+	uint8_t output_mode;
+	uint8_t rgb_mode;
+	uint8_t rgb_config_mode;
+	uint8_t device_enable;
+	uint8_t keys;		// Buttons with a key
+	bool axis_keys;
+};
+
+const Setup setups[] = {
+	{"joystick",         0,        0, 0, 0, 0, 0, 0,  false},
+	{"kb 7 keys",        0,        0, 2, 1, 3, 0, 7,  false},
+	{"kb all + axes",    1 << 6,   0, 2, 2, 1, 0, 11, true},
+	{"kb + ps2 iidx",    1 << 11,  2, 1, 2, 2, 2, 11, true},
+};
+
+const uint32_t num_inputs = 4096;
+Inputs inputs[num_inputs];
+
+double time_steps(void (*step)(const Inputs&, Outputs&, NKRO_Keyboard&), uint32_t iterations) {
+	NKRO_Keyboard nkro;
+	nkro.reset_keys();
+	Outputs out;
+	uint64_t start = __rdtsc();
+	for(uint32_t i = 0; i < iterations; i++) {
+		step(inputs[i % num_inputs], out, nkro);
+	}
+	return double(__rdtsc() - start) / iterations;
+}
+
+int main() {
+	for(uint32_t i = 0; i < num_inputs; i++) {
+		inputs[i].buttons = rnd() & 0x7ff;
+		inputs[i].dir[0] = int8_t(rnd() % 3) - 1;
+		inputs[i].dir[1] = int8_t(rnd() % 3) - 1;
+	}
+
+	const uint32_t iterations = 10000000;
+	uint32_t mismatches = 0;
+
+	printf("%-16s %14s %14s\n", "config", "before cycles", "after cycles");
+	for(const Setup& s : setups) {
+		memset(&config, 0, sizeof(config));
+		memset(&rgb_config, 0, sizeof(rgb_config));
+		memset(&mapping_config, 0, sizeof(mapping_config));
+		memset(&device_config, 0, sizeof(device_config));
+		config.flags = s.flags;
+		config.ps2_mode = s.ps2_mode;
+		config.output_mode = s.output_mode;
+		config.rgb_mode = s.rgb_mode;
+		rgb_config.rgb_mode = s.rgb_config_mode;
+		device_config.device_enable = s.device_enable;
+		// Distinct keys, letters then a modifier
+		for(uint8_t i = 0; i < s.keys; i++) {
+			mapping_config.button_kb_map[i] = i + 1 < s.keys ? 4 + i : 240 + i % 8;
+		}
+		if(s.axis_keys) {
+			for(uint8_t i = 0; i < 4; i++) {
+				mapping_config.axes_kb_map[i] = 30 + i;
+			}
+		}
+		compiled_config.compile(num_buttons);
+
+		NKRO_Keyboard before_nkro;
+		NKRO_Keyboard after_nkro;
+		before_nkro.reset_keys();
+		after_nkro.reset_keys();
+		memset(led_calls, 0, sizeof(led_calls));
+		for(uint32_t i = 0; i < num_inputs; i++) {
+			Outputs before_out;
+			Outputs after_out;
+			uint32_t before_calls[8];
+			step_before(inputs[i], before_out, before_nkro);
+			memcpy(before_calls, led_calls, sizeof(led_calls));
+			memset(led_calls, 0, sizeof(led_calls));
+			step_after(inputs[i], after_out, after_nkro);
+			if(before_out.buttons != after_out.buttons || before_out.joystick != after_out.joystick ||
+			   before_out.keyboard != after_out.keyboard || before_out.ps2 != after_out.ps2 ||
+			   before_out.restage != after_out.restage ||
+			   memcmp(before_nkro.get_data(), after_nkro.get_data(), 32) ||
+			   memcmp(before_calls, led_calls, sizeof(led_calls))) {
+				mismatches++;
+			}
+			memset(led_calls, 0, sizeof(led_calls));
+		}
+
+		double before = time_steps(step_before, iterations);
+		double after = time_steps(step_after, iterations);
+		printf("%-16s %14.1f %14.1f\n", s.name, before, after);
+	}
+	printf("mismatches       %u\n", mismatches);
+
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,303 @@
+// Host benchmark for Config_Store in roxy/config_store.h on an emulated
+// flash, against the page erase per save of the Configloader it replaced.
+//
+// The emulator behaves like the STM32F3 flash: erase sets a page to 0xff,
+// a half-word can only be programmed while erased or to 0x0000, and
+// operations take the datasheet maximum of 40 ms per page erase and 60 us
+// per half-word. It can cut the power at any operation, leaving that one
+// half done.
+//
+// Wear and throughput: random saves of the four config segments, each
+// changing a few bytes, with the flash time, half-words programmed and
+// the erases of the most worn page per save. Saves to 10k erase cycles is
+// how many it takes to wear a page out. The store runs them a step at a
+// time as the main loop does, and the longest the flash was busy in one
+// step is the longest the loop stalls, against the longest save done in
+// one go.
+//
+// Power cuts: a run of saves is repeated cutting the power at every flash
+// operation in turn, some of them batches of several segments. After each
+// cut the store is mounted again and every segment must read as its last
+// saved value, or the value being saved, and the segments of a batch must
+// all read old or all new.
+//
+//   scons sim && build/sim/config-store-bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+
+#include "../../roxy/config_store.h"
+#include "../../roxy/config.h"
+#include "../../roxy/rgb/rgb_config.h"
+#include "../../roxy/device/device_config.h"
+
+const uint32_t pages = STORE_PAGES;
+const uint32_t endurance = 10000;	// Erase cycles
+
+const uint32_t sizes[4] = {sizeof(config_t), sizeof(rgb_config_t), sizeof(mapping_config_t), sizeof(device_config_t)};
+
+uint32_t seed = 1;
+
+uint32_t rnd() {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+// The store takes 32-bit flash addresses, so the image sits where the
+// firmware has it.
+const uint32_t image_size = STORE_PAGES * FLASH_PAGE_SIZE;
+uint8_t* const image = (uint8_t*)STORE_BASE;
+
+void map_image() {
+	uintptr_t start = STORE_BASE & ~uintptr_t(4095);
+	size_t size = (STORE_BASE + image_size - start + 4095) & ~size_t(4095);
+	void* p = mmap((void*)start, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(p != (void*)start) {
+		fprintf(stderr, "config-store-bench: unable to map 0x%08lx\n", (unsigned long)start);
+		exit(1);
+	}
+}
+
+class Emulated_Flash : public Flash_Writer {
+	public:
+		uint32_t erases[STORE_PAGES];
+		uint64_t programs = 0;
+		uint64_t busy_us = 0;
+		uint32_t errors = 0;		// Programs over a half-word that wasn't erased
+		int64_t power = -1;			// Operations left before the cut, -1 for none
+
+		Emulated_Flash() {
+			memset(image, 0xff, image_size);
+			memset(erases, 0, sizeof(erases));
+		}
+
+		uint32_t base() {
+			return STORE_BASE;
+		}
+
+		virtual void unlock() final {}
+		virtual void lock() final {}
+
+		virtual void erase(uint32_t addr) final {
+			uint32_t page = (addr - base()) / FLASH_PAGE_SIZE;
+			uint8_t* p = image + page * FLASH_PAGE_SIZE;
+			if(!power) {
+				return;
+			}
+			if(power > 0 && !--power) {
+				// Torn, some bits still set
+				for(uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+					p[i] |= rnd();
+				}
+				return;
+			}
+			memset(p, 0xff, FLASH_PAGE_SIZE);
+			erases[page]++;
+			busy_us += 40000;
+		}
+
+		virtual void program(uint32_t addr, uint16_t value) final {
+			uint16_t* p = (uint16_t*)(uintptr_t)addr;
+			if(!power) {
+				return;
+			}
+			if(*p != 0xffff && value != 0) {
+				errors++;
+				return;
+			}
+			if(power > 0 && !--power) {
+				// Torn, some bits not cleared yet
+				*p &= value | rnd();
+				return;
+			}
+			*p &= value;
+			programs++;
+			busy_us += 60;
+		}
+};
+
+struct Wear {
+	double flash_ms;		// Per save
+	double half_words;
+	uint32_t max_erases;
+	double saves_to_wear;
+	double host_ns;
+	uint32_t errors;
+	double save_ms;			// Longest save
+	double step_ms;			// Longest step
+};
+
+Wear run_store(uint32_t saves) {
+	Emulated_Flash flash;
+	Config_Store store(flash, flash.base(), pages);
+	store.mount();
+
+	uint8_t values[4][64] = {};
+	uint64_t ns = 0;
+	uint64_t save_us = 0;
+	uint64_t step_us = 0;
+	for(uint32_t i = 0; i < saves; i++) {
+		uint32_t key = rnd() % 4;
+		values[key][rnd() % sizes[key]] = rnd();
+		auto start = std::chrono::steady_clock::now();
+		uint64_t save_start = flash.busy_us;
+		if(store.begin(key, sizes[key], values[key])) {
+			uint64_t step_start = flash.busy_us;
+			while(store.step()) {
+				step_us = flash.busy_us - step_start > step_us ? flash.busy_us - step_start : step_us;
+				step_start = flash.busy_us;
+			}
+		}
+		save_us = flash.busy_us - save_start > save_us ? flash.busy_us - save_start : save_us;
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	Wear w;
+	w.flash_ms = flash.busy_us / 1000.0 / saves;
+	w.half_words = double(flash.programs) / saves;
+	w.max_erases = 0;
+	for(uint32_t i = 0; i < pages; i++) {
+		w.max_erases = flash.erases[i] > w.max_erases ? flash.erases[i] : w.max_erases;
+	}
+	w.saves_to_wear = w.max_erases ? double(endurance) * saves / w.max_erases : 0;
+	w.host_ns = double(ns) / saves;
+	w.errors = flash.errors;
+	w.save_ms = save_us / 1000.0;
+	w.step_ms = step_us / 1000.0;
+	return w;
+}
+
+// One page per segment, erased and rewritten with an 8 byte header.
+Wear run_pages(uint32_t saves) {
+	uint32_t erases[4] = {};
+	uint64_t programs = 0;
+	for(uint32_t i = 0; i < saves; i++) {
+		uint32_t key = rnd() % 4;
+		erases[key]++;
+		programs += (8 + sizes[key] + 1) / 2;
+	}
+
+	Wear w;
+	w.half_words = double(programs) / saves;
+	w.flash_ms = (40000.0 * saves + 60.0 * programs) / 1000 / saves;
+	w.max_erases = 0;
+	for(uint32_t i = 0; i < 4; i++) {
+		w.max_erases = erases[i] > w.max_erases ? erases[i] : w.max_erases;
+	}
+	w.saves_to_wear = double(endurance) * saves / w.max_erases;
+	w.host_ns = 0;
+	w.errors = 0;
+	w.save_ms = (40000.0 + 60.0 * (8 + 64) / 2) / 1000;
+	w.step_ms = w.save_ms;
+	return w;
+}
+
+struct Save {
+	uint32_t keys;		// One bit per key, a batch if more than one
+	uint8_t value[4][64];
+};
+
+// Saves until the power goes, then checks what a fresh mount reads.
+// Returns false once the run gets through with power to spare.
+bool cut_at(const std::vector<Save>& run, int64_t op, uint32_t& bad) {
+	Emulated_Flash flash;
+	flash.power = op;
+	Config_Store store(flash, flash.base(), pages);
+	store.mount();
+
+	uint8_t saved[4][64];
+	bool has[4] = {};
+	const Save* pending = nullptr;
+	for(const Save& s : run) {
+		pending = &s;
+		Config_Store::item_t items[4];
+		uint32_t n = 0;
+		for(uint32_t key = 0; key < 4; key++) {
+			if(s.keys & (1 << key)) {
+				items[n++] = {uint16_t(key), uint16_t(sizes[key]), s.value[key]};
+			}
+		}
+		store.write(items, n);
+		if(!flash.power) {
+			break;
+		}
+		for(uint32_t key = 0; key < 4; key++) {
+			if(s.keys & (1 << key)) {
+				memcpy(saved[key], s.value[key], sizes[key]);
+				has[key] = true;
+			}
+		}
+		pending = nullptr;
+	}
+
+	Config_Store after(flash, flash.base(), pages);
+	after.mount();
+	uint32_t old_keys = 0;
+	uint32_t new_keys = 0;
+	for(uint32_t key = 0; key < 4; key++) {
+		uint8_t v[64];
+		bool found = after.read(key, sizes[key], v);
+		bool old_ok = has[key] ? found && !memcmp(v, saved[key], sizes[key]) : !found;
+		bool new_ok = pending && (pending->keys & (1 << key)) && found && !memcmp(v, pending->value[key], sizes[key]);
+		if(!old_ok && !new_ok) {
+			bad++;
+		}
+		if(pending && (pending->keys & (1 << key))) {
+			new_ok ? new_keys++ : old_keys++;
+		}
+	}
+	// Half a batch
+	if(old_keys && new_keys) {
+		bad++;
+	}
+
+	bool done = flash.power != 0;
+
+	// Keeps working after the cut
+	uint8_t v[64];
+	memset(v, 0x5a, sizeof(v));
+	flash.power = -1;
+	if(!after.write(0, sizes[0], v) || !after.read(0, sizes[0], v) || v[0] != 0x5a) {
+		bad++;
+	}
+
+	return done;
+}
+
+int main() {
+	const uint32_t saves = 200000;
+	map_image();
+
+	printf("%-12s %10s %12s %12s %16s %10s %10s %10s\n", "scheme", "flash ms", "half-words", "max erases", "saves to wear", "host ns", "save ms", "step ms");
+	Wear p = run_pages(saves);
+	printf("%-12s %10.2f %12.1f %12u %16.0f %10s %10.2f %10.2f\n", "page/save", p.flash_ms, p.half_words, p.max_erases, p.saves_to_wear, "-", p.save_ms, p.step_ms);
+	Wear s = run_store(saves);
+	printf("%-12s %10.2f %12.1f %12u %16.0f %10.0f %10.2f %10.2f\n", "store", s.flash_ms, s.half_words, s.max_erases, s.saves_to_wear, s.host_ns, s.save_ms, s.step_ms);
+
+	// Long enough to go round the ring
+	std::vector<Save> run;
+	for(uint32_t i = 0; i < 400; i++) {
+		Save sv;
+		sv.keys = rnd() % 4 ? 1 << (rnd() % 4) : 0xf;
+		for(uint32_t j = 0; j < sizeof(sv.value); j++) {
+			sv.value[j / 64][j % 64] = rnd();
+		}
+		run.push_back(sv);
+	}
+
+	uint32_t bad = 0;
+	uint32_t cuts = 0;
+	for(int64_t op = 1; ; op++) {
+		cuts++;
+		if(cut_at(run, op, bad)) {
+			break;
+		}
+	}
+	printf("power cuts   %u, bad reads %u, program errors %u\n", cuts, bad, s.errors);
+
+	return bad || s.errors ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+// Host evaluator for the adaptive deadzone and sustain in Axis::process()
+// (flag bit 17) against the static ones, over traces of a 600 ppr
+// turntable with a 2 degree deadzone and 50 ms sustain.
+//
+// A trace is the true position at every main loop iteration, labelled
+// with the direction the player meant: 0 at rest, 1 or -1 while moving.
+// For each it reports how long dir_state takes to follow a new direction
+// (start), how long it holds one after the player stopped (stop), and
+// how often it moved to a direction the player didn't mean (false).
+// Recorded traces can be replayed as text files of "<us> <counts> <dir>"
+// lines.
+//
+//   scons sim && build/sim/deadzone-eval [trace.txt...]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../roxy/axis.h"
+
+Us_Clock us_clock;
+
+const int8_t sens = -127;		// 600 ppr, 2400 counts per turn
+const uint8_t deadzone = 4;		// 0.5 deg
+const uint32_t sustain = 50000;	// us
+const uint32_t loop_us = 100;
+
+struct Sample {
+	uint32_t time;	// us
+	int32_t pos;	// True position in counts
+	int8_t dir;		// Intended direction
+};
+
+struct Trace {
+	const char* name;
+	std::vector<Sample> samples;
+};
+
+// Moves the microsecond clock to t, through the TIM15 wrap if needed.
+void set_time(uint32_t t) {
+	if((t & 0xffff) < TIM15.CNT) {
+		TIM15.SR |= 1 << 0;
+		us_clock.irq();
+	}
+	TIM15.CNT = t & 0xffff;
+}
+
+int32_t input;
+
+class Eval_Axis : public Axis {
+	public:
+		void enable() {
+			set_range(sens, false);
+		}
+
+		virtual int32_t get_position() final {
+			return input;
+		}
+};
+
+struct Result {
+	uint64_t start_us = 0;		// Sum over direction changes that were followed
+	uint32_t starts = 0;
+	uint32_t missed = 0;		// Direction changes never followed
+	uint64_t stop_us = 0;
+	uint32_t stops = 0;
+	uint32_t false_dir = 0;
+};
+
+Result replay(const Trace& t, bool adaptive) {
+	Result r;
+	Eval_Axis axis;
+	axis.enable();
+	axis.set_config(sustain, 0, deadzone);
+	axis.set_adaptive(adaptive);
+
+	input = 0;
+	set_time(0);
+	axis.process();
+
+	int8_t intended = 0;
+	uint32_t change_time = 0;
+	bool pending = false;
+	int8_t last_dir = 0;
+	for(const Sample& s : t.samples) {
+		if(s.dir != intended) {
+			if(pending && intended) {
+				r.missed++;
+			}
+			intended = s.dir;
+			change_time = s.time;
+			pending = true;
+		}
+
+		input = s.pos;
+		set_time(s.time);
+		axis.process();
+
+		int8_t dir = axis.dir_state > 0 ? 1 : axis.dir_state < 0 ? -1 : 0;
+		if(pending && dir == intended) {
+			if(intended) {
+				r.start_us += s.time - change_time;
+				r.starts++;
+			} else {
+				r.stop_us += s.time - change_time;
+				r.stops++;
+			}
+			pending = false;
+		}
+		if(dir && dir != last_dir && dir != intended) {
+			r.false_dir++;
+		}
+		last_dir = dir;
+	}
+	return r;
+}
+
+uint32_t seed = 1;
+
+uint32_t rnd() {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+// Moves at speed counts per second for len us, or rests if speed is 0.
+struct Segment {
+	int32_t speed;
+	uint32_t len;
+};
+
+Trace make_trace(const char* name, std::vector<Segment> segments, int32_t wobble) {
+	Trace t = {name, {}};
+	uint32_t time = 0;
+	int64_t pos_milli = 0;
+	int32_t offset = 0;
+	for(const Segment& seg : segments) {
+		for(uint32_t end = time + seg.len; time < end; time += loop_us) {
+			pos_milli += int64_t(seg.speed) * loop_us / 1000;
+			int32_t pos = pos_milli / 1000;
+			// Wobble at rest, a few counts either side, changing every 5 ms
+			if(wobble && !seg.speed) {
+				if(time % 5000 == 0) {
+					offset = int32_t(rnd() % (2 * wobble + 1)) - wobble;
+				}
+				pos += offset;
+			}
+			t.samples.push_back({time, pos, int8_t(seg.speed > 0 ? 1 : seg.speed < 0 ? -1 : 0)});
+		}
+	}
+	return t;
+}
+
+bool load_trace(const char* path, Trace& t) {
+	FILE* f = fopen(path, "r");
+	if(!f) {
+		fprintf(stderr, "deadzone-eval: can't open %s\n", path);
+		return false;
+	}
+	t.name = path;
+	unsigned long time;
+	long pos;
+	int dir;
+	while(fscanf(f, "%lu %ld %d", &time, &pos, &dir) == 3) {
+		t.samples.push_back({uint32_t(time), int32_t(pos), int8_t(dir)});
+	}
+	fclose(f);
+	return !t.samples.empty();
+}
+
+void print(const char* mode, const Result& r) {
+	printf(" | %-8s %7.2f %7.2f %5u %5u", mode,
+		r.starts ? r.start_us / 1000.0 / r.starts : 0.0,
+		r.stops ? r.stop_us / 1000.0 / r.stops : 0.0,
+		r.missed, r.false_dir);
+}
+
+int main(int argc, char** argv) {
+	std::vector<Trace> traces;
+	if(argc > 1) {
+		for(int i = 1; i < argc; i++) {
+			Trace t;
+			if(!load_trace(argv[i], t)) {
+				return 1;
+			}
+			traces.push_back(t);
+		}
+	} else {
+		std::vector<Segment> slow, fast, scratch;
+		for(int i = 0; i < 10; i++) {
+			slow.push_back({0, 300000});
+			slow.push_back({i & 1 ? -400 : 400, 300000});
+		}
+		for(int i = 0; i < 40; i++) {
+			fast.push_back({i & 1 ? -4800 : 4800, 60000});
+		}
+		fast.push_back({0, 300000});
+		for(int i = 0; i < 20; i++) {
+			scratch.push_back({0, 200000});
+			scratch.push_back({2400, 40000});
+			scratch.push_back({-2400, 40000});
+		}
+		traces.push_back(make_trace("slow scratch", slow, 0));
+		traces.push_back(make_trace("wobble at rest", {{0, 5000000}}, 6));
+		traces.push_back(make_trace("fast reversals", fast, 0));
+		traces.push_back(make_trace("scratch + wobble", scratch, 2));
+	}
+
+	printf("%-18s | %-8s %7s %7s %5s %5s | %-8s %7s %7s %5s %5s\n", "trace",
+		"static", "start", "stop", "miss", "false", "adaptive", "start", "stop", "miss", "false");
+	for(const Trace& t : traces) {
+		printf("%-18s", t.name);
+		print("", replay(t, false));
+		print("", replay(t, true));
+		printf("\n");
+	}
+	printf("start and stop in ms\n");
+
+	return 0;
+}
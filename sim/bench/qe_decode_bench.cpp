@@ -0,0 +1,147 @@
+// Host microbenchmark for IntAxis::updateEncoder(): the table decoder in
+// roxy/axis.h against the switch on two pin reads it replaced, kept below
+// as the reference. Checks that both count the same on a random sequence
+// of single steps, then times each.
+//
+//   scons sim && build/sim/qe-decode-bench
+
+#include <chrono>
+#include <cstdio>
+
+#include "../../roxy/axis.h"
+
+Us_Clock us_clock;
+
+// updateEncoder() before the table rewrite, reading the pins one at a time.
+class Switch_Decoder {
+	private:
+		Pin a = GPIOA[1];
+		Pin b = GPIOA[7];
+		uint8_t state = 0;
+
+	public:
+		uint32_t count = 0;
+		uint16_t max_count = 255;
+
+		void enable() {
+			state = a.get() | (b.get() << 1);
+		}
+
+		__attribute__((noinline)) void updateEncoder() {
+			uint8_t newState = a.get() | (b.get() << 1);
+			int8_t delta = 0;
+			uint8_t tempState = state | (newState << 2);
+			state = newState;
+			switch (tempState) {
+				case 1:
+				case 7:
+				case 8:
+				case 14:
+					delta = 1;
+					break;
+				case 2:
+				case 4:
+				case 11:
+				case 13:
+					delta = -1;
+					break;
+				case 3:
+				case 12:
+					delta = 2;
+					break;
+				case 6:
+				case 9:
+					delta = -2;
+					break;
+			}
+			if(((int16_t)count + delta) < 0) {
+				count += max_count;
+			}
+			count += delta;
+			if(count >= max_count) {
+				count -= max_count;
+			}
+		}
+};
+
+class Bench_Int_Axis : public IntAxis {
+	public:
+		__attribute__((noinline)) void update() {
+			updateEncoder();
+		}
+};
+
+uint32_t seed = 1;
+
+uint32_t rnd() {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+// Gray sequence on PA1 (A) and PA7 (B)
+uint8_t phase = 0;
+
+void step(int dir) {
+	static const uint8_t gray[4] = {0, 1, 3, 2};
+	phase = (phase + dir) & 3;
+	uint8_t s = gray[phase];
+	GPIOA.reg.IDR = (GPIOA.reg.IDR & ~((1 << 1) | (1 << 7))) | ((s & 1) << 1) | (((s >> 1) & 1) << 7);
+}
+
+int main() {
+	const uint32_t steps = 20000000;
+
+	GPIOA.reg.IDR &= ~((1 << 1) | (1 << 7));
+
+	Switch_Decoder sw;
+	Bench_Int_Axis lut;
+	lut.set_pins(&GPIOA, 1, 7);
+	sw.enable();
+	lut.enable(false, 0, QE_FILTER_NONE);
+
+	// Lockstep check, comparing positions within the 255 count wrap
+	uint32_t mismatch = 0;
+	int dir = 1;
+	for(uint32_t i = 0; i < 1000000; i++) {
+		if(rnd() % 64 == 0) {
+			dir = -dir;
+		}
+		step(dir);
+		sw.updateEncoder();
+		lut.update();
+		int32_t wrapped = ((lut.get_position() % 255) + 255) % 255;
+		if(uint32_t(wrapped) != sw.count) {
+			mismatch++;
+		}
+	}
+
+	// Timing over a fixed sequence
+	uint8_t seq[256];
+	for(uint32_t i = 0; i < 256; i++) {
+		if(rnd() % 64 == 0) {
+			dir = -dir;
+		}
+		step(dir);
+		seq[i] = GPIOA.reg.IDR & 0xff;
+	}
+
+	double ns[2];
+	for(int k = 0; k < 2; k++) {
+		auto start = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < steps; i++) {
+			GPIOA.reg.IDR = (GPIOA.reg.IDR & ~0xff) | seq[i & 0xff];
+			if(k == 0) {
+				sw.updateEncoder();
+			} else {
+				lut.update();
+			}
+		}
+		ns[k] = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) / steps;
+	}
+
+	qe_pair_stats_t stats = lut.get_stats();
+	printf("%-10s %10s %10s %10s %10s\n", "mismatch", "switch ns", "table ns", "steps", "illegal");
+	printf("%-10u %10.2f %10.2f %10u %10u\n", mismatch, ns[0], ns[1], stats.steps, stats.illegal);
+
+	return mismatch ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+// Host replay of encoder spin traces through QEAxis, which unwraps the
+// 16-bit timer into a 32-bit position, against the turn-wrapped counter
+// it replaced, which the loop could only unwrap the short way round.
+//
+// A trace is the true encoder position at every main loop iteration, with
+// stalls showing up as longer gaps. Between iterations the timer is moved a
+// count at a time, raising its wrap and compare interrupts like the real one.
+// Built-in traces model scratches, steady spins and loop stalls; recorded
+// ones can be replayed as text files of "<us> <counts>" lines.
+//
+//   scons sim && build/sim/spin-replay [trace.txt...]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../../roxy/axis.h"
+
+Us_Clock us_clock;
+
+const int8_t sens = -127;	// 600 ppr, 2400 counts per turn
+const int32_t turn = 2400;
+
+struct Sample {
+	uint32_t time;	// us
+	int32_t pos;	// True position in counts
+};
+
+struct Trace {
+	const char* name;
+	std::vector<Sample> samples;
+};
+
+// Moves the microsecond clock to t, through the TIM15 wrap if needed.
+void set_time(uint32_t t) {
+	if((t & 0xffff) < TIM15.CNT) {
+		TIM15.SR |= 1 << 0;
+		us_clock.irq();
+	}
+	TIM15.CNT = t & 0xffff;
+}
+
+// The counter before QEAxis: ARR at the turn, read once per loop.
+class Wrapped_Axis : public Axis {
+	private:
+		int32_t counter = 0;
+		uint32_t last_cnt = 0;
+
+	public:
+		uint32_t cnt = 0;
+
+		void enable() {
+			set_range(sens, false);
+		}
+
+		virtual int32_t get_position() final {
+			int32_t delta = int32_t(cnt) - int32_t(last_cnt);
+			if(delta > turn / 2) {
+				delta -= turn;
+			} else if(delta < -turn / 2) {
+				delta += turn;
+			}
+			counter += delta;
+			last_cnt = cnt;
+			return counter;
+		}
+};
+
+QEAxis* axis_qe;
+
+template<>
+void interrupt<Interrupt::TIM2>() {
+	axis_qe->irq();
+}
+
+// One count at a time, as the encoder would move the timer.
+void move_timer(int32_t counts) {
+	int dir = counts < 0 ? -1 : 1;
+	for(int32_t i = 0; i < (counts < 0 ? -counts : counts); i++) {
+		uint32_t cnt = (TIM2.CNT + dir) & 0xffff;
+		uint32_t flags = 0;
+		if(cnt == (dir > 0 ? 0u : 0xffffu)) {
+			flags |= 1 << 0;
+		}
+		if(cnt == TIM2.CCR3) {
+			flags |= 1 << 3;
+		}
+		if(cnt == TIM2.CCR4) {
+			flags |= 1 << 4;
+		}
+		TIM2.CNT = cnt;
+		TIM2.SR |= flags;
+		if(flags & TIM2.DIER) {
+			interrupt<Interrupt::TIM2>();
+		}
+	}
+}
+
+struct Result {
+	uint32_t wrong_dir = 0;		// Loops reporting the opposite of the true direction
+	int32_t drift = 0;			// Final position error in counts
+	uint64_t vel_err = 0;		// Sum of |velocity error| in counts/s
+	uint32_t vel_n = 0;
+	double ns = 0;				// Per process() call
+};
+
+template <class A>
+void check(A& axis, const Sample& prev, const Sample& s, Result& r) {
+	int32_t moved = s.pos - prev.pos;
+	if((moved > 0 && axis.dir_state < 0) || (moved < 0 && axis.dir_state > 0)) {
+		r.wrong_dir++;
+	}
+}
+
+Result replay_wrapped(const Trace& trace) {
+	Result r;
+	Wrapped_Axis axis;
+	axis.enable();
+	axis.set_config(50000, 0, 0);
+	uint64_t ns = 0;
+	for(size_t i = 0; i < trace.samples.size(); i++) {
+		const Sample& s = trace.samples[i];
+		axis.cnt = ((s.pos % turn) + turn) % turn;
+		set_time(s.time);
+		auto start = std::chrono::steady_clock::now();
+		axis.process();
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if(i) {
+			check(axis, trace.samples[i - 1], s, r);
+		}
+	}
+	r.drift = axis.position - trace.samples.back().pos;
+	r.ns = double(ns) / trace.samples.size();
+	return r;
+}
+
+Result replay_qe(const Trace& trace) {
+	Result r;
+	memset((void*)&TIM2, 0, sizeof(TIM2));
+	QEAxis axis(TIM2, Interrupt::TIM2);
+	axis_qe = &axis;
+	axis.enable(false, sens);
+	axis.set_config(50000, 0, 0);
+	uint64_t ns = 0;
+	int32_t last = 0;
+	for(size_t i = 0; i < trace.samples.size(); i++) {
+		const Sample& s = trace.samples[i];
+		move_timer(s.pos - last);
+		last = s.pos;
+		set_time(s.time);
+		auto start = std::chrono::steady_clock::now();
+		axis.process();
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if(i) {
+			check(axis, trace.samples[i - 1], s, r);
+		}
+
+		// Against the true rate over the window that just closed, once one has.
+		if(i && s.time >= AXIS_VELOCITY_WINDOW_US * 2) {
+			size_t j = i;
+			while(j > 0 && s.time - trace.samples[j].time < AXIS_VELOCITY_WINDOW_US) {
+				j--;
+			}
+			int64_t truth = int64_t(s.pos - trace.samples[j].pos) * 1000000 / int32_t(s.time - trace.samples[j].time);
+			int64_t err = axis.velocity - truth;
+			r.vel_err += err < 0 ? -err : err;
+			r.vel_n++;
+		}
+	}
+	r.drift = axis.position - trace.samples.back().pos;
+	r.ns = double(ns) / trace.samples.size();
+	return r;
+}
+
+uint32_t seed = 1;
+
+uint32_t rnd() {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 16;
+}
+
+// Loop runs every 250 us. speed is in counts per second, stalls are
+// {every, length} in us.
+Trace make_trace(const char* name, uint32_t length_us, int32_t speed, bool scratch, uint32_t stall_every, uint32_t stall_len) {
+	Trace t = {name, {}};
+	int64_t pos_milli = 0;
+	uint32_t time = 0;
+	uint32_t next_stall = stall_every;
+	int32_t v = speed;
+	while(time < length_us) {
+		uint32_t step = 250;
+		if(stall_every && time >= next_stall) {
+			step = stall_len;
+			next_stall += stall_every;
+		}
+		if(scratch && rnd() % 200 == 0) {
+			v = int32_t(rnd() % (2 * speed + 1)) - speed;
+		}
+		time += step;
+		pos_milli += int64_t(v) * step / 1000;
+		t.samples.push_back({time, int32_t(pos_milli / 1000)});
+	}
+	return t;
+}
+
+bool load_trace(const char* path, Trace& t) {
+	FILE* f = fopen(path, "r");
+	if(!f) {
+		fprintf(stderr, "spin-replay: can't open %s\n", path);
+		return false;
+	}
+	t.name = path;
+	unsigned long time;
+	long pos;
+	while(fscanf(f, "%lu %ld", &time, &pos) == 2) {
+		t.samples.push_back({uint32_t(time), int32_t(pos)});
+	}
+	fclose(f);
+	return !t.samples.empty();
+}
+
+int main(int argc, char** argv) {
+	std::vector<Trace> traces;
+	if(argc > 1) {
+		for(int i = 1; i < argc; i++) {
+			Trace t;
+			if(!load_trace(argv[i], t)) {
+				return 1;
+			}
+			traces.push_back(t);
+		}
+	} else {
+		traces.push_back(make_trace("scratch", 5000000, 20000, true, 0, 0));
+		traces.push_back(make_trace("spin 10/s", 5000000, 24000, false, 0, 0));
+		traces.push_back(make_trace("spin 5ms stalls", 5000000, 24000, false, 50000, 5000));
+		traces.push_back(make_trace("spin 60ms stalls", 5000000, -24000, false, 200000, 60000));
+		traces.push_back(make_trace("spin 2s stall", 5000000, 30000, false, 2000000, 2000000));
+	}
+
+	bool ok = true;
+	printf("%-18s %8s | %10s %10s %8s | %10s %10s %10s %8s\n", "trace", "loops",
+		"wrap dir", "wrap drift", "wrap ns", "qe dir", "qe drift", "vel err/s", "qe ns");
+	for(const Trace& t : traces) {
+		Result w = replay_wrapped(t);
+		Result q = replay_qe(t);
+		if(q.wrong_dir || q.drift) {
+			ok = false;
+		}
+		printf("%-18s %8zu | %10u %10d %8.2f | %10u %10d %10llu %8.2f\n", t.name, t.samples.size(),
+			w.wrong_dir, w.drift, w.ns,
+			q.wrong_dir, q.drift, q.vel_n ? (unsigned long long)(q.vel_err / q.vel_n) : 0ull, q.ns);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+#ifndef SIM_ADC_F3_H
+#define SIM_ADC_F3_H
+
+#include <stdint.h>
+
+#include "../sim_reg.h"
+
+// ADSTART completes instantly; DR holds whatever the simulator last drove.
+struct ADC_t {
+	volatile uint32_t ISR;
+	volatile uint32_t IER;
+	sim_reg_t<(1 << 2)> CR;
+	volatile uint32_t CFGR;
+	volatile uint32_t RESERVED0;
+	volatile uint32_t SMPR1;
+	volatile uint32_t SMPR2;
+	volatile uint32_t RESERVED1;
+	volatile uint32_t TR1;
+	volatile uint32_t TR2;
+	volatile uint32_t TR3;
+	volatile uint32_t RESERVED2;
+	volatile uint32_t SQR1;
+	volatile uint32_t SQR2;
+	volatile uint32_t SQR3;
+	volatile uint32_t SQR4;
+	volatile uint32_t DR;
+
+	ADC_t() : ISR(1), CR() {}
+};
+
+inline ADC_t ADC1;
+inline ADC_t ADC2;
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SIM_DMA_H
+#define SIM_DMA_H
+
+#include <stdint.h>
+
+struct DMA_channel_reg_t {
+	volatile uint32_t CR;
+	volatile uint32_t NDTR;
+	volatile uintptr_t PAR;		// Pointer width on the host, 32 bits on the MCU
+	volatile uintptr_t MAR;
+	volatile uint32_t RESERVED;
+};
+
+struct DMA_reg_t {
+	volatile uint32_t ISR;
+	volatile uint32_t IFCR;
+	DMA_channel_reg_t C[7];
+};
+
+// PAR and MAR hold whole host pointers, so the transfers the simulator paces
+// from timers can follow them; memory to peripheral transfers just complete.
+class DMA_t {
+	public:
+		DMA_reg_t reg;
+};
+
+inline DMA_t DMA1;
+inline DMA_t DMA2;
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef SIM_GPIO_H
+#define SIM_GPIO_H
+
+#include <stdint.h>
+
+class GPIO_t {
+	public:
+		struct GPIO_reg_t {
+			volatile uint32_t MODER;
+			volatile uint32_t OTYPER;
+			volatile uint32_t OSPEEDR;
+			volatile uint32_t PUPDR;
+			volatile uint32_t IDR;
+			volatile uint32_t ODR;
+			volatile uint32_t BSRR;
+			volatile uint32_t LCKR;
+			volatile uint32_t AFRL;
+			volatile uint32_t AFRH;
+			volatile uint32_t BRR;
+		};
+
+		class Pin {
+			private:
+				GPIO_t* g;
+				uint32_t n;
+
+			public:
+				enum Mode {
+					Input,
+					Output,
+					AF,
+					Analog,
+				};
+
+				enum Type {
+					PushPull,
+					OpenDrain,
+				};
+
+				enum Pull {
+					PullNone,
+					PullUp,
+					PullDown,
+				};
+
+				enum Speed {
+					Low,
+					Medium,
+					High = 3,
+				};
+
+				Pin(GPIO_t& gpio, uint32_t pin) : g(&gpio), n(pin) {}
+
+				void set_mode(Mode m) {
+					g->reg.MODER = (g->reg.MODER & ~(3 << (n * 2))) | (m << (n * 2));
+				}
+
+				void set_type(Type t) {
+					g->reg.OTYPER = (g->reg.OTYPER & ~(1 << n)) | (t << n);
+				}
+
+				void set_speed(Speed s) {
+					g->reg.OSPEEDR = (g->reg.OSPEEDR & ~(3 << (n * 2))) | (s << (n * 2));
+				}
+
+				void set_pull(Pull p) {
+					g->reg.PUPDR = (g->reg.PUPDR & ~(3 << (n * 2))) | (p << (n * 2));
+				}
+
+				void set_af(int af) {
+					if(n < 8) {
+						g->reg.AFRL = (g->reg.AFRL & ~(0xf << (n * 4))) | (af << (n * 4));
+					} else {
+						g->reg.AFRH = (g->reg.AFRH & ~(0xf << (n * 4 - 32))) | (af << (n * 4 - 32));
+					}
+				}
+
+				void on() {
+					g->reg.ODR |= 1 << n;
+				}
+
+				void off() {
+					g->reg.ODR &= ~(1 << n);
+				}
+
+				void set(bool value) {
+					if(value) {
+						on();
+					} else {
+						off();
+					}
+				}
+
+				void toggle() {
+					g->reg.ODR ^= 1 << n;
+				}
+
+				bool get() {
+					return g->reg.IDR & (1 << n);
+				}
+
+				GPIO_t& port() {
+					return *g;
+				}
+
+				uint32_t index() {
+					return n;
+				}
+		};
+
+		GPIO_reg_t reg;
+
+		// Inputs idle high, as if every pin had its pull-up enabled.
+		GPIO_t() : reg() {
+			reg.IDR = 0xffff;
+		}
+
+		Pin operator[](uint32_t pin) {
+			return Pin(*this, pin);
+		}
+};
+
+typedef GPIO_t::Pin Pin;
+
+inline GPIO_t GPIOA;
+inline GPIO_t GPIOB;
+inline GPIO_t GPIOC;
+inline GPIO_t GPIOD;
+inline GPIO_t GPIOE;
+inline GPIO_t GPIOF;
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef SIM_EXTI_H
+#define SIM_EXTI_H
+
+#include <stdint.h>
+
+struct EXTI_t {
+	volatile uint32_t IMR1;
+	volatile uint32_t EMR1;
+	volatile uint32_t RTSR1;
+	volatile uint32_t FTSR1;
+	volatile uint32_t SWIER1;
+	volatile uint32_t PR1;
+	volatile uint32_t RESERVED[2];
+	volatile uint32_t IMR2;
+	volatile uint32_t EMR2;
+	volatile uint32_t RTSR2;
+	volatile uint32_t FTSR2;
+	volatile uint32_t SWIER2;
+	volatile uint32_t PR2;
+};
+
+inline EXTI_t EXTI;
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SIM_INTERRUPT_H
+#define SIM_INTERRUPT_H
+
+#include <stdint.h>
+
+struct SCB_t {
+	volatile uint32_t CPUID;
+	volatile uint32_t ICSR;
+	volatile uintptr_t VTOR;	// Pointer width on the host
+	volatile uint32_t AIRCR;
+	volatile uint32_t SCR;
+	volatile uint32_t CCR;
+	volatile uint8_t SHPR[12];
+	volatile uint32_t SHCSR;
+	volatile uint32_t CFSR;
+	volatile uint32_t HFSR;
+	volatile uint32_t DFSR;
+	volatile uint32_t MMFAR;
+	volatile uint32_t BFAR;
+	volatile uint32_t AFSR;
+	volatile uint32_t CPACR;
+};
+
+struct NVIC_t {
+	volatile uint32_t ISER[32];
+	volatile uint32_t ICER[32];
+	volatile uint32_t ISPR[32];
+	volatile uint32_t ICPR[32];
+	volatile uint32_t IABR[64];
+	volatile uint8_t IPR[240];
+};
+
+inline SCB_t SCB;
+inline NVIC_t NVIC;
+
+namespace Interrupt {
+	// STM32F303 vector numbers.
+	enum IRQ {
+		EXTI0 = 6,
+		EXTI1 = 7,
+		EXTI2_TSC = 8,
+		EXTI3 = 9,
+		EXTI4 = 10,
+		DMA1_Channel1 = 11,
+		DMA1_Channel2 = 12,
+		DMA1_Channel3 = 13,
+		DMA1_Channel4 = 14,
+		DMA1_Channel5 = 15,
+		DMA1_Channel6 = 16,
+		DMA1_Channel7 = 17,
+		ADC1_2 = 18,
+		USB_HP_CAN_TX = 19,
+		USB_LP_CAN_RX0 = 20,
+		EXTI9_5 = 23,
+		TIM1_BRK_TIM15 = 24,
+		TIM1_UP_TIM16 = 25,
+		TIM1_TRG_COM_TIM17 = 26,
+		TIM1_CC = 27,
+		TIM2 = 28,
+		TIM3 = 29,
+		TIM4 = 30,
+		SPI1 = 35,
+		SPI2 = 36,
+		EXTI15_10 = 40,
+		TIM8_UP = 44,
+		TIM8_CC = 46,
+		SPI3 = 51,
+		TIM6 = 54,
+		TIM7 = 55,
+		DMA2_Channel1 = 56,
+		DMA2_Channel2 = 57,
+		DMA2_Channel3 = 58,
+		DMA2_Channel4 = 59,
+		DMA2_Channel5 = 60,
+	};
+
+	inline void enable(IRQ n) {
+		NVIC.ISER[n >> 5] |= 1 << (n & 0x1f);
+	}
+
+	inline void disable(IRQ n) {
+		NVIC.ISER[n >> 5] &= ~(1 << (n & 0x1f));
+	}
+
+	inline bool is_enabled(IRQ n) {
+		return NVIC.ISER[n >> 5] & (1 << (n & 0x1f));
+	}
+
+	inline void set_priority(IRQ n, uint8_t priority) {
+		NVIC.IPR[n] = priority;
+	}
+};
+
+template<Interrupt::IRQ>
+void interrupt();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SIM_TIME_H
+#define SIM_TIME_H
+
+#include <stdint.h>
+
+#include "../../sim.h"
+
+struct STK_t {
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+	volatile uint32_t CALIB;
+};
+
+inline STK_t STK;
+
+namespace Time {
+	inline uint32_t time() {
+		return Sim::systick_ms;
+	}
+
+	inline void sleep(uint32_t ms) {
+		Sim::advance(ms * 1000);
+	}
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef SIM_FLASH_H
+#define SIM_FLASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+void sim_flash_cr_written(uint32_t cr);
+
+// Writing STRT with PER erases the page at AR. PG only counts the program
+// operation, the write itself goes straight to the RAM image mapped over
+// the flash address range by the simulator. BSY never needs to be set,
+// instead the time the operations take at the datasheet maximum adds up
+// in sim_flash_busy_us, for the simulator to stall the main loop by.
+struct sim_flash_cr_t {
+	volatile uint32_t v;
+
+	operator uint32_t() const {
+		return v;
+	}
+
+	sim_flash_cr_t& operator=(uint32_t x) {
+		v = x & ~(1 << 6);	// STRT
+		sim_flash_cr_written(x);
+		return *this;
+	}
+};
+
+struct FLASH_t {
+	volatile uint32_t ACR;
+	volatile uint32_t KEYR;
+	volatile uint32_t OPTKEYR;
+	volatile uint32_t SR;
+	sim_flash_cr_t CR;
+	volatile uint32_t AR;
+	volatile uint32_t RESERVED;
+	volatile uint32_t OBR;
+	volatile uint32_t WRPR;
+};
+
+inline FLASH_t FLASH;
+
+inline uint32_t sim_flash_erases;
+inline uint32_t sim_flash_programs;
+inline uint32_t sim_flash_busy_us;
+
+inline void sim_flash_cr_written(uint32_t cr) {
+	if((cr & (1 << 6)) && (cr & (1 << 1))) {
+		memset((void*)(uintptr_t)(FLASH.AR & ~2047u), 0xff, 2048);
+		sim_flash_erases++;
+		sim_flash_busy_us += 40000;
+	} else if(cr & (1 << 0)) {
+		sim_flash_programs++;
+		sim_flash_busy_us += 60;
+	}
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SIM_RCC_H
+#define SIM_RCC_H
+
+#include <stdint.h>
+
+struct RCC_t {
+	enum AHBPeriph {
+		DMA1, DMA2, CRC, GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, ADC12, ADC34,
+	};
+	enum APB1Periph {
+		TIM2 = 32, TIM3, TIM4, TIM6, TIM7, SPI2, SPI3, USB,
+	};
+	enum APB2Periph {
+		SYSCFG = 64, TIM1, SPI1, TIM8, TIM15, TIM16, TIM17,
+	};
+
+	volatile uint32_t CR;
+	volatile uint32_t CFGR;
+	volatile uint32_t CIR;
+	volatile uint32_t APB2RSTR;
+	volatile uint32_t APB1RSTR;
+	volatile uint32_t AHBENR;
+	volatile uint32_t APB2ENR;
+	volatile uint32_t APB1ENR;
+	volatile uint32_t BDCR;
+	volatile uint32_t CSR;
+	volatile uint32_t AHBRSTR;
+	volatile uint32_t CFGR2;
+	volatile uint32_t CFGR3;
+
+	void enable(uint32_t periph) {
+		volatile uint32_t* enr[] = {&AHBENR, &APB1ENR, &APB2ENR};
+		*enr[periph / 32] |= 1 << (periph % 32);
+	}
+};
+
+inline RCC_t RCC;
+
+inline void rcc_init() {}
+
+#endif
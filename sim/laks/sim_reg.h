@@ -0,0 +1,65 @@
+#ifndef SIM_REG_H
+#define SIM_REG_H
+
+#include <stdint.h>
+
+// Register whose bits in self_clear are cleared by "hardware" as soon as
+// they are written, e.g. ADSTART on the ADC. Everything else behaves like a
+// plain volatile uint32_t.
+template <uint32_t self_clear>
+struct sim_reg_t {
+	volatile uint32_t v;
+
+	operator uint32_t() const {
+		return v;
+	}
+
+	sim_reg_t& operator=(uint32_t x) {
+		v = x & ~self_clear;
+		return *this;
+	}
+
+	sim_reg_t& operator|=(uint32_t x) {
+		v = (v | x) & ~self_clear;
+		return *this;
+	}
+
+	sim_reg_t& operator&=(uint32_t x) {
+		v = v & x;
+		return *this;
+	}
+};
+
+// Flag register where writing 0 clears a bit and writing 1 leaves it alone
+// (rc_w0), e.g. USB_ISTR.
+struct sim_rc_w0_t {
+	volatile uint32_t v;
+
+	operator uint32_t() const {
+		return v;
+	}
+
+	sim_rc_w0_t& operator=(uint32_t x) {
+		v = v & x;
+		return *this;
+	}
+};
+
+// USB endpoint register: CTR_RX/CTR_TX are rc_w0, DTOG and STAT bits toggle
+// when written as 1, the rest is plain read/write.
+struct sim_epr_t {
+	volatile uint32_t v;
+
+	operator uint32_t() const {
+		return v;
+	}
+
+	sim_epr_t& operator=(uint32_t x) {
+		const uint32_t ctr = 0x8080;
+		const uint32_t toggle = 0x7070;
+		v = (v & x & ctr) | ((v ^ x) & toggle) | (x & ~(ctr | toggle) & 0xffff);
+		return *this;
+	}
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include <stdint.h>
+
+struct SPI_reg_t {
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t SR;
+	union {
+		volatile uint32_t DR;
+		volatile uint8_t DR8;
+	};
+	volatile uint32_t CRCPR;
+	volatile uint32_t RXCRCR;
+	volatile uint32_t TXCRCR;
+	volatile uint32_t I2SCFGR;
+	volatile uint32_t I2SPR;
+};
+
+class SPI_t {
+	public:
+		SPI_reg_t reg;
+};
+
+inline SPI_t SPI1;
+inline SPI_t SPI2;
+inline SPI_t SPI3;
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef SIM_SYSCFG_H
+#define SIM_SYSCFG_H
+
+#include <stdint.h>
+
+struct SYSCFG_t {
+	volatile uint32_t CFGR1;
+	volatile uint32_t RCR;
+	volatile uint32_t EXTICR[4];
+	volatile uint32_t CFGR2;
+};
+
+inline SYSCFG_t SYSCFG;
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SIM_TIMER_H
+#define SIM_TIMER_H
+
+#include <stdint.h>
+
+struct TIM_t {
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t SMCR;
+	volatile uint32_t DIER;
+	volatile uint32_t SR;
+	volatile uint32_t EGR;
+	volatile uint32_t CCMR1;
+	volatile uint32_t CCMR2;
+	volatile uint32_t CCER;
+	volatile uint32_t CNT;
+	volatile uint32_t PSC;
+	volatile uint32_t ARR;
+	volatile uint32_t RCR;
+	volatile uint32_t CCR1;
+	volatile uint32_t CCR2;
+	volatile uint32_t CCR3;
+	volatile uint32_t CCR4;
+	volatile uint32_t BDTR;
+	volatile uint32_t DCR;
+	volatile uint32_t DMAR;
+};
+
+inline TIM_t TIM1;
+inline TIM_t TIM2;
+inline TIM_t TIM3;
+inline TIM_t TIM4;
+inline TIM_t TIM6;
+inline TIM_t TIM7;
+inline TIM_t TIM8;
+inline TIM_t TIM15;
+inline TIM_t TIM16;
+inline TIM_t TIM17;
+
+#endif
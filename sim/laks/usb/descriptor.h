@@ -0,0 +1,83 @@
+#ifndef SIM_USB_DESCRIPTOR_H
+#define SIM_USB_DESCRIPTOR_H
+
+#include <stdint.h>
+
+// Descriptors are built as flat packed byte arrays so sizeof() matches what
+// goes on the wire, like the real laks descriptor templates.
+template <uint32_t N>
+struct desc_bytes_t {
+	uint8_t b[N];
+} __attribute__((packed));
+
+template <>
+struct desc_bytes_t<0> {};
+
+template <uint32_t A, uint32_t B>
+constexpr desc_bytes_t<A + B> operator+(const desc_bytes_t<A>& a, const desc_bytes_t<B>& b) {
+	desc_bytes_t<A + B> r = {};
+	for(uint32_t i = 0; i < A; i++) {
+		r.b[i] = a.b[i];
+	}
+	for(uint32_t i = 0; i < B; i++) {
+		r.b[A + i] = b.b[i];
+	}
+	return r;
+}
+
+template <uint32_t B>
+constexpr desc_bytes_t<B> operator+(const desc_bytes_t<0>&, const desc_bytes_t<B>& b) {
+	return b;
+}
+
+template <typename... T>
+constexpr auto pack(T... data) {
+	return (desc_bytes_t<0>() + ... + data);
+}
+
+constexpr desc_bytes_t<18> device_desc(uint16_t bcdUSB, uint8_t bDeviceClass, uint8_t bDeviceSubClass, uint8_t bDeviceProtocol, uint8_t bMaxPacketSize0, uint16_t idVendor, uint16_t idProduct, uint16_t bcdDevice, uint8_t iManufacturer, uint8_t iProduct, uint8_t iSerialNumber, uint8_t bNumConfigurations) {
+	return {{
+		18, 0x01,
+		uint8_t(bcdUSB), uint8_t(bcdUSB >> 8),
+		bDeviceClass, bDeviceSubClass, bDeviceProtocol, bMaxPacketSize0,
+		uint8_t(idVendor), uint8_t(idVendor >> 8),
+		uint8_t(idProduct), uint8_t(idProduct >> 8),
+		uint8_t(bcdDevice), uint8_t(bcdDevice >> 8),
+		iManufacturer, iProduct, iSerialNumber, bNumConfigurations,
+	}};
+}
+
+template <typename... T>
+constexpr auto configuration_desc(uint8_t bNumInterfaces, uint8_t bConfigurationValue, uint8_t iConfiguration, uint8_t bmAttributes, uint8_t bMaxPower, T... data) {
+	constexpr uint32_t len = (9 + ... + sizeof(T));
+	desc_bytes_t<9> header = {{
+		9, 0x02, uint8_t(len), uint8_t(len >> 8),
+		bNumInterfaces, bConfigurationValue, iConfiguration, bmAttributes, bMaxPower,
+	}};
+	return (header + ... + data);
+}
+
+template <typename... T>
+constexpr auto interface_desc(uint8_t bInterfaceNumber, uint8_t bAlternateSetting, uint8_t bNumEndpoints, uint8_t bInterfaceClass, uint8_t bInterfaceSubClass, uint8_t bInterfaceProtocol, uint8_t iInterface, T... data) {
+	desc_bytes_t<9> header = {{
+		9, 0x04, bInterfaceNumber, bAlternateSetting, bNumEndpoints,
+		bInterfaceClass, bInterfaceSubClass, bInterfaceProtocol, iInterface,
+	}};
+	return (header + ... + data);
+}
+
+constexpr desc_bytes_t<9> hid_desc(uint16_t bcdHID, uint8_t bCountryCode, uint8_t bNumDescriptors, uint8_t bDescriptorType, uint16_t wDescriptorLength) {
+	return {{
+		9, 0x21, uint8_t(bcdHID), uint8_t(bcdHID >> 8), bCountryCode, bNumDescriptors,
+		bDescriptorType, uint8_t(wDescriptorLength), uint8_t(wDescriptorLength >> 8),
+	}};
+}
+
+constexpr desc_bytes_t<7> endpoint_desc(uint8_t bEndpointAddress, uint8_t bmAttributes, uint16_t wMaxPacketSize, uint8_t bInterval) {
+	return {{
+		7, 0x05, bEndpointAddress, bmAttributes,
+		uint8_t(wMaxPacketSize), uint8_t(wMaxPacketSize >> 8), bInterval,
+	}};
+}
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef SIM_USB_HID_H
+#define SIM_USB_HID_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "descriptor.h"
+#include "usb.h"
+
+namespace UsagePage {
+	enum {
+		Desktop = 0x01,
+		Simulation = 0x02,
+		KeyCodes = 0x07,
+		LED = 0x08,
+		Button = 0x09,
+		Ordinal = 0x0a,
+		Consumer = 0x0c,
+	};
+};
+
+namespace DesktopUsage {
+	enum {
+		Pointer = 0x01,
+		Mouse = 0x02,
+		Joystick = 0x04,
+		GamePad = 0x05,
+		Keyboard = 0x06,
+		KeyCodes = 0x07,
+		X = 0x30,
+		Y = 0x31,
+		Z = 0x32,
+		Rx = 0x33,
+		Ry = 0x34,
+		Rz = 0x35,
+		Slider = 0x36,
+		Dial = 0x37,
+		Wheel = 0x38,
+		ResolutionMultiplier = 0x48,
+	};
+};
+
+namespace Collection {
+	enum {
+		Physical = 0x00,
+		Application = 0x01,
+		Logical = 0x02,
+	};
+};
+
+constexpr desc_bytes_t<2> hid_item1(uint8_t prefix, uint8_t value) {
+	return {{uint8_t(prefix | 1), value}};
+}
+
+constexpr desc_bytes_t<3> hid_item2(uint8_t prefix, uint16_t value) {
+	return {{uint8_t(prefix | 2), uint8_t(value), uint8_t(value >> 8)}};
+}
+
+constexpr auto input(uint8_t flags) { return hid_item1(0x80, flags); }
+constexpr auto output(uint8_t flags) { return hid_item1(0x90, flags); }
+constexpr auto feature(uint8_t flags) { return hid_item1(0xb0, flags); }
+
+constexpr auto usage_page(uint16_t page) { return hid_item2(0x04, page); }
+constexpr auto logical_minimum(int16_t v) { return hid_item2(0x14, v); }
+constexpr auto logical_maximum(int16_t v) { return hid_item2(0x24, v); }
+constexpr auto physical_minimum(int16_t v) { return hid_item2(0x34, v); }
+constexpr auto physical_maximum(int16_t v) { return hid_item2(0x44, v); }
+constexpr auto unit_exponent(uint8_t v) { return hid_item1(0x54, v); }
+constexpr auto unit(uint16_t v) { return hid_item2(0x64, v); }
+constexpr auto report_size(uint8_t v) { return hid_item1(0x74, v); }
+constexpr auto report_id(uint8_t v) { return hid_item1(0x84, v); }
+constexpr auto report_count(uint8_t v) { return hid_item1(0x94, v); }
+
+constexpr auto usage(uint16_t v) { return hid_item2(0x08, v); }
+constexpr auto usage_minimum(uint16_t v) { return hid_item2(0x18, v); }
+constexpr auto usage_maximum(uint16_t v) { return hid_item2(0x28, v); }
+constexpr auto string_index(uint8_t v) { return hid_item1(0x78, v); }
+
+template <typename... T>
+constexpr auto collection(uint8_t type, T... data) {
+	return (hid_item1(0xa0, type) + ... + data) + desc_bytes_t<1>{{0xc0}};
+}
+
+constexpr auto buttons(uint8_t num) {
+	return pack(
+		usage_page(UsagePage::Button),
+		usage_minimum(1),
+		usage_maximum(num),
+		logical_minimum(0),
+		logical_maximum(1),
+		report_size(1),
+		report_count(num),
+		input(0x02),
+		report_size(1),
+		report_count((8 - num % 8) % 8),
+		input(0x01)
+	);
+}
+
+constexpr auto padding_in(uint8_t bits) {
+	return pack(report_size(1), report_count(bits), input(0x01));
+}
+
+constexpr auto padding_out(uint8_t bits) {
+	return pack(report_size(1), report_count(bits), output(0x01));
+}
+
+template <typename... T>
+constexpr auto joystick(T... data) {
+	return pack(
+		usage_page(UsagePage::Desktop),
+		usage(DesktopUsage::Joystick),
+		collection(Collection::Application, data...)
+	);
+}
+
+template <typename... T>
+constexpr auto gamepad(T... data) {
+	return pack(
+		usage_page(UsagePage::Desktop),
+		usage(DesktopUsage::GamePad),
+		collection(Collection::Application, data...)
+	);
+}
+
+template <typename... T>
+constexpr auto keyboard(T... data) {
+	return pack(
+		usage_page(UsagePage::Desktop),
+		usage(DesktopUsage::Keyboard),
+		collection(Collection::Application, data...)
+	);
+}
+
+template <typename... T>
+constexpr auto mouse(T... data) {
+	return pack(
+		usage_page(UsagePage::Desktop),
+		usage(DesktopUsage::Mouse),
+		collection(Collection::Application,
+			usage(DesktopUsage::Pointer),
+			collection(Collection::Physical, data...)
+		)
+	);
+}
+
+// Class driver for one HID interface. Report requests from the host are fed
+// in by the simulator through USB_f1::sim_control().
+class USB_HID : public USB_class_driver {
+	protected:
+		USB_generic& usb;
+		desc_t report_desc;
+		uint8_t interface;
+		uint8_t endpoint;
+		uint32_t ep_size;
+
+		uint8_t pending_request;
+		uint16_t pending_value;
+
+		virtual bool set_output_report(uint32_t*, uint32_t) {
+			return false;
+		}
+
+		virtual bool set_feature_report(uint32_t*, uint32_t) {
+			return false;
+		}
+
+		virtual bool get_feature_report(uint8_t) {
+			return false;
+		}
+
+		virtual SetupStatus handle_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+			if(wIndex != interface) {
+				return SetupStatus::Unhandled;
+			}
+
+			// Get report descriptor.
+			if(bmRequestType == 0x81 && bRequest == 0x06 && wValue == 0x2200) {
+				usb.write(0, (uint32_t*)report_desc.data, report_desc.size > wLength ? wLength : report_desc.size);
+				return SetupStatus::Ok;
+			}
+
+			// Set report, data stage follows.
+			if(bmRequestType == 0x21 && bRequest == 0x09) {
+				pending_request = bRequest;
+				pending_value = wValue;
+				return SetupStatus::Ok;
+			}
+
+			// Get feature report.
+			if(bmRequestType == 0xa1 && bRequest == 0x01 && (wValue >> 8) == 3) {
+				return get_feature_report(wValue & 0xff) ? SetupStatus::Ok : SetupStatus::Stall;
+			}
+
+			return SetupStatus::Unhandled;
+		}
+
+		virtual void handle_out(uint8_t ep, uint32_t len) {
+			if(ep != 0 || !pending_request) {
+				return;
+			}
+			pending_request = 0;
+
+			uint32_t buf[16];
+			len = usb.read(0, buf, len);
+
+			bool ok = false;
+			switch(pending_value >> 8) {
+				case 2:
+					ok = set_output_report(buf, len);
+					break;
+
+				case 3:
+					ok = set_feature_report(buf, len);
+					break;
+			}
+
+			if(ok) {
+				usb.write(0, nullptr, 0);
+			}
+		}
+
+	public:
+		USB_HID(USB_generic& usbd, desc_t rdesc, uint8_t iface, uint8_t ep, uint32_t size) :
+			usb(usbd), report_desc(rdesc), interface(iface), endpoint(ep), ep_size(size), pending_request(0), pending_value(0) {
+			usb.register_driver(this);
+		}
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef SIM_USB_H
+#define SIM_USB_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../../sim.h"
+#include "../sim_reg.h"
+
+struct desc_t {
+	uint32_t size;
+	void* data;
+};
+
+enum class SetupStatus {
+	Unhandled,
+	Ok,
+	Stall,
+};
+
+class USB_class_driver {
+	friend class USB_generic;
+
+	protected:
+		virtual SetupStatus handle_setup(uint8_t, uint8_t, uint16_t, uint16_t, uint16_t) {
+			return SetupStatus::Unhandled;
+		}
+
+		virtual void handle_set_configuration(uint8_t) {}
+
+		virtual void handle_out(uint8_t, uint32_t) {}
+};
+
+class USB_generic {
+	private:
+		USB_class_driver* drivers[8];
+		uint32_t num_drivers;
+
+	protected:
+		desc_t dev_desc;
+		desc_t conf_desc;
+
+		// Runs a control transfer through the registered class drivers the
+		// same way the setup/data stages would arrive from the host.
+		bool control(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength, uint32_t out_len) {
+			for(uint32_t i = 0; i < num_drivers; i++) {
+				SetupStatus status = drivers[i]->handle_setup(bmRequestType, bRequest, wValue, wIndex, wLength);
+				if(status == SetupStatus::Unhandled) {
+					continue;
+				}
+				if(status == SetupStatus::Ok && !(bmRequestType & 0x80) && out_len) {
+					drivers[i]->handle_out(0, out_len);
+				}
+				return status == SetupStatus::Ok;
+			}
+			return false;
+		}
+
+		void set_configuration(uint8_t configuration) {
+			for(uint32_t i = 0; i < num_drivers; i++) {
+				drivers[i]->handle_set_configuration(configuration);
+			}
+		}
+
+	public:
+		USB_generic(desc_t dev, desc_t conf) : num_drivers(0), dev_desc(dev), conf_desc(conf) {}
+
+		bool register_driver(USB_class_driver* driver) {
+			if(num_drivers >= 8) {
+				return false;
+			}
+			drivers[num_drivers++] = driver;
+			return true;
+		}
+
+		virtual bool ep_ready(uint32_t ep) = 0;
+		virtual void write(uint32_t ep, uint32_t* bufp, uint32_t len) = 0;
+		virtual uint32_t read(uint32_t ep, uint32_t* bufp, uint32_t len) = 0;
+};
+
+struct USB_reg_t {
+	sim_epr_t EPR[16];
+	volatile uint32_t CNTR;
+	sim_rc_w0_t ISTR;
+	volatile uint32_t FNR;
+	volatile uint32_t DADDR;
+	volatile uint32_t BTABLE;
+	volatile uint32_t LPMCSR;
+	volatile uint32_t BCDR;
+};
+
+class USB_t {
+	public:
+		USB_reg_t reg;
+};
+
+inline USB_t USB;
+
+// Endpoint timing comes from the simulator's host model: every interrupt IN
+// endpoint is polled once per 1 ms frame.
+class USB_f1 : public USB_generic, public Sim::USB_device {
+	private:
+		USB_t& usb;
+		uint8_t out_buf[64];
+		uint32_t out_len;
+
+	public:
+		USB_f1(USB_t& usb_periph, desc_t dev, desc_t conf) : USB_generic(dev, conf), usb(usb_periph), out_len(0) {}
+
+		void init() {
+			Sim::attach(this, (const uint8_t*)conf_desc.data);
+			set_configuration(1);
+		}
+
+		void process() {
+			Sim::loop_hook();
+		}
+
+		virtual bool ep_ready(uint32_t ep) {
+			return Sim::ep_ready(ep);
+		}
+
+		virtual void write(uint32_t ep, uint32_t* bufp, uint32_t len) {
+			Sim::ep_write(ep, (const uint8_t*)bufp, len);
+		}
+
+		virtual uint32_t read(uint32_t, uint32_t* bufp, uint32_t len) {
+			if(len > out_len) {
+				len = out_len;
+			}
+			memcpy(bufp, out_buf, len);
+			return len;
+		}
+
+		virtual bool sim_control(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, const uint8_t* data, uint32_t len) {
+			out_len = len > sizeof(out_buf) ? sizeof(out_buf) : len;
+			memcpy(out_buf, data, out_len);
+			return control(bmRequestType, bRequest, wValue, wIndex, (bmRequestType & 0x80) ? 64 : out_len, out_len);
+		}
+};
+
+#include "hid.h"
+
+#endif
@@ -0,0 +1,1191 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+
+#include <gpio/gpio.h>
+#include <timer/timer.h>
+#include <dma/dma.h>
+#include <adc/adc_f3.h>
+#include <interrupt/interrupt.h>
+#include <interrupt/exti.h>
+#include <syscfg/syscfg.h>
+#include <spi/spi.h>
+#include <rcc/flash.h>
+#include <os/time.h>
+#include <usb/usb.h>
+
+#include "sim.h"
+
+// Script format, one event per line, '#' starts a comment:
+//
+//   <time_us> <command> [args...]
+//
+//   board v11|v20|arcin      Board revision reported to the version check
+//   config <segment> <hex>   Preload a config segment (0-3) into flash
+//   flash <addr> <hex>       Preload bytes into flash, such as stale store pages
+//   step <us>                Simulated time per main loop iteration
+//   press <button>           Pull a button input low
+//   release <button>         Let a button input go high again
+//   spin <axis> <counts>     Turn an encoder by a signed number of counts, or
+//                            the magnetic sensor on axis 0 by 1/16384 turns
+//   knob <axis> <value>      Set an analog knob to a 12-bit value
+//   noise <lsb>              Add up to +-lsb of noise to every knob conversion
+//   adc <adc> <ch> <value>   Set an ADC input (0: ADC1, 1: ADC2) to a 12-bit value
+//   expect <button> <0|1>    Expect a report with the button in that state, for
+//                            inputs the simulator doesn't know are buttons
+//   expect <stat> <op> <n>   Check a statistic at the end, op is ==, <= or >=
+//   expect ep0 <hex>         Check the start of the next ep0 report, .. for
+//                            any byte
+//   control <bmRequestType> <bRequest> <wValue> <wIndex> [hex]
+//                            Issue a control request on endpoint 0
+//   end                      Print statistics and exit
+//
+// Setup commands (board, config, flash) take effect before main() runs regardless
+// of their time stamp. The script is read from $ROXY_SIM_SCRIPT, or stdin.
+//
+// The exit status is 1 if an expectation isn't met. Inputs never reported
+// count as one, unless the script checks never_reported itself.
+
+template<> __attribute__((weak)) void interrupt<Interrupt::EXTI1>();
+template<> __attribute__((weak)) void interrupt<Interrupt::EXTI9_5>();
+template<> __attribute__((weak)) void interrupt<Interrupt::TIM2>();
+template<> __attribute__((weak)) void interrupt<Interrupt::TIM3>();
+template<> __attribute__((weak)) void interrupt<Interrupt::TIM6>();
+template<> __attribute__((weak)) void interrupt<Interrupt::TIM7>();
+template<> __attribute__((weak)) void interrupt<Interrupt::USB_LP_CAN_RX0>();
+template<> __attribute__((weak)) void interrupt<Interrupt::TIM1_BRK_TIM15>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA1_Channel1>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA1_Channel2>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA1_Channel3>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA1_Channel4>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA1_Channel5>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA1_Channel6>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA1_Channel7>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA2_Channel1>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA2_Channel2>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA2_Channel3>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA2_Channel4>();
+template<> __attribute__((weak)) void interrupt<Interrupt::DMA2_Channel5>();
+
+// Interrupts with RAMFUNC handlers, in main.cpp.
+extern const Interrupt::IRQ ram_irqs[];
+extern const uint32_t num_ram_irqs;
+
+namespace Sim {
+
+uint64_t now_us;
+uint32_t systick_ms;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Event {
+	uint64_t time;
+	std::vector<std::string> args;
+};
+
+struct Stat {
+	uint64_t n = 0;
+	uint64_t sum = 0;
+	uint64_t min = ~0ULL;
+	uint64_t max = 0;
+
+	void add(uint64_t v) {
+		n++;
+		sum += v;
+		if(v < min) {
+			min = v;
+		}
+		if(v > max) {
+			max = v;
+		}
+	}
+
+	void print(const char* name, const char* unit) {
+		if(!n) {
+			printf("%-16s n=0\n", name);
+			return;
+		}
+		printf("%-16s n=%-8llu min %llu %s  avg %llu %s  max %llu %s\n", name,
+			(unsigned long long)n, (unsigned long long)min, unit,
+			(unsigned long long)(sum / n), unit, (unsigned long long)max, unit);
+	}
+};
+
+struct Pending {
+	int index;			// Report bit for buttons, axis number for axes
+	uint32_t value;		// Expected bit state, or axis byte at the time of the event
+	uint64_t time;
+};
+
+struct Check {
+	std::string stat;
+	std::string op;
+	int64_t value;
+};
+
+struct Pin_Ref {
+	GPIO_t* port;
+	uint8_t pin;
+};
+
+enum Board {
+	V11,
+	V20,
+	ARCIN_BOARD,
+};
+
+// Mirrors the button input tables in roxy/board_define.h.
+const Pin_Ref button_pins[3][12] = {
+	{{&GPIOB, 4}, {&GPIOB, 5}, {&GPIOB, 6}, {&GPIOB, 9}, {&GPIOC, 14}, {&GPIOC, 5},
+	 {&GPIOB, 1}, {&GPIOB, 10}, {&GPIOC, 7}, {&GPIOC, 9}, {&GPIOA, 9}, {&GPIOB, 7}},
+	{{&GPIOA, 15}, {&GPIOD, 2}, {&GPIOC, 14}, {&GPIOC, 15}, {&GPIOC, 1}, {&GPIOC, 3},
+	 {&GPIOC, 2}, {&GPIOA, 4}, {&GPIOA, 5}, {&GPIOB, 2}, {&GPIOB, 10}, {nullptr, 0}},
+	{{&GPIOB, 0}, {&GPIOB, 1}, {&GPIOB, 2}, {&GPIOB, 3}, {&GPIOB, 4}, {&GPIOB, 5},
+	 {&GPIOB, 6}, {&GPIOB, 7}, {&GPIOB, 8}, {&GPIOB, 9}, {&GPIOB, 10}, {nullptr, 0}},
+};
+
+#if defined(ARCIN)
+Board board = ARCIN_BOARD;
+#else
+Board board = V20;
+#endif
+
+std::vector<Event> events;
+size_t next_event;
+uint32_t step_us = 100;
+
+USB_device* device;
+uint8_t interfaces;		// bNumInterfaces of the attached device
+
+// Endpoint model: a write stages one packet, the host collects it with the
+// IN token at the next frame boundary. STAT_TX and DTOG_TX in USB_EPR follow
+// the hardware, so the firmware can NAK a staged packet.
+struct Endpoint {
+	uint8_t data[64];
+	uint32_t len;
+	uint64_t count;
+	uint64_t written_us;
+	bool staged;			// Written and not collected yet
+	uint64_t restaged;		// Writes over a staged packet
+};
+Endpoint endpoints[8];
+uint64_t next_frame_us = 1000;
+
+// Timer requests that move data by DMA, and the interrupt the timer raises
+// itself. Requests move to the remapped channel when their SYSCFG_CFGR1 bit
+// is set.
+struct Dma_Request {
+	uint32_t dier;			// UDE or CCxDE bit
+	DMA_t* dma;
+	uint8_t channel;
+	uint32_t remap = 0;
+	DMA_t* remap_dma = nullptr;
+	uint8_t remap_channel = 0;
+};
+
+struct Timer_Model {
+	TIM_t* tim;
+	Interrupt::IRQ irq;
+	void (*handler)();
+	Dma_Request requests[3];
+	uint64_t start_ns = 0;
+	uint64_t next_ns = 0;
+};
+
+Timer_Model timers[] = {
+	{&TIM4, Interrupt::IRQ(0), nullptr, {
+		{1 << 8, &DMA1, 6},
+		{1 << 9, &DMA1, 0},
+		{1 << 10, &DMA1, 3}}},
+	{&TIM6, Interrupt::TIM6, interrupt<Interrupt::TIM6>, {
+		{1 << 8, &DMA2, 2, 1 << 13, &DMA1, 2}}},
+	{&TIM7, Interrupt::TIM7, interrupt<Interrupt::TIM7>, {
+		{1 << 8, &DMA2, 3, 1 << 14, &DMA1, 3}}},
+	{&TIM15, Interrupt::TIM1_BRK_TIM15, interrupt<Interrupt::TIM1_BRK_TIM15>, {
+		{1 << 8, &DMA1, 4}}},
+	{&TIM16, Interrupt::IRQ(0), nullptr, {
+		{1 << 8, &DMA1, 2, 1 << 11, &DMA1, 5}}},
+	{&TIM17, Interrupt::IRQ(0), nullptr, {
+		{1 << 8, &DMA1, 0, 1 << 12, &DMA1, 6}}},
+};
+
+// The NDTR value a running channel was started with, for circular reloads.
+uint32_t dma_ndtr[2][7];
+
+uint8_t qe_phase[2] = {2, 2};	// Index into the Gray sequence, inputs idle high
+
+std::vector<Pending> pending_buttons;
+std::vector<Pending> pending_axes;
+std::vector<Check> checks;
+std::vector<std::string> ep0_expected;	// Patterns for the next ep0 reports
+uint32_t failures;
+uint8_t last_axis_byte[2];
+int8_t last_axis_dir[2];
+uint64_t axis_changes;
+uint64_t axis_reversals;
+uint16_t adc_input[2][19];
+uint16_t mag_angle;			// Magnetic sensor angle, 14 bits
+uint16_t mag_latched;		// Angle the next frame returns
+uint16_t knob_noise;
+uint16_t last_buttons;
+
+Stat loop_ns;
+Stat led_loop_ns;
+Stat isr_ns;
+Stat button_latency_us;
+Stat axis_latency_us;
+Stat hires_samples;			// Input samples between high resolution reports
+int32_t spun[2];			// Counts turned by the script
+int16_t hires_position[2];
+uint16_t hires_seq;
+bool hires_seen;
+int32_t mouse_moved[3];		// X, Y, wheel
+uint32_t keys_held;			// Keys set in the last NKRO report
+uint32_t keys_held_max;
+uint64_t dma_transfers;
+uint64_t lost_edges;
+uint64_t iterations;
+bool dma_started;
+bool in_loop;
+Clock::time_point loop_start;
+uint32_t longest_stall_us;	// Main loop iteration held up by flash operations
+uint64_t flash_busy_until_us;
+int stalled_priority = -1;	// Of a handler in flash stuck on its first fetch
+void (*held[64])();			// Handlers held off until the flash is done
+bool systick_held;
+
+// DWT_CYCCNT is plain memory here, so it only moves with host time at the
+// points the simulator controls: around interrupts and the USB poll. Cycle
+// counts for code in between are only meaningful on hardware.
+volatile uint32_t* const cyccnt = (volatile uint32_t*)0xe0001004;
+const Clock::time_point start_time = Clock::now();
+
+void sync_cyccnt() {
+	*cyccnt = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time).count() * 72 / 1000;
+}
+
+bool in_ram(Interrupt::IRQ irq) {
+	for(uint32_t i = 0; i < num_ram_irqs; i++) {
+		if(ram_irqs[i] == irq) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// While the flash is busy, the first handler in flash taken stalls on its
+// first fetch until the operation is done, and holds off everything of the
+// same or lower priority meanwhile. RAMFUNC handlers above it still run.
+bool held_up(bool ram, uint8_t priority) {
+	if(now_us >= flash_busy_until_us) {
+		return false;
+	}
+	if(stalled_priority >= 0 && priority >= stalled_priority) {
+		return true;
+	}
+	if(!ram) {
+		stalled_priority = priority;
+		return true;
+	}
+	return false;
+}
+
+void fire(void (*handler)(), Interrupt::IRQ irq) {
+	if(!handler || !Interrupt::is_enabled(irq)) {
+		return;
+	}
+	if(held_up(in_ram(irq), NVIC.IPR[irq])) {
+		held[irq] = handler;	// Stays pending, repeats are lost
+		return;
+	}
+	sync_cyccnt();
+	Clock::time_point t = Clock::now();
+	handler();
+	isr_ns.add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t).count());
+	sync_cyccnt();
+}
+
+void (*const dma1_handlers[7])() = {
+	interrupt<Interrupt::DMA1_Channel1>, interrupt<Interrupt::DMA1_Channel2>,
+	interrupt<Interrupt::DMA1_Channel3>, interrupt<Interrupt::DMA1_Channel4>,
+	interrupt<Interrupt::DMA1_Channel5>, interrupt<Interrupt::DMA1_Channel6>,
+	interrupt<Interrupt::DMA1_Channel7>,
+};
+void (*const dma2_handlers[7])() = {
+	interrupt<Interrupt::DMA2_Channel1>, interrupt<Interrupt::DMA2_Channel2>,
+	interrupt<Interrupt::DMA2_Channel3>, interrupt<Interrupt::DMA2_Channel4>,
+	interrupt<Interrupt::DMA2_Channel5>, nullptr, nullptr,
+};
+
+// Flags written to IFCR clear ISR once the handler returns.
+void fire_dma(DMA_t& dma, uint32_t c) {
+	bool first = &dma == &DMA1;
+	void (*const* handlers)() = first ? dma1_handlers : dma2_handlers;
+	Interrupt::IRQ irq = Interrupt::IRQ((first ? Interrupt::DMA1_Channel1 : Interrupt::DMA2_Channel1) + c);
+	fire(handlers[c], irq);
+
+	// CGIFx clears every flag of channel x.
+	uint32_t clear = dma.reg.IFCR;
+	for(uint32_t i = 0; i < 7; i++) {
+		if(clear & (1 << (4 * i))) {
+			clear |= 0xf << (4 * i);
+		}
+	}
+	dma.reg.ISR &= ~clear;
+	dma.reg.IFCR = 0;
+}
+
+// SysTick runs at 1 kHz in step with the frames. Its handler is laks code
+// in flash.
+void systick() {
+	if(!(STK.CTRL & (1 << 1))) {
+		return;
+	}
+	if(held_up(false, SCB.SHPR[11])) {
+		systick_held = true;
+		return;
+	}
+	systick_ms++;
+}
+
+// Takes what was held off once the flash is done: SysTick first, then by
+// priority and number like the NVIC.
+void release_held() {
+	stalled_priority = -1;
+	if(systick_held) {
+		systick_held = false;
+		systick_ms++;
+	}
+	for(;;) {
+		int next = -1;
+		for(int i = 0; i < 64; i++) {
+			if(held[i] && (next < 0 || NVIC.IPR[i] < NVIC.IPR[next])) {
+				next = i;
+			}
+		}
+		if(next < 0) {
+			break;
+		}
+		void (*handler)() = held[next];
+		held[next] = nullptr;
+		if(next >= Interrupt::DMA1_Channel1 && next <= Interrupt::DMA1_Channel7) {
+			fire_dma(DMA1, next - Interrupt::DMA1_Channel1);
+		} else if(next >= Interrupt::DMA2_Channel1 && next <= Interrupt::DMA2_Channel5) {
+			fire_dma(DMA2, next - Interrupt::DMA2_Channel1);
+		} else {
+			fire(handler, Interrupt::IRQ(next));
+		}
+	}
+}
+
+// Transfers that only run on a peripheral request: anything reading from a
+// peripheral, and circular buffers.
+bool paced(DMA_channel_reg_t& ch) {
+	return !(ch.CR & (1 << 4)) || (ch.CR & (1 << 5));
+}
+
+// Memory to peripheral transfers complete instantly.
+void complete_dma(DMA_t& dma) {
+	for(uint32_t c = 0; c < 7; c++) {
+		if(!(dma.reg.C[c].CR & 1)) {
+			dma_ndtr[&dma == &DMA2][c] = 0;
+		}
+		for(uint32_t guard = 0; guard < 10000 && (dma.reg.C[c].CR & 1) && !paced(dma.reg.C[c]); guard++) {
+			dma_transfers++;
+			dma_started = true;
+			dma.reg.C[c].NDTR = 0;
+			dma.reg.ISR |= (1 << 1) << (4 * c);	// TCIF
+			if(dma.reg.C[c].CR & (1 << 1)) {
+				// The handler disables the channel and may chain the next transfer.
+				fire_dma(dma, c);
+			} else {
+				dma.reg.C[c].CR &= ~1;
+			}
+		}
+	}
+}
+
+void complete_all_dma() {
+	complete_dma(DMA1);
+	complete_dma(DMA2);
+}
+
+void dma_request(DMA_t& dma, uint32_t c);
+
+// A frame clocked by a write to SPI1 DR. The magnetic sensor answers every
+// command with the angle latched by the frame before, with even parity.
+void spi1_frame() {
+	if(!(SPI1.reg.CR1 & (1 << 6))) {	// SPE
+		return;
+	}
+	uint16_t frame = mag_latched;
+	frame |= __builtin_parity(frame) << 15;
+	mag_latched = mag_angle & 0x3fff;
+	if(SPI1.reg.CR2 & (1 << 0)) {	// RXDMAEN
+		SPI1.reg.DR = frame;
+		dma_request(DMA1, 1);
+	}
+}
+
+// One item of a paced transfer.
+void dma_request(DMA_t& dma, uint32_t c) {
+	DMA_channel_reg_t& ch = dma.reg.C[c];
+	uint32_t& ndtr0 = dma_ndtr[&dma == &DMA2][c];
+	if(!(ch.CR & 1)) {
+		ndtr0 = 0;
+		return;
+	}
+	if(!ndtr0) {
+		ndtr0 = ch.NDTR;
+	}
+	if(!ch.NDTR) {
+		return;
+	}
+
+	uint32_t item = ndtr0 - ch.NDTR;
+	uint32_t psize = 1 << ((ch.CR >> 8) & 3);
+	uint32_t msize = 1 << ((ch.CR >> 10) & 3);
+	uintptr_t per = ch.PAR + (ch.CR & (1 << 6) ? item * psize : 0);
+	uintptr_t mem = ch.MAR + (ch.CR & (1 << 7) ? item * msize : 0);
+	uint32_t v = 0;
+	if(ch.CR & (1 << 4)) {
+		memcpy(&v, (void*)mem, msize);
+		memcpy((void*)per, &v, psize);
+		if(per == (uintptr_t)&SPI1.reg.DR) {
+			spi1_frame();
+		}
+	} else {
+		memcpy(&v, (void*)per, psize);
+		memcpy((void*)mem, &v, msize);
+	}
+	dma_transfers++;
+
+	uint32_t flags = 0;
+	ch.NDTR = ch.NDTR - 1;
+	if(ch.NDTR == ndtr0 / 2) {
+		flags |= 1 << 2;	// HTIF
+	}
+	if(!ch.NDTR) {
+		flags |= 1 << 1;	// TCIF
+		if(ch.CR & (1 << 5)) {
+			ch.NDTR = ndtr0;
+		}
+	}
+	if(flags) {
+		dma.reg.ISR |= (flags | 1) << (4 * c);
+		if(ch.CR & flags & ((1 << 1) | (1 << 2))) {
+			fire_dma(dma, c);
+		}
+	}
+}
+
+void tick_timer(Timer_Model& t) {
+	TIM_t& tim = *t.tim;
+	tim.SR |= 1;
+	if((tim.DIER & 1) && t.handler) {
+		fire(t.handler, t.irq);
+	}
+	for(const Dma_Request& r : t.requests) {
+		if(r.dma && (tim.DIER & r.dier)) {
+			if(r.remap && (SYSCFG.CFGR1 & r.remap)) {
+				dma_request(*r.remap_dma, r.remap_channel);
+			} else {
+				dma_request(*r.dma, r.channel);
+			}
+		}
+	}
+}
+
+void run_timers(uint64_t now_ns) {
+	for(Timer_Model& t : timers) {
+		TIM_t& tim = *t.tim;
+		if(!(tim.CR1 & 1)) {
+			t.next_ns = 0;
+			continue;
+		}
+		uint64_t period_ns = uint64_t(tim.PSC + 1) * (tim.ARR + 1) * 1000 / 72;
+		if(!t.next_ns) {
+			t.start_ns = now_ns;
+			t.next_ns = now_ns + period_ns;
+		}
+		tim.CNT = (now_ns - t.start_ns) * 72 / 1000 / (tim.PSC + 1) % (tim.ARR + 1);
+		while(t.next_ns <= now_ns) {
+			tick_timer(t);
+			t.next_ns += period_ns;
+		}
+	}
+}
+
+// Continuous conversions of the regular sequence with DMA, at the longest
+// sample time: 614 ADC clocks at 72 MHz.
+struct Adc_Model {
+	ADC_t* adc;
+	uint32_t input;
+	DMA_t* dma;
+	uint32_t channel;
+	uint32_t remap = 0;		// SYSCFG_CFGR1 bit moving the request
+	DMA_t* remap_dma = nullptr;
+	uint32_t remap_channel = 0;
+	uint64_t next_ns = 0;
+	uint32_t seq = 0;		// Position in the regular sequence
+};
+
+Adc_Model adcs[] = {
+	{&ADC1, 0, &DMA1, 0},
+	{&ADC2, 1, &DMA2, 0, 1 << 8, &DMA2, 2},
+};
+
+uint32_t noise_seed = 1;
+
+void run_adcs(uint64_t now_ns) {
+	const uint64_t period_ns = 614 * 1000 / 72;
+	for(Adc_Model& m : adcs) {
+		ADC_t& adc = *m.adc;
+		if(!(adc.CR & 1) || (adc.CFGR & 0x2001) != 0x2001) {	// ADEN, CONT and DMAEN
+			m.next_ns = 0;
+			m.seq = 0;
+			continue;
+		}
+		if(!m.next_ns) {
+			m.next_ns = now_ns + period_ns;
+		}
+		while(m.next_ns <= now_ns) {
+			static const uint8_t sqr_pos[16][2] = {
+				{0, 6}, {0, 12}, {0, 18}, {0, 24}, {1, 0}, {1, 6}, {1, 12}, {1, 18},
+				{1, 24}, {2, 0}, {2, 6}, {2, 12}, {2, 18}, {2, 24}, {3, 0}, {3, 6},
+			};
+			const volatile uint32_t* sqr[4] = {&adc.SQR1, &adc.SQR2, &adc.SQR3, &adc.SQR4};
+			if(m.seq > (adc.SQR1 & 0xf)) {
+				m.seq = 0;
+			}
+			uint32_t ch = (*sqr[sqr_pos[m.seq][0]] >> sqr_pos[m.seq][1]) & 0x1f;
+			m.seq++;
+			int32_t v = ch < 19 ? adc_input[m.input][ch] : 0;
+			if(knob_noise) {
+				noise_seed = noise_seed * 1103515245 + 12345;
+				v += int32_t((noise_seed >> 16) % (2 * knob_noise + 1)) - knob_noise;
+				v = v < 0 ? 0 : v > 0xfff ? 0xfff : v;
+			}
+			adc.DR = v << (adc.CFGR & (1 << 5) ? 4 : 0);
+			if(m.remap && (SYSCFG.CFGR1 & m.remap)) {
+				dma_request(*m.remap_dma, m.remap_channel);
+			} else {
+				dma_request(*m.dma, m.channel);
+			}
+			m.next_ns += period_ns;
+		}
+	}
+}
+
+void print_stats() {
+	printf("roxy-sim: %llu iterations, %.3f s simulated\n", (unsigned long long)iterations, now_us / 1e6);
+	loop_ns.print("loop", "ns");
+	led_loop_ns.print("loop w/ led dma", "ns");
+	isr_ns.print("isr", "ns");
+	printf("%-16s %llu\n", "dma transfers", (unsigned long long)dma_transfers);
+	if(sim_flash_erases || sim_flash_programs) {
+		printf("%-16s %u erases, %u half-words, longest stall %u us\n", "flash", sim_flash_erases, sim_flash_programs, longest_stall_us);
+	}
+	for(uint32_t ep = 1; ep < 8; ep++) {
+		if(endpoints[ep].count) {
+			printf("ep%u reports      %llu\n", ep, (unsigned long long)endpoints[ep].count);
+		}
+		if(endpoints[ep].restaged) {
+			printf("ep%u restaged     %llu\n", ep, (unsigned long long)endpoints[ep].restaged);
+		}
+	}
+	button_latency_us.print("button latency", "us");
+	axis_latency_us.print("axis latency", "us");
+	if(endpoints[2].count) {
+		printf("%-16s %u at end, %u at most\n", "keys held", keys_held, keys_held_max);
+	}
+	if(endpoints[3].count) {
+		printf("%-16s x %d, y %d, wheel %d\n", "mouse moved", mouse_moved[0], mouse_moved[1], mouse_moved[2]);
+	}
+	if(hires_samples.n) {
+		hires_samples.print("hires samples", "");
+		printf("%-16s %d %d, spun %d %d\n", "hires position", hires_position[0], hires_position[1], spun[0], spun[1]);
+	}
+	if(axis_changes) {
+		printf("%-16s %llu, %llu reversals\n", "axis changes", (unsigned long long)axis_changes, (unsigned long long)axis_reversals);
+	}
+	printf("%-16s %llu\n", "lost edges", (unsigned long long)lost_edges);
+	if(pending_buttons.size() || pending_axes.size()) {
+		printf("%-16s %zu button, %zu axis\n", "never reported", pending_buttons.size(), pending_axes.size());
+	}
+	fflush(stdout);
+}
+
+bool stat_value(const std::string& name, int64_t& v) {
+	const struct {
+		const char* name;
+		int64_t value;
+	} stats[] = {
+		{"lost_edges", int64_t(lost_edges)},
+		{"never_reported", int64_t(pending_buttons.size() + pending_axes.size())},
+		{"button_latency_n", int64_t(button_latency_us.n)},
+		{"button_latency_max", int64_t(button_latency_us.max)},
+		{"axis_latency_n", int64_t(axis_latency_us.n)},
+		{"axis_latency_avg", int64_t(axis_latency_us.n ? axis_latency_us.sum / axis_latency_us.n : 0)},
+		{"axis_latency_max", int64_t(axis_latency_us.max)},
+		{"axis_changes", int64_t(axis_changes)},
+		{"axis_reversals", int64_t(axis_reversals)},
+		{"ep1_reports", int64_t(endpoints[1].count)},
+		{"ep1_restaged", int64_t(endpoints[1].restaged)},
+		{"ep2_reports", int64_t(endpoints[2].count)},
+		{"ep2_restaged", int64_t(endpoints[2].restaged)},
+		{"keys_held", keys_held},
+		{"keys_held_max", keys_held_max},
+		{"interfaces", interfaces},
+		{"mouse_x", mouse_moved[0]},
+		{"mouse_y", mouse_moved[1]},
+		{"mouse_wheel", mouse_moved[2]},
+		{"hires_samples_max", int64_t(hires_samples.max)},
+		{"hires_x", uint16_t(hires_position[0])},	// Raw axis fields of the last report
+		{"hires_y", uint16_t(hires_position[1])},
+		{"hires_error0", int16_t(hires_position[0] - spun[0])},	// Position against the counts spun
+		{"hires_error1", int16_t(hires_position[1] - spun[1])},
+		{"dma_transfers", int64_t(dma_transfers)},
+		{"flash_erases", sim_flash_erases},
+		{"flash_programs", sim_flash_programs},
+		{"longest_stall", longest_stall_us},
+	};
+	for(const auto& s : stats) {
+		if(name == s.name) {
+			v = s.value;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Checks the expectations left for the end, returns the exit status.
+int check_expectations() {
+	bool counted_pending = false;
+	for(const Check& c : checks) {
+		int64_t v;
+		if(!stat_value(c.stat, v)) {
+			printf("expect: unknown statistic '%s'\n", c.stat.c_str());
+			failures++;
+			continue;
+		}
+		counted_pending |= c.stat == "never_reported";
+		bool ok = c.op == "==" ? v == c.value : c.op == "<=" ? v <= c.value : c.op == ">=" ? v >= c.value : false;
+		if(!ok) {
+			printf("expect: %s %s %lld failed, is %lld\n", c.stat.c_str(), c.op.c_str(), (long long)c.value, (long long)v);
+			failures++;
+		}
+	}
+	if(!counted_pending && (pending_buttons.size() || pending_axes.size())) {
+		printf("expect: inputs never reported\n");
+		failures++;
+	}
+	for(const std::string& p : ep0_expected) {
+		printf("expect: no ep0 report for %s\n", p.c_str());
+		failures++;
+	}
+	return failures ? 1 : 0;
+}
+
+// Host IN token for every endpoint holding a packet.
+void collect_reports() {
+	for(uint32_t ep = 1; ep < 8; ep++) {
+		Endpoint& e = endpoints[ep];
+		if((USB.reg.EPR[ep].v & 0x30) != 0x30) {
+			continue;
+		}
+		// STAT_TX = NAK, CTR_TX set, DTOG_TX flips
+		USB.reg.EPR[ep].v = ((USB.reg.EPR[ep].v & ~0x30) | 0x20 | 0x80) ^ 0x40;
+		e.count++;
+		e.staged = false;
+
+		// Keyboard: NKRO bitmap
+		if(ep == 2 && e.len == 32) {
+			keys_held = 0;
+			for(uint32_t i = 0; i < e.len; i++) {
+				keys_held += __builtin_popcount(e.data[i]);
+			}
+			if(keys_held > keys_held_max) {
+				keys_held_max = keys_held;
+			}
+		}
+
+		// Mouse: {x[2], y[2], wheel}
+		if(ep == 3 && e.len == 5) {
+			mouse_moved[0] += int16_t(e.data[0] | (e.data[1] << 8));
+			mouse_moved[1] += int16_t(e.data[2] | (e.data[3] << 8));
+			mouse_moved[2] += int8_t(e.data[4]);
+		}
+
+		// Latency is only tracked on the joystick report: {id, buttons[2], x, y},
+		// or {id, buttons[2], x[2], y[2], vx[2], vy[2], seq[2], time[2]} in
+		// high resolution mode, where the axis bytes are the low ones.
+		if(ep != 1 || e.len < 5) {
+			continue;
+		}
+		uint32_t stride = e.len == 15 ? 2 : 1;
+		if(stride == 2) {
+			uint16_t seq = e.data[11] | (e.data[12] << 8);
+			if(hires_seen) {
+				hires_samples.add(uint16_t(seq - hires_seq));
+			}
+			hires_seen = true;
+			hires_seq = seq;
+			hires_position[0] = e.data[3] | (e.data[4] << 8);
+			hires_position[1] = e.data[5] | (e.data[6] << 8);
+		}
+		uint16_t buttons = e.data[1] | (e.data[2] << 8);
+		// A button that changed carries the latest edge it agrees with.
+		// Earlier edges of the same button were never seen by the host.
+		uint16_t changed = buttons ^ last_buttons;
+		last_buttons = buttons;
+		for(int b = 0; b < 16; b++) {
+			if(!(changed & (1 << b))) {
+				continue;
+			}
+			bool bit = buttons & (1 << b);
+			size_t match = pending_buttons.size();
+			for(size_t i = 0; i < pending_buttons.size(); i++) {
+				const Pending& p = pending_buttons[i];
+				if(p.index == b && p.time <= e.written_us && bool(p.value) == bit) {
+					match = i;
+				}
+			}
+			if(match == pending_buttons.size()) {
+				continue;
+			}
+			uint64_t t = pending_buttons[match].time;
+			button_latency_us.add(now_us - t);
+				for(size_t i = 0; i < pending_buttons.size();) {
+				if(pending_buttons[i].index == b && pending_buttons[i].time <= t) {
+					if(pending_buttons[i].time < t) {
+						lost_edges++;
+					}
+					pending_buttons.erase(pending_buttons.begin() + i);
+				} else {
+					i++;
+				}
+			}
+		}
+		for(size_t i = 0; i < pending_axes.size();) {
+			Pending& p = pending_axes[i];
+			if(e.data[3 + p.index * stride] != p.value) {
+				axis_latency_us.add(now_us - p.time);
+				pending_axes.erase(pending_axes.begin() + i);
+			} else {
+				i++;
+			}
+		}
+		for(int i = 0; i < 2; i++) {
+			int8_t moved = e.data[3 + i * stride] - last_axis_byte[i];
+			if(moved) {
+				int8_t dir = moved > 0 ? 1 : -1;
+				axis_changes++;
+				if(last_axis_dir[i] && dir != last_axis_dir[i]) {
+					axis_reversals++;
+				}
+				last_axis_dir[i] = dir;
+			}
+		}
+		last_axis_byte[0] = e.data[3];
+		last_axis_byte[1] = e.data[3 + stride];
+	}
+}
+
+void quadrature_step(int dir) {
+	static const uint8_t gray[4] = {0, 1, 3, 2};
+	qe_phase[0] = (qe_phase[0] + dir) & 3;
+	uint8_t state = gray[qe_phase[0]];
+
+	// QE pair mode: A on PA1, B on PA7.
+	bool a = state & 1;
+	bool b = state & 2;
+	bool a_changed = bool(GPIOA.reg.IDR & (1 << 1)) != a;
+	GPIOA.reg.IDR = (GPIOA.reg.IDR & ~((1 << 1) | (1 << 7))) | (a << 1) | (b << 7);
+
+	if(a_changed) {
+		EXTI.PR1 |= 1 << 1;
+		fire(interrupt<Interrupt::EXTI1>, Interrupt::EXTI1);
+	} else {
+		EXTI.PR1 |= 1 << 7;
+		fire(interrupt<Interrupt::EXTI9_5>, Interrupt::EXTI9_5);
+	}
+}
+
+void spin(int axis, int counts) {
+	TIM_t& tim = axis ? TIM3 : TIM2;
+	if(tim.CR1 & 1) {
+		// One count at a time, so every wrap and compare match raises its
+		// interrupt as the encoder passes it.
+		int32_t max = tim.ARR + 1;
+		int dir = counts < 0 ? -1 : 1;
+		for(int i = 0; i < (counts < 0 ? -counts : counts); i++) {
+			int32_t cnt = int32_t(tim.CNT) + dir;
+			uint32_t flags = 0;
+			if(cnt < 0 || cnt >= max) {
+				cnt = (cnt + max) % max;
+				flags |= 1 << 0;	// UIF
+			}
+			tim.CNT = cnt;
+			if(uint32_t(cnt) == tim.CCR3) {
+				flags |= 1 << 3;	// CC3IF
+			}
+			if(uint32_t(cnt) == tim.CCR4) {
+				flags |= 1 << 4;	// CC4IF
+			}
+			// Input A rises entering the second quarter of a cycle going
+			// forward and the third going back, B a quarter later.
+			if((tim.CCER & (1 << 0)) && (cnt & 3) == (dir > 0 ? 1 : 2)) {
+				tim.CCR1 = cnt;
+				flags |= 1 << 1;	// CC1IF
+			}
+			if((tim.CCER & (1 << 4)) && (cnt & 3) == (dir > 0 ? 2 : 3)) {
+				tim.CCR2 = cnt;
+				flags |= 1 << 2;	// CC2IF
+			}
+			tim.SR |= flags;
+			if(flags & tim.DIER) {
+				if(axis) {
+					fire(interrupt<Interrupt::TIM3>, Interrupt::TIM3);
+				} else {
+					fire(interrupt<Interrupt::TIM2>, Interrupt::TIM2);
+				}
+			}
+		}
+	} else if(axis == 0 && (SPI1.reg.CR1 & (1 << 6))) {
+		mag_angle = (mag_angle + counts) & 0x3fff;
+	} else if(axis == 0 && (EXTI.IMR1 & ((1 << 1) | (1 << 7)))) {
+		for(int i = 0; i < (counts < 0 ? -counts : counts); i++) {
+			quadrature_step(counts < 0 ? -1 : 1);
+		}
+	}
+}
+
+void set_button(uint32_t index, bool pressed) {
+	if(index >= 12 || !button_pins[board][index].port) {
+		fprintf(stderr, "roxy-sim: no button %u on this board\n", index);
+		return;
+	}
+	const Pin_Ref& p = button_pins[board][index];
+	bool was_pressed = !(p.port->reg.IDR & (1 << p.pin));
+	if(was_pressed == pressed) {
+		return;
+	}
+	if(pressed) {
+		p.port->reg.IDR &= ~(1 << p.pin);
+	} else {
+		p.port->reg.IDR |= 1 << p.pin;
+	}
+	pending_buttons.push_back({int(index), pressed, now_us});
+}
+
+std::vector<uint8_t> parse_hex(const std::string& s) {
+	std::vector<uint8_t> out;
+	for(size_t i = 0; i + 1 < s.size(); i += 2) {
+		out.push_back(strtoul(s.substr(i, 2).c_str(), nullptr, 16));
+	}
+	return out;
+}
+
+void write_config(uint32_t segment, const std::vector<uint8_t>& data) {
+	static const uint32_t addr[4] = {0x801f800, 0x8020000, 0x8020800, 0x8021000};
+	if(segment >= 4) {
+		return;
+	}
+	uint32_t* header = (uint32_t*)(uintptr_t)addr[segment];
+	header[0] = 0xc0ff600d;
+	header[1] = data.size();
+	memcpy(header + 2, data.data(), data.size());
+}
+
+bool setup_command(const Event& e) {
+	const std::string& cmd = e.args[0];
+	if(cmd == "board" && e.args.size() > 1) {
+		if(e.args[1] == "v11") {
+			board = V11;
+		} else if(e.args[1] == "v20") {
+			board = V20;
+		} else {
+			board = ARCIN_BOARD;
+		}
+		ADC1.DR = board == V20 ? 2048 : 0;
+		return true;
+	}
+	if(cmd == "config" && e.args.size() > 2) {
+		write_config(strtoul(e.args[1].c_str(), nullptr, 0), parse_hex(e.args[2]));
+		return true;
+	}
+	if(cmd == "flash" && e.args.size() > 2) {
+		uint32_t addr = strtoul(e.args[1].c_str(), nullptr, 0);
+		std::vector<uint8_t> data = parse_hex(e.args[2]);
+		if(addr < 0x08000000 || addr + data.size() > 0x08000000 + 256 * 1024) {
+			fprintf(stderr, "roxy-sim: 0x%08lx is not in flash\n", (unsigned long)addr);
+			exit(1);
+		}
+		memcpy((void*)(uintptr_t)addr, data.data(), data.size());
+		return true;
+	}
+	return false;
+}
+
+void run_command(const Event& e) {
+	const std::vector<std::string>& a = e.args;
+	const std::string& cmd = a[0];
+	if(cmd == "step" && a.size() > 1) {
+		step_us = strtoul(a[1].c_str(), nullptr, 0);
+	} else if(cmd == "press" && a.size() > 1) {
+		set_button(strtoul(a[1].c_str(), nullptr, 0), true);
+	} else if(cmd == "release" && a.size() > 1) {
+		set_button(strtoul(a[1].c_str(), nullptr, 0), false);
+	} else if(cmd == "spin" && a.size() > 2) {
+		int axis = strtol(a[1].c_str(), nullptr, 0) & 1;
+		pending_axes.push_back({axis, last_axis_byte[axis], now_us});
+		spin(axis, strtol(a[2].c_str(), nullptr, 0));
+		spun[axis] += strtol(a[2].c_str(), nullptr, 0);
+	} else if(cmd == "knob" && a.size() > 2) {
+		int axis = strtol(a[1].c_str(), nullptr, 0) & 1;
+		ADC_t& adc = axis ? ADC2 : ADC1;
+		uint16_t& v = adc_input[axis][axis ? 4 : 2];
+		v = strtoul(a[2].c_str(), nullptr, 0) & 0xfff;
+		adc.DR = v << (adc.CFGR & (1 << 5) ? 4 : 0);
+		// Only once the host is reading reports, the first value sets the baseline.
+		if(endpoints[1].count) {
+			pending_axes.push_back({axis, last_axis_byte[axis], now_us});
+		}
+	} else if(cmd == "adc" && a.size() > 3) {
+		uint32_t ch = strtoul(a[2].c_str(), nullptr, 0);
+		if(ch < 19) {
+			adc_input[strtoul(a[1].c_str(), nullptr, 0) & 1][ch] = strtoul(a[3].c_str(), nullptr, 0) & 0xfff;
+		}
+	} else if(cmd == "expect" && a.size() > 2 && a[1] == "ep0") {
+		ep0_expected.push_back(a[2]);
+	} else if(cmd == "expect" && a.size() > 3) {
+		checks.push_back({a[1], a[2], strtoll(a[3].c_str(), nullptr, 0)});
+	} else if(cmd == "expect" && a.size() > 2) {
+		pending_buttons.push_back({int(strtoul(a[1].c_str(), nullptr, 0)), strtoul(a[2].c_str(), nullptr, 0) != 0, now_us});
+	} else if(cmd == "noise" && a.size() > 1) {
+		knob_noise = strtoul(a[1].c_str(), nullptr, 0);
+	} else if(cmd == "control" && a.size() > 4) {
+		std::vector<uint8_t> data = a.size() > 5 ? parse_hex(a[5]) : std::vector<uint8_t>();
+		bool ok = device && device->sim_control(
+			strtoul(a[1].c_str(), nullptr, 0), strtoul(a[2].c_str(), nullptr, 0),
+			strtoul(a[3].c_str(), nullptr, 0), strtoul(a[4].c_str(), nullptr, 0),
+			data.data(), data.size());
+		if(!ok) {
+			printf("control: stall\n");
+		}
+	} else if(cmd == "end") {
+		print_stats();
+		exit(check_expectations());
+	} else if(!setup_command(e)) {
+		fprintf(stderr, "roxy-sim: unknown command '%s'\n", cmd.c_str());
+	}
+}
+
+void load_script() {
+	const char* path = getenv("ROXY_SIM_SCRIPT");
+	FILE* f = path ? fopen(path, "r") : stdin;
+	if(!f) {
+		perror(path);
+		exit(1);
+	}
+
+	char line[1024];
+	while(fgets(line, sizeof(line), f)) {
+		char* hash = strchr(line, '#');
+		if(hash) {
+			*hash = 0;
+		}
+		Event e;
+		char* save;
+		char* tok = strtok_r(line, " \t\r\n", &save);
+		if(!tok) {
+			continue;
+		}
+		e.time = strtoull(tok, nullptr, 0);
+		while((tok = strtok_r(nullptr, " \t\r\n", &save))) {
+			e.args.push_back(tok);
+		}
+		if(e.args.empty()) {
+			continue;
+		}
+		if(!setup_command(e)) {
+			events.push_back(e);
+		}
+	}
+	if(f != stdin) {
+		fclose(f);
+	}
+}
+
+void map_region(uintptr_t addr, size_t size, uint8_t fill) {
+	void* p = mmap((void*)addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(p != (void*)addr) {
+		fprintf(stderr, "roxy-sim: unable to map 0x%08lx\n", (unsigned long)addr);
+		exit(1);
+	}
+	memset(p, fill, size);
+}
+
+// Flash, CCM, the system memory UID and the DWT/CoreDebug registers have to
+// sit at their real addresses since the firmware dereferences them directly.
+void init_memory() {
+	map_region(0x08000000, 256 * 1024, 0xff);
+	map_region(0x10000000, 8 * 1024, 0);
+	map_region(0x1ffff000, 4 * 1024, 0xff);
+	map_region(0xe0001000, 4 * 1024, 0);
+	map_region(0xe000e000, 4 * 1024, 0);
+	uint32_t* uid = (uint32_t*)0x1ffff7ac;
+	uid[0] = 0x00420031;
+	uid[1] = 0x3236470b;
+	uid[2] = 0x31363238;
+
+	ADC1.DR = board == V20 ? 2048 : 0;
+	load_script();
+}
+
+// Defined last so it runs after everything above is constructed, and before
+// main() reads its config from flash.
+struct Init {
+	Init() {
+		init_memory();
+	}
+} init;
+
+}
+
+void attach(USB_device* dev, const uint8_t* conf_desc) {
+	device = dev;
+	interfaces = conf_desc[4];
+
+	// Interrupt endpoints, STAT_TX = NAK
+	for(uint32_t ep = 1; ep < 8; ep++) {
+		USB.reg.EPR[ep].v = (3 << 9) | 0x20 | ep;
+	}
+}
+
+void advance(uint32_t us) {
+	uint64_t end = now_us + us;
+
+	while(now_us < end) {
+		uint64_t next = end;
+		if(next_event < events.size() && events[next_event].time < next) {
+			next = events[next_event].time > now_us ? events[next_event].time : now_us;
+		}
+		if(next_frame_us < next) {
+			next = next_frame_us;
+		}
+		if(flash_busy_until_us > now_us && flash_busy_until_us < next) {
+			next = flash_busy_until_us;
+		}
+		now_us = next;
+
+		if(now_us >= flash_busy_until_us && stalled_priority >= 0) {
+			release_held();
+		}
+
+		run_timers(now_us * 1000);
+		run_adcs(now_us * 1000);
+
+		if(now_us >= next_frame_us) {
+			systick();
+			USB.reg.FNR = (USB.reg.FNR + 1) & 0x7ff;
+			if(USB.reg.CNTR & (1 << 9)) {
+				USB.reg.ISTR.v |= 1 << 9;	// SOF
+				fire(interrupt<Interrupt::USB_LP_CAN_RX0>, Interrupt::USB_LP_CAN_RX0);
+			}
+			collect_reports();
+			next_frame_us += 1000;
+		}
+
+		while(next_event < events.size() && events[next_event].time <= now_us) {
+			run_command(events[next_event++]);
+		}
+	}
+
+	if(next_event >= events.size() && now_us > (events.empty() ? 0 : events.back().time) + 100000) {
+		print_stats();
+		exit(0);
+	}
+}
+
+void loop_hook() {
+	Clock::time_point t = Clock::now();
+	if(in_loop) {
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t - loop_start).count();
+		iterations++;
+		loop_ns.add(ns);
+		dma_started = false;
+		complete_all_dma();
+		if(dma_started) {
+			led_loop_ns.add(ns);
+		}
+	} else {
+		complete_all_dma();
+	}
+	in_loop = true;
+
+	// Flash operations since the last iteration held it up for as long as
+	// they took. Peripherals carry on meanwhile, interrupts only as far as
+	// held_up() lets them.
+	uint32_t stall = sim_flash_busy_us;
+	sim_flash_busy_us = 0;
+	if(stall > longest_stall_us) {
+		longest_stall_us = stall;
+	}
+	flash_busy_until_us = now_us + stall;
+
+	advance(step_us + stall);
+
+	loop_start = Clock::now();
+	sync_cyccnt();
+}
+
+bool ep_ready(uint32_t ep) {
+	return ep == 0 || (ep < 8 && (USB.reg.EPR[ep].v & 0x30) == 0x20);
+}
+
+void ep_write(uint32_t ep, const uint8_t* buf, uint32_t len) {
+	if(ep == 0) {
+		if(len) {
+			printf("ep0:");
+			for(uint32_t i = 0; i < len; i++) {
+				printf(" %02x", buf[i]);
+			}
+			printf("\n");
+			if(ep0_expected.size()) {
+				const std::string& p = ep0_expected.front();
+				bool ok = p.size() / 2 <= len;
+				for(size_t i = 0; ok && i + 1 < p.size(); i += 2) {
+					ok = p.substr(i, 2) == ".." || strtoul(p.substr(i, 2).c_str(), nullptr, 16) == buf[i / 2];
+				}
+				if(!ok) {
+					printf("expect: ep0 report is not %s\n", p.c_str());
+					failures++;
+				}
+				ep0_expected.erase(ep0_expected.begin());
+			}
+		}
+		return;
+	}
+	if(ep >= 8) {
+		return;
+	}
+	Endpoint& e = endpoints[ep];
+	if(e.staged) {
+		e.restaged++;
+	}
+	e.staged = true;
+	e.len = len > sizeof(e.data) ? sizeof(e.data) : len;
+	memcpy(e.data, buf, e.len);
+	USB.reg.EPR[ep].v |= 0x30;
+	e.written_us = now_us;
+}
+
+};
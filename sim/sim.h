@@ -0,0 +1,31 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// Host-side simulation of the controller hardware. The mocked laks headers
+// under sim/laks call into here; everything else in roxy/ builds unchanged.
+namespace Sim {
+	extern uint64_t now_us;
+	extern uint32_t systick_ms;		// Falls behind while SysTick is held off
+
+	class USB_device {
+		public:
+			virtual bool sim_control(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, const uint8_t* data, uint32_t len) = 0;
+	};
+
+	// Called by USB_f1::init() for the device main() selected, with its
+	// configuration descriptor.
+	void attach(USB_device* dev, const uint8_t* conf_desc);
+
+	// Moves simulated time forward, firing timer interrupts and script events.
+	void advance(uint32_t us);
+
+	// Called once per main loop iteration from USB_f1::process().
+	void loop_hook();
+
+	bool ep_ready(uint32_t ep);
+	void ep_write(uint32_t ep, const uint8_t* buf, uint32_t len);
+};
+
+#endif